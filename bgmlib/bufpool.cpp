@@ -0,0 +1,219 @@
+// Music Room BGM Library
+// ----------------------
+// bufpool.cpp - Reusable large buffer pool
+// ----------------------
+// "" Nmlgc, 2011
+
+#include "platform.h"
+#include "list.h"
+#include "bufpool.h"
+
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+const ulong POOL_MIN_CLASS = 0x10000;	// 64 KiB
+
+ulong BufPool::PageSize = 0;
+
+BufPool::BufPool()
+{
+	Cached = 0;
+	InUse = Peak = Total = 0;
+	MaxCache = 256 * 1024 * 1024;
+	HugePages = false;
+
+	if(!PageSize)
+	{
+#ifdef WIN32
+		SYSTEM_INFO SI;
+		GetSystemInfo(&SI);
+		PageSize = SI.dwPageSize;
+#else
+		PageSize = sysconf(_SC_PAGESIZE);
+#endif
+	}
+}
+
+// Rounds [Size] up to the next quarter step between two powers of two, so that at most 25% are wasted.
+ulong BufPool::SizeClass(const ulong& Size)
+{
+	ulong Step, p = POOL_MIN_CLASS;
+
+	if(Size <= p)	return p;
+	while((p << 1) < Size && (p << 1) > p)	p <<= 1;
+	Step = p >> 2;
+
+	return ((Size + Step - 1) / Step) * Step;
+}
+
+char* BufPool::SysAlloc(const ulong& Size)
+{
+	char* Ret = NULL;
+#ifdef WIN32
+	if(HugePages)
+	{
+		SIZE_T Large = GetLargePageMinimum();
+		// Only works with SeLockMemoryPrivilege, fall back silently otherwise
+		if(Large && !(Size % Large))	Ret = (char*)VirtualAlloc(NULL, Size, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+	}
+	if(!Ret)	Ret = (char*)VirtualAlloc(NULL, Size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+#else
+	void* Map = mmap(NULL, Size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if(Map == MAP_FAILED)	return NULL;
+#ifdef MADV_HUGEPAGE
+	if(HugePages)	madvise(Map, Size, MADV_HUGEPAGE);
+#endif
+	Ret = (char*)Map;
+#endif
+	return Ret;
+}
+
+void BufPool::SysFree(char* Buf, const ulong& Size)
+{
+#ifdef WIN32
+	VirtualFree(Buf, 0, MEM_RELEASE);
+#else
+	munmap(Buf, Size);
+#endif
+}
+
+ListEntry<PoolBuf>* BufPool::Find(char* Buf)
+{
+	ListEntry<PoolBuf>* Cur = Bufs.First();
+	while(Cur)
+	{
+		if(Cur->Data.Buf == Buf)	return Cur;
+		Cur = Cur->Next();
+	}
+	return NULL;
+}
+
+void BufPool::Evict(const ulong& Need)
+{
+	ListEntry<PoolBuf>* Cur = Bufs.First();
+	while(Cur && (Cached + Need) > MaxCache)
+	{
+		ListEntry<PoolBuf>* Next = Cur->Next();
+		if(!Cur->Data.Used)
+		{
+			SysFree(Cur->Data.Buf, Cur->Data.Cap);
+			Cached -= Cur->Data.Cap;
+			Bufs.Delete(Cur);
+		}
+		Cur = Next;
+	}
+}
+
+char* BufPool::Get(const ulong& Size)
+{
+	FXMutexLock Lock(this->Lock);
+
+	ulong Class = SizeClass(Size);
+	ListEntry<PoolBuf>* Cur = Bufs.First();
+	ListEntry<PoolBuf>* Best = NULL;
+
+	// Best fit among the unused buffers, but don't waste more than the requested size
+	while(Cur)
+	{
+		PoolBuf& P = Cur->Data;
+		if(!P.Used && P.Cap >= Class && (P.Cap - Class) <= Size)
+		{
+			if(!Best || P.Cap < Best->Data.Cap)	Best = Cur;
+		}
+		Cur = Cur->Next();
+	}
+
+	if(Best)	Cached -= Best->Data.Cap;
+	else
+	{
+		PoolBuf New;
+		New.Cap = ((Class + PageSize - 1) / PageSize) * PageSize;
+		New.Buf = SysAlloc(New.Cap);
+		if(!New.Buf)
+		{
+			// Out of address space? Drop everything we don't need and try again.
+			Evict(MaxCache);
+			New.Buf = SysAlloc(New.Cap);
+			if(!New.Buf)	return NULL;
+		}
+		New.Used = false;
+		Best = Bufs.Add(&New);
+	}
+	Best->Data.Used = true;
+
+	InUse += Best->Data.Cap;
+	Total += Size;
+	if(InUse > Peak)	Peak = InUse;
+	return Best->Data.Buf;
+}
+
+char* BufPool::Resize(char* Buf, const ulong& Size)
+{
+	ulong Cap;
+	char* New;
+
+	if(!Buf)	return Get(Size);
+	{
+		FXMutexLock Lock(this->Lock);
+		ListEntry<PoolBuf>* E = Find(Buf);
+		if(!E)	return (char*)realloc(Buf, Size);	// Not ours, must be a malloc() buffer
+		Cap = E->Data.Cap;
+	}
+	if(Cap >= Size)	return Buf;
+
+	New = Get(Size);
+	if(!New)	return NULL;
+	memcpy(New, Buf, Cap);
+	Release(Buf);
+	return New;
+}
+
+void BufPool::Release(char* Buf)
+{
+	if(!Buf)	return;
+
+	FXMutexLock Lock(this->Lock);
+	ListEntry<PoolBuf>* E = Find(Buf);
+	if(!E)
+	{
+		free(Buf);	// see Resize()
+		return;
+	}
+
+	PoolBuf& P = E->Data;
+	InUse -= P.Cap;
+
+	if(P.Cap > MaxCache)
+	{
+		SysFree(P.Buf, P.Cap);
+		Bufs.Delete(E);
+		return;
+	}
+	Evict(P.Cap);	// [P] is still marked as used here and stays
+	P.Used = false;
+	Cached += P.Cap;
+}
+
+void BufPool::Trim()
+{
+	FXMutexLock Lock(this->Lock);
+	ulong Max = MaxCache;
+	MaxCache = 0;
+	Evict(0);
+	MaxCache = Max;
+}
+
+BufPool::~BufPool()
+{
+	ListEntry<PoolBuf>* Cur = Bufs.First();
+	while(Cur)
+	{
+		SysFree(Cur->Data.Buf, Cur->Data.Cap);
+		Cur = Cur->Next();
+	}
+	Bufs.Clear();
+}
@@ -0,0 +1,67 @@
+// Music Room BGM Library
+// ----------------------
+// bufpool.h - Reusable large buffer pool
+// ----------------------
+// "" Nmlgc, 2011
+
+#ifndef BGMLIB_BUFPOOL_H
+#define BGMLIB_BUFPOOL_H
+
+#include <FXThread.h>
+
+// Pooled buffer
+struct PoolBuf
+{
+	char*	Buf;
+	ulong	Cap;	// Actually usable size
+	bool	Used;
+};
+
+// Whole-file buffers (decryption, decoding, PCM assembly) are way too large for the allocator to recycle them nicely.
+// This keeps them around, page-aligned and rounded up to a size class, so that the next track just picks one up again.
+class BufPool
+{
+protected:
+	FXMutex	Lock;
+	List<PoolBuf>	Bufs;
+
+	ulong	Cached;	// Bytes in unused buffers
+
+	// Statistics
+	FXulong	InUse;
+	FXulong	Peak;
+	FXulong	Total;
+
+	static ulong	PageSize;
+
+	ulong	SizeClass(const ulong& Size);
+	char*	SysAlloc(const ulong& Size);
+	void	SysFree(char* Buf, const ulong& Size);
+	void	Evict(const ulong& Need);	// Frees unused buffers until <Cached> + [Need] fits into <MaxCache>
+
+	ListEntry<PoolBuf>*	Find(char* Buf);
+
+	BufPool();
+
+public:
+	SINGLETON(BufPool);
+
+	ulong	MaxCache;	// Maximum amount of bytes kept in unused buffers
+	bool	HugePages;	// Try to back new buffers with large pages
+
+	char*	Get(const ulong& Size);	// Returns a buffer of at least [Size] bytes
+	// realloc() equivalent. [Buf] may be NULL.
+	// Buffers that don't come from the pool are assumed to come from malloc(), and are passed on to realloc().
+	char*	Resize(char* Buf, const ulong& Size);
+	void	Release(char* Buf);	// Gives [Buf] back to the pool, or free()s it if it's not ours. [Buf] may be NULL.
+	void	Trim();	// Frees all unused buffers
+
+	FXulong	PeakBytes()	{return Peak;}	// Maximum number of bytes handed out at the same time
+	FXulong	TotalBytes()	{return Total;}	// Number of bytes handed out in total
+
+	~BufPool();
+};
+
+#define POOL_RELEASE(x)	{BufPool::Inst().Release(x); (x) = NULL;}	// Safe release of a pool buffer
+
+#endif /* BGMLIB_BUFPOOL_H */
@@ -9,9 +9,18 @@
 #include "packmethod.h"
 #include "ui.h"
 #include "libvorbis.h"
+#include "bufpool.h"
 #include <FXFile.h>
 #include <vorbis/vorbisenc.h>
 
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define PCM_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && !defined(__ARM_BIG_ENDIAN)
+#define PCM_NEON
+#include <arm_neon.h>
+#endif
+
 const int OV_BLOCK = 8192;
 
 // Vorbis Stuff
@@ -37,17 +46,32 @@ int FXFile_tell(FXFile* _File)
 }
 // ------------
 
-bool DumpDecrypt(GameInfo* GI, TrackInfo* TI, const FXString& OutFN)
+bool DumpDecrypt(GameInfo* GI, TrackInfo* TI, const FXString& OutFN, volatile FXulong* p)
 {
 	bool Ret = false;
 	FXFile Src;
 
 	if(!GI->OpenBGMFile(Src, TI))	return Ret;
-	Ret = GI->PM->Dump(GI, Src, TI->GetStart(), TI->FS, OutFN);
+	Ret = GI->PM->Dump(GI, Src, TI->GetStart(), TI->FS, OutFN, p);
 	Src.close();
 	return Ret;
 }
 
+bool DecryptBGM(GameInfo* GI, TrackInfo* TI, VFile& Dst, volatile FXulong* p)
+{
+	FXFile Src;
+
+	Dst.Clear();
+	if(!GI->OpenBGMFile(Src, TI))	return false;
+	Dst.Create(TI->FS);
+	if(!Dst.Buf)	return false;
+
+	GI->PM->DecryptFile(GI, Src, Dst.Buf, TI->GetStart(), TI->FS, p);
+	Dst.Write = Dst.Size;
+	Src.close();
+	return true;
+}
+
 // Virtual file
 // ------------
 VFile::VFile()
@@ -65,14 +89,13 @@ void VFile::Create(const ulong& _Size)
 {
 	Size = _Size;
 	Read = Write = 0;
-	Buf = (char*)malloc(Size);
+	Buf = BufPool::Inst().Get(Size);
 }
 
 void VFile::Clear()
 {
 	Size = Read = Write = 0;
-	free(Buf);
-	Buf = NULL;
+	POOL_RELEASE(Buf);
 }
 
 VFile::~VFile()
@@ -110,27 +133,225 @@ int VFile_tell(VFile* VF)
 {
 	return VF->Read;
 }
+
+VFileIO::VFileIO(VFile& _VF) : VF(_VF)
+{
+	access = WriteOnly;
+}
+
+FXival VFileIO::writeBlock(const void* Data, FXival Count)
+{
+	char* New;
+
+	if(Count <= 0)	return 0;
+
+	New = BufPool::Inst().Resize(VF.Buf, VF.Write + Count);
+	if(!New)	return -1;
+	VF.Buf = New;
+
+	memcpy(VF.Buf + VF.Write, Data, Count);
+	VF.Write += Count;
+	VF.Size = VF.Write;
+	return Count;
+}
+// ------------
+
+// Loop splice
 // ------------
+LoopSplice::LoopSplice()
+{
+	Buf = NULL;
+	Reset(NULL);
+}
+
+bool LoopSplice::Alloc()
+{
+	if(!Buf)	Buf = (char*)malloc(MaxSize);
+	return Buf != NULL;
+}
+
+void LoopSplice::Reset(TrackInfo* NewTI)
+{
+	TI = NewTI;
+	Len = Read = Pos = 0;
+	Seek = false;
+}
+
+ulong LoopSplice::Get(char* Dst, const ulong& Size)
+{
+	ulong Copy = MIN(Size, Len - Read);
+
+	memcpy(Dst, Buf + Read, Copy);
+	Read += Copy;
+	return Copy;
+}
+
+LoopSplice::~LoopSplice()
+{
+	SAFE_FREE(Buf);
+}
+// ------------
+
+// Encoder setup cache
+// -------------------
+// vorbis_encode_init_vbr() and the first vorbis_analysis_init() build the complete codebooks and psychoacoustic tables,
+// and chained streams used to do that again for every single link. After that, the codec setup is only ever read,
+// so all streams with the same parameters can share one, together with its two fixed header packets.
+// The cache only lives as long as the process, so the encoder version is always the same.
+struct VorbisSetup
+{
+	int	channels;
+	long	rate;
+	float	quality;
+
+	vorbis_info	vi;	// Prototype
+	ogg_packet	header;	// Identification header
+	ogg_packet	header_code;	// Codebook header
+};
+
+class VorbisSetupCache
+{
+protected:
+	FXMutex	Lock;
+	List<VorbisSetup>	Setups;
+
+	VorbisSetupCache()	{}
+
+public:
+	SINGLETON(VorbisSetupCache);
+
+	VorbisSetup*	Get(const int& channels, const long& rate, const float& quality);	// NULL if libvorbis can't do this
+	VorbisSetup*	Find(vorbis_info* vi);	// Returns the setup [vi] was copied from, if any
+
+	// Writes the headers of [S] with the comments in [vc] to [os] and flushes them to [out]. Returns the number of bytes written.
+	uint	WriteHeaders(FXIO& out, ogg_stream_state* os, VorbisSetup* S, vorbis_comment* vc);
+
+	~VorbisSetupCache();
+};
+
+static void packet_dup(ogg_packet* dst, const ogg_packet* src)
+{
+	*dst = *src;
+	dst->packet = new unsigned char[src->bytes];
+	memcpy(dst->packet, src->packet, src->bytes);
+}
+
+VorbisSetup* VorbisSetupCache::Get(const int& channels, const long& rate, const float& quality)
+{
+	FXMutexLock Lock(this->Lock);
+
+	VorbisSetup New;
+	vorbis_dsp_state vd;
+	vorbis_comment vc;
+	ogg_packet header, header_comm, header_code;
+
+	ListEntry<VorbisSetup>* Cur = Setups.First();
+	while(Cur)
+	{
+		VorbisSetup& S = Cur->Data;
+		if(S.channels == channels && S.rate == rate && S.quality == quality)	return &S;
+		Cur = Cur->Next();
+	}
+
+	vorbis_info_init(&New.vi);
+	if(vorbis_encode_init_vbr(&New.vi, channels, rate, quality))
+	{
+		vorbis_info_clear(&New.vi);
+		return NULL;
+	}
+
+	// This also builds the encoder codebooks, so that no stream ever has to write to the codec setup again
+	vorbis_analysis_init(&vd, &New.vi);
+	vorbis_comment_init(&vc);
+	vorbis_analysis_headerout(&vd, &vc, &header, &header_comm, &header_code);
+	packet_dup(&New.header, &header);
+	packet_dup(&New.header_code, &header_code);
+	vorbis_comment_clear(&vc);
+	vorbis_dsp_clear(&vd);
+
+	New.channels = channels;
+	New.rate = rate;
+	New.quality = quality;
+
+	Cur = Setups.Add(&New);
+	return &Cur->Data;
+}
+
+uint VorbisSetupCache::WriteHeaders(FXIO& out, ogg_stream_state* os, VorbisSetup* S, vorbis_comment* vc)
+{
+	ogg_page og;
+	ogg_packet header_comm;
+	uint ret = 0;
+
+	// Only the comment header differs between streams, and that one doesn't need any encoder state
+	vorbis_commentheader_out(vc, &header_comm);
+	ogg_stream_packetin(os, &S->header);	// automatically placed in its own page
+	ogg_stream_packetin(os, &header_comm);
+	ogg_stream_packetin(os, &S->header_code);
+	ogg_packet_clear(&header_comm);
+
+	// This ensures the actual audio data will start on a new page, as per spec
+	while(ogg_stream_flush(os, &og))
+	{
+		out.writeBlock(og.header, og.header_len);
+		out.writeBlock(og.body, og.body_len);
+		ret += og.header_len + og.body_len;
+	}
+	return ret;
+}
+
+VorbisSetup* VorbisSetupCache::Find(vorbis_info* vi)
+{
+	FXMutexLock Lock(this->Lock);
+
+	ListEntry<VorbisSetup>* Cur = Setups.First();
+	while(Cur)
+	{
+		if(Cur->Data.vi.codec_setup == vi->codec_setup)	return &Cur->Data;
+		Cur = Cur->Next();
+	}
+	return NULL;
+}
+
+VorbisSetupCache::~VorbisSetupCache()
+{
+	ListEntry<VorbisSetup>* Cur = Setups.First();
+	while(Cur)
+	{
+		SAFE_DELETE_ARRAY(Cur->Data.header.packet);
+		SAFE_DELETE_ARRAY(Cur->Data.header_code.packet);
+		vorbis_info_clear(&Cur->Data.vi);
+		Cur = Cur->Next();
+	}
+	Setups.Clear();
+}
+// -------------------
 
 // Encoding state
 // --------------
 OggVorbis_EncState::OggVorbis_EncState()
 {
 	out = NULL;
+	src = NULL;
 	memset(&stream_out, 0, sizeof(ogg_stream_state));
 	vorbis_info_init(&vi);
 	memset(&vd, 0, sizeof(vorbis_dsp_state));
 	memset(&vb, 0, sizeof(vorbis_block));
 }
 
-bool OggVorbis_EncState::setup(FXFile* _out, const float& freq, const float& quality)
+bool OggVorbis_EncState::setup(FXIO* _out, const float& freq, const float& quality)
 {
 	int ret;
 
 	out = _out;
-	vorbis_info_init(&vi);
-	ret = vorbis_encode_init_vbr(&vi, 2, freq, quality);
-	if(ret)	return false;
+	if(!src)	vorbis_info_clear(&vi);
+	src = VorbisSetupCache::Inst().Get(2, (long)freq, quality);
+	if(!src)
+	{
+		vorbis_info_init(&vi);
+		return false;
+	}
+	vi = src->vi;	// Shallow copy
 	ret = vorbis_analysis_init(&vd,&vi);
 	ret = vorbis_block_init(&vd,&vb);
 	return true;
@@ -149,30 +370,11 @@ uint OggVorbis_EncState::write_headers()
 
 uint OggVorbis_EncState::write_headers(vorbis_comment* vc)
 {
-	uint ret = 0;
-	ogg_page og;
-	ogg_packet header;
-    ogg_packet header_comm;
-    ogg_packet header_code;
-
-	if(!vc && !stream_out.body_data)	return 0;
-	
-	vorbis_analysis_headerout(&vd, vc, &header,&header_comm,&header_code);
-    ogg_stream_packetin(&stream_out,&header); // automatically placed in its own page
-	ogg_stream_packetin(&stream_out,&header_comm);
-	ogg_stream_packetin(&stream_out,&header_code);
-    
-	// This ensures the actual audio data will start on a new page, as per spec
-	while(ogg_stream_flush(&stream_out,&og))
-	{
-		out->writeBlock(og.header,og.header_len);
-		out->writeBlock(og.body,og.body_len);
-		ret += og.header_len, og.body_len;
-	}
-	return ret;
+	if(!src || (!vc && !stream_out.body_data))	return 0;
+	return VorbisSetupCache::Inst().WriteHeaders(*out, &stream_out, src, vc);
 }
 
-uint OggVorbis_EncState::new_stream(FXFile* out, const float& freq, const float& quality, long serialno, vorbis_comment* vc)
+uint OggVorbis_EncState::new_stream(FXIO* out, const float& freq, const float& quality, long serialno, vorbis_comment* vc)
  {
 	ogg_stream_clear(&stream_out);
 	clear();
@@ -181,25 +383,18 @@ uint OggVorbis_EncState::new_stream(FXFile* out, const float& freq, const float&
 	return write_headers(vc);
  }
 
-uint OggVorbis_EncState::encode_pcm(char* buf, const int& size)
+float** OggVorbis_EncState::analysis_buffer(const int& samples)
+{
+	return vorbis_analysis_buffer(&vd, samples);
+}
+
+uint OggVorbis_EncState::encode_wrote(const int& samples)
 {
 	ogg_packet op;
-	float **buffer;
-	long i;
 	uint ret = 0;
 
-	// expose the buffer to submit data
-	buffer=vorbis_analysis_buffer(&vd,size/4);
-
-	// uninterleave samples
-	for(i=0;i<size/4;i++)
-	{
-		buffer[0][i]=((buf[i*4+1]<<8)| (0x00ff&(int)buf[i*4]))/32768.f;
-		buffer[1][i]=((buf[i*4+3]<<8)| (0x00ff&(int)buf[i*4+2]))/32768.f;
-	}
-
 	// tell the library how much we actually submitted
-	vorbis_analysis_wrote(&vd,i);
+	vorbis_analysis_wrote(&vd, samples);
 
 	if(!stream_out.body_data)	return 0;
 
@@ -221,6 +416,53 @@ uint OggVorbis_EncState::encode_pcm(char* buf, const int& size)
 	return ret;
 }
 
+// Splits [frames] interleaved little-endian 16-bit stereo frames into the float channels [l] and [r].
+// Multiplying by 1/32768 is exact, so the vector paths give the same bits as the scalar division.
+void deinterleave_s16(float* l, float* r, const char* buf, const long& frames)
+{
+	long i = 0;
+#if defined(PCM_SSE2)
+	const __m128 scale = _mm_set1_ps(1.0f / 32768.0f);
+	for(; (i + 4) <= frames; i += 4)
+	{
+		__m128i x = _mm_loadu_si128((const __m128i*)&buf[i*4]);
+		__m128i xl = _mm_srai_epi32(_mm_slli_epi32(x, 16), 16);
+		__m128i xr = _mm_srai_epi32(x, 16);
+
+		_mm_storeu_ps(&l[i], _mm_mul_ps(_mm_cvtepi32_ps(xl), scale));
+		_mm_storeu_ps(&r[i], _mm_mul_ps(_mm_cvtepi32_ps(xr), scale));
+	}
+#elif defined(PCM_NEON)
+	for(; (i + 8) <= frames; i += 8)
+	{
+		int16x8x2_t x = vld2q_s16((const int16_t*)&buf[i*4]);
+
+		vst1q_f32(&l[i],     vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(x.val[0]))), 1.0f / 32768.0f));
+		vst1q_f32(&l[i + 4], vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(x.val[0]))), 1.0f / 32768.0f));
+		vst1q_f32(&r[i],     vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(x.val[1]))), 1.0f / 32768.0f));
+		vst1q_f32(&r[i + 4], vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(x.val[1]))), 1.0f / 32768.0f));
+	}
+#endif
+	for(; i < frames; i++)
+	{
+		l[i]=((buf[i*4+1]<<8)| (0x00ff&(int)buf[i*4]))/32768.f;
+		r[i]=((buf[i*4+3]<<8)| (0x00ff&(int)buf[i*4+2]))/32768.f;
+	}
+}
+
+uint OggVorbis_EncState::encode_pcm(char* buf, const int& size)
+{
+	float **buffer;
+	long frames = size/4;
+
+	// expose the buffer to submit data
+	buffer = analysis_buffer(frames);
+
+	// uninterleave samples
+	deinterleave_s16(buffer[0], buffer[1], buf, frames);
+	return encode_wrote(frames);
+}
+
 bool OggVorbis_EncState::encode_file(FXFile& in, const ulong& bytes, char* buf, const ulong& bufsize, volatile FXulong& d, volatile bool* StopReq)
 {
 	ulong Rem = bytes;
@@ -242,7 +484,9 @@ void OggVorbis_EncState::clear()
 {
 	vorbis_block_clear(&vb);
 	vorbis_dsp_clear(&vd);
-	vorbis_info_clear(&vi);
+	if(src)	memset(&vi, 0, sizeof(vorbis_info));
+	else	vorbis_info_clear(&vi);
+	src = NULL;
 }
 
 OggVorbis_EncState::~OggVorbis_EncState()
@@ -252,8 +496,32 @@ OggVorbis_EncState::~OggVorbis_EncState()
 // --------------
 
 #ifdef SUPPORT_VORBIS_PM
+// Decodes the first bytes after the loop point [L] into [LS]. Leaves [vf] right behind them.
+static bool ov_fill_splice(OggVorbis_File* vf, LoopSplice* LS, const ulong& L, const ulong& E)
+{
+	int Link;
+	long Ret;
+	ulong Size = MIN((ulong)LoopSplice::MaxSize, (E - L) * 4);
+
+	if(!LS->Alloc())	return false;
+
+	// Unlike ov_pcm_seek_lap(), this one is sample-exact and doesn't blend anything in
+	if(ov_pcm_seek(vf, L))	return false;
+	LS->Pos = L;
+	LS->Len = 0;
+	while(LS->Len < Size)
+	{
+		Ret = ov_read(vf, LS->Buf + LS->Len, Size - LS->Len, 0, 2, 1, &Link);
+		if(Ret == OV_HOLE)	continue;
+		if(Ret <= 0)	break;
+		LS->Len += Ret;
+	}
+	return LS->Len != 0;
+}
+
 // Decodes [Size] bytes from [vf] into [buffer]. Loops according to the info in [TI].
-ogg_int64_t ov_read_bgm(OggVorbis_File* vf, char* buffer, const ulong& size, TrackInfo* TI)
+// With [LS], loop transitions are bit-exact and served from the splice instead of seeking on the spot.
+ogg_int64_t ov_read_bgm(OggVorbis_File* vf, char* buffer, const ulong& size, TrackInfo* TI, LoopSplice* LS)
 {
 	int Link;
 	long Ret = 1;
@@ -262,22 +530,225 @@ ogg_int64_t ov_read_bgm(OggVorbis_File* vf, char* buffer, const ulong& size, Tra
 
 	ulong L, E;
 	TI->GetPos(FMT_SAMPLE, false, NULL, &L, &E);
+	if(L == E)	L = 0;
+
+	if(LS && LS->TI != TI)	LS->Reset(TI);
 
 	while(Rem > 0)
 	{
+		if(LS)
+		{
+			if(LS->Active())
+			{
+				Rem -= LS->Get(buffer + size - Rem, Rem);
+				Cur = LS->Pos + LS->Read / 4;
+				continue;
+			}
+			if(LS->Seek)
+			{
+				// Catch up behind the splice
+				ov_pcm_seek(vf, LS->Pos + LS->Len / 4);
+				LS->Seek = false;
+			}
+		}
+
 		Ret = ov_read(vf, buffer + size - Rem, Rem, 0, 2, 1, &Link);
 		Cur = ov_pcm_tell(vf);
 		if(Cur >= E)
 		{
-			ov_pcm_seek_lap(vf, L != E ? L : 0);
 			Ret -= (Cur - E) * 4;
-			Cur = ov_pcm_tell(vf);
+			if(LS && (LS->Len || ov_fill_splice(vf, LS, L, E)))
+			{
+				// Freshly filled splices already left [vf] behind them
+				LS->Seek = LS->Read != 0;
+				LS->Read = 0;
+				Cur = L;
+			}
+			else
+			{
+				ov_pcm_seek_lap(vf, L);
+				Cur = ov_pcm_tell(vf);
+			}
 		}
 		Rem -= Ret;
 	}
 	return Cur;
 }
 
+// Decodes [Samples] stereo samples from [vf] into the planar float buffers [pcm], without ever going through 16-bit.
+// Loops according to the info in [TI] with a sample-exact seek, unlike ov_read_bgm() without a splice.
+ogg_int64_t ov_read_float_bgm(OggVorbis_File* vf, float** pcm, const long& Samples, TrackInfo* TI)
+{
+	int Link, ch;
+	long Ret, Done = 0;
+	float** Src;
+	ogg_int64_t Cur = ov_pcm_tell(vf);
+	vorbis_info* vi;
+
+	ulong L, E;
+	TI->GetPos(FMT_SAMPLE, false, NULL, &L, &E);
+
+	while(Done < Samples)
+	{
+		Ret = ov_read_float(vf, &Src, Samples - Done, &Link);
+		if(Ret == OV_HOLE)	continue;
+		if(Ret <= 0)	break;
+
+		vi = ov_info(vf, Link);
+		Cur = ov_pcm_tell(vf);
+		if(Cur >= E)	Ret = MAX(Ret - (long)(Cur - E), 0);
+
+		// Mono streams are played on both channels
+		for(ch = 0; ch < 2; ch++)	memcpy(pcm[ch] + Done, Src[ch % vi->channels], Ret * sizeof(float));
+		Done += Ret;
+
+		if(Cur >= E)
+		{
+			// Not ov_pcm_seek_lap() like ov_read_bgm() without a splice: that would blend the loop start with the end,
+			// and the PCM pipeline every other encoder reads from doesn't do that either
+			if(ov_pcm_seek(vf, L != E ? L : 0))	break;
+			Cur = ov_pcm_tell(vf);
+		}
+	}
+	// Premature end of stream
+	for(ch = 0; ch < 2; ch++)	memset(pcm[ch] + Done, 0, (Samples - Done) * sizeof(float));
+	return Cur;
+}
+
+// Page index
+// ----------
+OggPageIndex::OggPageIndex()
+{
+	Sample = Offset = NULL;
+	Count = 0;
+	Link = -1;
+}
+
+void OggPageIndex::Clear()
+{
+	SAFE_FREE(Sample);
+	SAFE_FREE(Offset);
+	Count = 0;
+	Link = -1;
+}
+
+bool OggPageIndex::Build(OggVorbis_File* vf, const ogg_int64_t& Start, const ogg_int64_t& End)
+{
+	ogg_sync_state Sync;
+	ogg_page Page;
+	ogg_int64_t Base = 0, Off, Granule;
+	ulong Cap = 0;
+	long Ret;
+	char* Buf;
+
+	Clear();
+	if(!vf->seekable || !vf->callbacks.seek_func)	return false;
+
+	// Which logical bitstream are we in?
+	for(Link = 0; Link < vf->links - 1; Link++)
+	{
+		if(Start < Base + vf->pcmlengths[Link * 2 + 1])	break;
+		Base += vf->pcmlengths[Link * 2 + 1];
+	}
+
+	Off = vf->dataoffsets[Link];
+	if(vf->callbacks.seek_func(vf->datasource, Off, SEEK_SET))	return false;
+
+	ogg_sync_init(&Sync);
+	while(Off < vf->offsets[Link + 1])
+	{
+		Ret = ogg_sync_pageseek(&Sync, &Page);
+		if(Ret < 0)	Off -= Ret;	// Skipped garbage
+		else if(Ret == 0)
+		{
+			Buf = ogg_sync_buffer(&Sync, OV_BLOCK);
+			Ret = vf->callbacks.read_func(Buf, 1, OV_BLOCK, vf->datasource);
+			if(Ret <= 0)	break;
+			ogg_sync_wrote(&Sync, Ret);
+		}
+		else
+		{
+			Granule = ogg_page_granulepos(&Page);
+			// Pages without a finished packet don't have a position
+			if(Granule >= 0 && ogg_page_serialno(&Page) == vf->serialnos[Link])
+			{
+				if(Count == Cap)
+				{
+					Cap = Cap ? Cap * 2 : 256;
+					Sample = (ogg_int64_t*)realloc(Sample, Cap * sizeof(ogg_int64_t));
+					Offset = (ogg_int64_t*)realloc(Offset, Cap * sizeof(ogg_int64_t));
+					if(!Sample || !Offset)	break;
+				}
+				Sample[Count] = Base + Granule - vf->pcmlengths[Link * 2];
+				Offset[Count] = Off;
+				if(Sample[Count++] >= End)	break;
+			}
+			Off += Ret;
+		}
+	}
+	ogg_sync_clear(&Sync);
+
+	if(!Sample || !Offset)	Clear();
+	return Count != 0;
+}
+
+bool OggPageIndex::Covers(const ogg_int64_t& Pos)
+{
+	return Count && Pos < Sample[Count - 1];
+}
+
+ulong OggPageIndex::Find(const ogg_int64_t& Pos)
+{
+	ulong Lo = 0, Hi = Count, Mid;
+
+	while(Lo < Hi)
+	{
+		Mid = (Lo + Hi) / 2;
+		if(Sample[Mid] <= Pos)	Lo = Mid + 1;
+		else					Hi = Mid;
+	}
+	return Lo;
+}
+
+OggPageIndex::~OggPageIndex()
+{
+	Clear();
+}
+// ----------
+
+int ov_pcm_seek_indexed(OggVorbis_File* vf, OggPageIndex* Index, const ogg_int64_t& pos)
+{
+	char Temp[OV_BLOCK];
+	int Link;
+	long Ret;
+	ulong Page;
+	ogg_int64_t Cur;
+
+	if(!Index || !Index->Covers(pos))	return ov_pcm_seek(vf, pos);
+
+	// ov_raw_seek() drops the packet continued from the page before and decodes the next one without output,
+	// so start one long block earlier
+	Page = Index->Find(pos - vorbis_info_blocksize(ov_info(vf, Index->Link), 1));
+	for(;;)
+	{
+		if(ov_raw_seek(vf, Index->Offset[Page]))	return ov_pcm_seek(vf, pos);
+		Cur = ov_pcm_tell(vf);
+		if(Cur <= pos)	break;
+		if(Page == 0)	return ov_pcm_seek(vf, pos);
+		Page--;
+	}
+
+	// Pre-roll
+	while(Cur < pos)
+	{
+		Ret = ov_read(vf, Temp, (int)MIN((ogg_int64_t)OV_BLOCK, (pos - Cur) * 4), 0, 2, 1, &Link);
+		if(Ret == OV_HOLE)	continue;
+		if(Ret <= 0)	return Ret ? Ret : OV_EOF;
+		Cur += Ret / 4;
+	}
+	return 0;
+}
+
 int ov_bitstream_seek(OggVorbis_File* vf, ogg_int64_t pos, bool seek_to_header)
 {
 	ogg_int64_t seek;
@@ -307,7 +778,7 @@ int ov_bitstream_seek(OggVorbis_File* vf, ogg_int64_t pos, bool seek_to_header)
 // Ogg packet copy functions
 // ===============
 
-void vorbis_write_headers(FXFile& out, ogg_stream_state* os, vorbis_dsp_state* vd, vorbis_comment* vc)
+void vorbis_write_headers(FXIO& out, ogg_stream_state* os, vorbis_dsp_state* vd, vorbis_comment* vc)
 {
 	ogg_page og;
 	ogg_packet header;
@@ -327,29 +798,34 @@ void vorbis_write_headers(FXFile& out, ogg_stream_state* os, vorbis_dsp_state* v
 	}
 }
 
-void vorbis_write_headers(FXFile& out, ogg_stream_state* os, vorbis_info* vi, vorbis_comment* vc)
+void vorbis_write_headers(FXIO& out, ogg_stream_state* os, vorbis_info* vi, vorbis_comment* vc)
 {
 	vorbis_dsp_state vd;
+	VorbisSetup* S = VorbisSetupCache::Inst().Find(vi);
+
+	// Encoder streams just reuse the cached header packets
+	if(S)
+	{
+		VorbisSetupCache::Inst().WriteHeaders(out, os, S, vc);
+		return;
+	}
+
 	vorbis_analysis_init(&vd, vi);
 	vorbis_write_headers(out, os, &vd, vc);
 	vorbis_dsp_clear(&vd);
 }
 
-void vorbis_write_headers(FXFile& out, ogg_stream_state* os, vorbis_info* vi, ogg_packet* header, vorbis_comment* vc, ogg_packet* header_code)
+void vorbis_write_headers(FXIO& out, ogg_stream_state* os, vorbis_info* vi, ogg_packet* header, vorbis_comment* vc, ogg_packet* header_code)
 {
 	ogg_page og;
-	ogg_packet dump[2];
     ogg_packet header_comm;
-	vorbis_dsp_state vd;
 
-	// Because of lolvorbis "we declare everything _we_ see no public use for static",
-	// we have to needlessly include [vi] as parameter, and allocate two fake packets
-	// just to make it create that one comment packet. Great.
-	vorbis_analysis_init(&vd, vi);
-    vorbis_analysis_headerout(&vd, vc, &dump[0],&header_comm,&dump[1]);
+	// [vi] is unused since the comment header doesn't depend on the encoder setup
+	vorbis_commentheader_out(vc, &header_comm);
     ogg_stream_packetin(os,header); // automatically placed in its own page
 	ogg_stream_packetin(os,&header_comm);
 	ogg_stream_packetin(os,header_code);
+	ogg_packet_clear(&header_comm);
     
 	// This ensures the actual audio data will start on a new page, as per spec
 	while(ogg_stream_flush(os,&og))
@@ -357,8 +833,6 @@ void vorbis_write_headers(FXFile& out, ogg_stream_state* os, vorbis_info* vi, og
 		out.writeBlock(og.header,og.header_len);
 		out.writeBlock(og.body,og.body_len);
 	}
-	
-	vorbis_dsp_clear(&vd);
 }
 
 // Adapted from vcut.c
@@ -390,20 +864,25 @@ static long get_blocksize(vorbis_info* vi, ogg_packet *op, int& prevW)
 	return ret;
 }
 
-// Reads an arbitrary amount of bytes from [file_in] into [sync_in].
+// Reads an arbitrary amount of bytes through [read_func] (as in ov_callbacks) from [datasource] into [sync_in].
 // Return value: number of read bytes
-int ogg_update_sync(FXFile& file_in, ogg_sync_state* sync_in)
+int ogg_update_sync(size_t (*read_func)(void*, size_t, size_t, void*), void* datasource, ogg_sync_state* sync_in)
 {
 	static const ulong Read = 4096;
 
 	char *buffer = ogg_sync_buffer(sync_in, Read);
-	int bytes = file_in.readBlock(buffer, Read);
+	int bytes = (int)read_func(buffer, 1, Read, datasource);
 	ogg_sync_wrote(sync_in, bytes);
 	return bytes;
 }
 
+int ogg_update_sync(FXFile& file_in, ogg_sync_state* sync_in)
+{
+	return ogg_update_sync(OV_CALLBACKS_FXFILE.read_func, &file_in, sync_in);
+}
+
 // Writes pages to the given file, or discards them if file is NULL.
-bool write_pages_to_file(ogg_stream_state *stream, FXFile& file, int flush)
+bool write_pages_to_file(ogg_stream_state *stream, FXIO& file, int flush)
 {
 	ogg_page page;
 
@@ -434,7 +913,7 @@ bool write_pages_to_file(ogg_stream_state *stream, FXFile& file, int flush)
 }
 
 // Submits [packet] to [stream_out], and writes filled pages to [out].
-bool ogg_write_packet(FXFile& out, ogg_stream_state* stream_out, ogg_packet *packet)
+bool ogg_write_packet(FXIO& out, ogg_stream_state* stream_out, ogg_packet *packet)
 {
 	int flush;
 
@@ -457,9 +936,77 @@ bool ogg_write_packet(FXFile& out, ogg_stream_state* stream_out, ogg_packet *pac
 	return true;
 }
 
-// Copies audio packets from [file_in] to [file_out].
+// Packet capture
+// --------------
+OggPacketList::OggPacketList()
+{
+	op = NULL;
+	pos = NULL;
+	off = NULL;
+	data = NULL;
+	count = cap = 0;
+	bytes = data_cap = 0;
+}
+
+bool OggPacketList::add(const ogg_packet* p, const ogg_int64_t& sample_pos)
+{
+	if(count == cap)
+	{
+		long new_cap = cap ? (cap << 1) : 256;
+		ogg_packet* new_op = (ogg_packet*)realloc(op, new_cap * sizeof(ogg_packet));
+		if(!new_op)	return false;
+		op = new_op;
+		ogg_int64_t* new_pos = (ogg_int64_t*)realloc(pos, new_cap * sizeof(ogg_int64_t));
+		if(!new_pos)	return false;
+		pos = new_pos;
+		long* new_off = (long*)realloc(off, new_cap * sizeof(long));
+		if(!new_off)	return false;
+		off = new_off;
+		cap = new_cap;
+	}
+	if(bytes + p->bytes > data_cap)
+	{
+		long new_cap = MAX(data_cap << 1, bytes + p->bytes);
+		unsigned char* new_data = (unsigned char*)realloc(data, new_cap);
+		if(!new_data)	return false;
+		data = new_data;
+		data_cap = new_cap;
+	}
+	memcpy(data + bytes, p->packet, p->bytes);
+
+	op[count] = *p;
+	op[count].packet = NULL;
+	pos[count] = sample_pos;
+	off[count] = bytes;
+	bytes += p->bytes;
+	count++;
+	return true;
+}
+
+void OggPacketList::finish()
+{
+	for(long i = 0; i < count; i++)	op[i].packet = data + off[i];
+}
+
+void OggPacketList::clear()
+{
+	SAFE_FREE(op);
+	SAFE_FREE(pos);
+	SAFE_FREE(off);
+	SAFE_FREE(data);
+	count = cap = 0;
+	bytes = data_cap = 0;
+}
+
+OggPacketList::~OggPacketList()
+{
+	clear();
+}
+// --------------
+
+// Copies audio packets from [datasource], read through [read_func], to [file_out].
 // Stops once a given number of samples, or the end of the input stream is reached
-ogg_int64_t ogg_packetcopy(FXFile& file_out, ogg_stream_state* stream_out, FXFile& file_in, ogg_stream_state* stream_in, ogg_sync_state* sync_in, vorbis_info* info_in, ogg_int64_t sample_end, ogg_int64_t sample_start)
+static ogg_int64_t ogg_packetcopy(FXFile& file_out, ogg_stream_state* stream_out, size_t (*read_func)(void*, size_t, size_t, void*), void* datasource, ogg_stream_state* stream_in, ogg_sync_state* sync_in, vorbis_info* info_in, ogg_int64_t sample_end, ogg_int64_t sample_start, OggPacketList* capture)
 {
 	bool eos = false;
 	bool write = (sample_start == 0);
@@ -542,19 +1089,61 @@ ogg_int64_t ogg_packetcopy(FXFile& file_out, ogg_stream_state* stream_out, FXFil
 				}
 
 				if(op.e_o_s)	eos = write = true;
-				if(write)	ogg_write_packet(file_out, stream_out, &op);
+				if(write)
+				{
+					ogg_write_packet(file_out, stream_out, &op);
+					// The last packet's position is where the stream actually ends, after any cut
+					if(capture && !capture->add(&op, (op.e_o_s && op.granulepos >= 0) ? op.granulepos : granulepos))
+					{
+						// Out of memory, the caller will have to copy again
+						capture->clear();
+						capture = NULL;
+					}
+				}
 			}
 		}
-		else if(!eos)	eos = ogg_update_sync(file_in, sync_in) == 0;
+		else if(!eos)	eos = ogg_update_sync(read_func, datasource, sync_in) == 0;
 	}
 	SAFE_FREE(last_packet.packet);
+	if(capture)	capture->finish();
 
 	return granulepos;
 }
 
-ogg_int64_t ogg_packetcopy(FXFile& file_out, ogg_stream_state* stream_out, OggVorbis_File* ov_in, ogg_int64_t sample_end, ogg_int64_t sample_start)
+ogg_int64_t ogg_packetcopy(FXFile& file_out, ogg_stream_state* stream_out, FXFile& file_in, ogg_stream_state* stream_in, ogg_sync_state* sync_in, vorbis_info* info_in, ogg_int64_t sample_end, ogg_int64_t sample_start, OggPacketList* capture)
 {
-	return ogg_packetcopy(file_out, stream_out, *((FXFile*)ov_in->datasource), &ov_in->os, &ov_in->oy, ov_in->vi, sample_end, sample_start);
+	return ogg_packetcopy(file_out, stream_out, OV_CALLBACKS_FXFILE.read_func, &file_in, stream_in, sync_in, info_in, sample_end, sample_start, capture);
+}
+
+// [ov_in] may be opened on anything, not just an FXFile, so keep reading through its own callbacks
+ogg_int64_t ogg_packetcopy(FXFile& file_out, ogg_stream_state* stream_out, OggVorbis_File* ov_in, ogg_int64_t sample_end, ogg_int64_t sample_start, OggPacketList* capture)
+{
+	return ogg_packetcopy(file_out, stream_out, ov_in->callbacks.read_func, ov_in->datasource, &ov_in->os, &ov_in->oy, ov_in->vi, sample_end, sample_start, capture);
+}
+
+ogg_int64_t ogg_packetreplay(FXIO& file_out, ogg_stream_state* stream_out, OggPacketList* list, ogg_int64_t sample_end)
+{
+	ogg_packet op;
+	ogg_int64_t granulepos = 0;
+
+	if(sample_end == 0)	return 0;
+	if(sample_end < 0)	sample_end = 0x7fffffffffffffff + sample_end;
+
+	for(long i = 0; i < list->count; i++)
+	{
+		op = list->op[i];
+		granulepos = list->pos[i];
+
+		// Same cut as in ogg_packetcopy(), and we only wrote that much
+		if(granulepos > sample_end)
+		{
+			op.granulepos = granulepos = sample_end;
+			op.e_o_s = 1;
+		}
+		ogg_write_packet(file_out, stream_out, &op);
+		if(op.e_o_s)	break;
+	}
+	return granulepos;
 }
 // -------
 
@@ -9,6 +9,7 @@
 
 #include <vorbis/codec.h>
 #include <vorbis/vorbisfile.h>
+#include <FXIO.h>
 
 extern const int OV_BLOCK;	// Ogg Vorbis read block size;
 
@@ -29,6 +30,71 @@ public:
 	void Create(const ulong& Size);
 	void Clear();
 };
+
+// Writing end of a virtual file, growing it as necessary. Used to keep encoded streams in memory.
+class VFileIO : public FXIO
+{
+protected:
+	VFile&	VF;
+
+public:
+	VFileIO(VFile& VF);
+
+	virtual FXbool isOpen() const	{return true;}
+	virtual FXival writeBlock(const void* Data, FXival Count);
+};
+// ------------
+
+struct TrackInfo;
+
+// Loop splice.
+// Resident copy of the first samples after a track's loop point, decoded once when the loop end is reached for the first time.
+// The loop-aware readers hand it out at every following loop end instead of seeking back,
+// and only reposition the source to the end of the copy once it's used up.
+// ------------
+struct LoopSplice
+{
+	static const ulong MaxSize = 0x8000;	// 8192 16-bit stereo samples
+
+	TrackInfo*	TI;	// Track <Buf> belongs to
+	char*	Buf;
+	ulong	Len;	// Valid bytes in <Buf>. 0 until the loop end was reached once.
+	ulong	Read;	// Bytes of <Buf> already handed out since the last loop end
+	ulong	Pos;	// Source position of <Buf> (samples for Vorbis, bytes for PCM)
+	bool	Seek;	// Source has yet to be repositioned to the end of <Buf>
+
+	LoopSplice();
+	~LoopSplice();
+
+	bool Alloc();	// Makes sure that <Buf> exists
+	void Reset(TrackInfo* NewTI);	// Invalidates the copy and binds it to [NewTI]
+	ulong Get(char* Dst, const ulong& Size);	// Copies up to [Size] unread bytes to [Dst]. Returns the number of bytes copied.
+	bool Active()	{return Read < Len;}
+	void Skip()	{Read = Len; Seek = false;}	// Drops the rest of the copy after the source was repositioned elsewhere
+};
+// ------------
+
+// Page index.
+// Maps the PCM positions of a logical bitstream's pages to their byte offsets,
+// so that seeks can land on the right page with a single raw seek instead of bisecting the file every time.
+// ------------
+struct OggPageIndex
+{
+	int	Link;	// Indexed logical bitstream
+	ogg_int64_t*	Sample;	// PCM position (as returned by ov_pcm_tell()) at the end of each page
+	ogg_int64_t*	Offset;	// Byte offset of each page
+	ulong	Count;
+
+	OggPageIndex();
+	~OggPageIndex();
+
+	// Indexes the pages of the logical bitstream in [vf] containing [Start], up to the one containing [End].
+	// Moves the file cursor of [vf] behind its back, so seek [vf] afterwards!
+	bool Build(OggVorbis_File* vf, const ogg_int64_t& Start, const ogg_int64_t& End);
+	bool Covers(const ogg_int64_t& Pos);
+	ulong Find(const ogg_int64_t& Pos);	// Returns the first page ending behind [Pos]
+	void Clear();
+};
 // ------------
 
 class PackMethod;
@@ -91,34 +157,52 @@ static ov_callbacks OV_CALLBACKS_VFILE =
 // ----------------
 
 #ifdef BGMLIB_INFOSTRUCT_H
-bool DumpDecrypt(GameInfo* GI, TrackInfo* TI, const FXString& FN);
+bool DumpDecrypt(GameInfo* GI, TrackInfo* TI, const FXString& FN, volatile FXulong* p = NULL);	// [p]: Progress in bytes, optional
+bool DecryptBGM(GameInfo* GI, TrackInfo* TI, VFile& Dst, volatile FXulong* p = NULL);	// Same as DumpDecrypt(), but into memory. Open [Dst] with OV_CALLBACKS_VFILE.
+bool OpenVorbisFile(FXFile& File, OggVorbis_File& VF, GameInfo* GI, TrackInfo* TI);	// Opens [GI->BGMFile] and writes handles to [File] and [VF]. [VF] shares the parsed headers of a cached master handle.
 bool OpenVorbisBGM(FXFile& File, OggVorbis_File& VF, GameInfo* GI, TrackInfo* TI);	// Opens [GI->BGMFile], writes handles to [File] and [VF], and seeks to [TI]
+void CloseVorbisMaster();	// Releases the cached master handle of OpenVorbisFile()
 
 // Decodes [Size] bytes from [vf] into [buffer]. Loops according to the info in [TI].
-ogg_int64_t ov_read_bgm(OggVorbis_File* vf, char* buffer, const ulong& Size, TrackInfo* TI);
+// With [LS], loop transitions are bit-exact and served from the splice instead of seeking on the spot.
+ogg_int64_t ov_read_bgm(OggVorbis_File* vf, char* buffer, const ulong& Size, TrackInfo* TI, LoopSplice* LS = NULL);
+
+// Decodes [Samples] stereo samples from [vf] into the planar float buffers [pcm], without ever going through 16-bit.
+// Loops according to the info in [TI].
+ogg_int64_t ov_read_float_bgm(OggVorbis_File* vf, float** pcm, const long& Samples, TrackInfo* TI);
 #endif
 
+// Splits [frames] interleaved little-endian 16-bit stereo frames into the float channels [l] and [r]
+void deinterleave_s16(float* l, float* r, const char* buf, const long& frames);
+
 // Encoding state
 // --------------
+struct VorbisSetup;
+
 struct OggVorbis_EncState
 {
-	FXFile*	out;
+	FXIO*	out;
+	VorbisSetup*	src;	// Cached setup <vi> was copied from. The codec setup behind <vi> belongs to the cache then.
 	ogg_stream_state stream_out; // collects Ogg packets and streams out pages
 	vorbis_info      vi; // stores all the static vorbis bitstream settings
 	vorbis_dsp_state vd; // central working state for the packet->PCM decoder
 	vorbis_block     vb; // local working space for packet->PCM decode
 
-	// initializes the Ogg Vorbis structures
-	bool setup(FXFile* out, const float& freq, const float& quality);
+	// initializes the Ogg Vorbis structures. Identical parameters share one cached codec setup.
+	bool setup(FXIO* out, const float& freq, const float& quality);
 
 	uint write_headers();
 	uint write_headers(vorbis_comment* vc);
 
 	// Enter a new bitstream. Returns the size of the stream header
-	uint new_stream(FXFile* out, const float& freq, const float& quality, long serialno, vorbis_comment* vc);
+	uint new_stream(FXIO* out, const float& freq, const float& quality, long serialno, vorbis_comment* vc);
 
 	uint encode_pcm(char* buf, const int& size);	// Returns the number of encoded bytes
 
+	// Float input. Write up to [samples] samples into the planar buffer returned by analysis_buffer(), then submit them with encode_wrote().
+	float** analysis_buffer(const int& samples);
+	uint encode_wrote(const int& samples);	// Returns the number of encoded bytes
+
 	// Encodes [bytes] bytes from [in]
 	bool encode_file(FXFile& in, const ulong& bytes, char* buf, const ulong& bufsize);
 	bool encode_file(FXFile& in, const ulong& bytes, char* buf, const ulong& bufsize, volatile FXulong& d, volatile bool* StopReq);
@@ -130,12 +214,16 @@ struct OggVorbis_EncState
 };
 // --------------
 
+// Sample-exact seek to [pos]. Looks up the page in [Index] and only pre-rolls the packets right before [pos].
+// Falls back to ov_pcm_seek() if [Index] doesn't cover [pos].
+int ov_pcm_seek_indexed(OggVorbis_File* vf, OggPageIndex* Index, const ogg_int64_t& pos);
+
 // Ogg packet copy functions
 // ===============
 int ov_bitstream_seek(OggVorbis_File* vf, ogg_int64_t pos, bool seek_to_header);
-void vorbis_write_headers(FXFile& out, ogg_stream_state* os, vorbis_dsp_state* vd, vorbis_comment* vc);
-void vorbis_write_headers(FXFile& out, ogg_stream_state* os, vorbis_info* vi, vorbis_comment* vc);
-void vorbis_write_headers(FXFile& out, ogg_stream_state* os, vorbis_info* vi, ogg_packet* header, vorbis_comment* vc, ogg_packet* header_code);
+void vorbis_write_headers(FXIO& out, ogg_stream_state* os, vorbis_dsp_state* vd, vorbis_comment* vc);
+void vorbis_write_headers(FXIO& out, ogg_stream_state* os, vorbis_info* vi, vorbis_comment* vc);
+void vorbis_write_headers(FXIO& out, ogg_stream_state* os, vorbis_info* vi, ogg_packet* header, vorbis_comment* vc, ogg_packet* header_code);
 
 // Adapted from vcut.c
 // -------
@@ -143,18 +231,42 @@ void vorbis_write_headers(FXFile& out, ogg_stream_state* os, vorbis_info* vi, og
 // Reads an arbitrary amount of bytes from [file_in] into [sync_in].
 // Return value: number of read bytes
 int ogg_update_sync(FXFile& file_in, ogg_sync_state* sync_in);
+int ogg_update_sync(size_t (*read_func)(void*, size_t, size_t, void*), void* datasource, ogg_sync_state* sync_in);	// Same through ov_callbacks-style [read_func]
 
 // Writes pages to the given file, or discards them if file is NULL.
-bool ogg_write_pages_to_file(ogg_stream_state *stream, FXFile& file, bool flush);
+bool ogg_write_pages_to_file(ogg_stream_state *stream, FXIO& file, bool flush);
 
 // Submits [packet] to [stream_out], and writes filled pages to [out]. 
-bool ogg_write_packet(FXFile& out, ogg_stream_state* stream_out, ogg_packet *packet);
+bool ogg_write_packet(FXIO& out, ogg_stream_state* stream_out, ogg_packet *packet);
+
+// Audio packets of one stream, captured by ogg_packetcopy() to write them into further streams without reading the source again
+struct OggPacketList
+{
+	ogg_packet*	op;	// Packet headers. <packet> is only valid after finish().
+	ogg_int64_t*	pos;	// Running sample position behind each packet
+	long*	off;	// Offset of each packet in <data>
+	unsigned char*	data;
+	long	count, cap;
+	long	bytes, data_cap;
+
+	bool add(const ogg_packet* p, const ogg_int64_t& sample_pos);	// Copies [p]
+	void finish();	// Points the packet headers into <data>. Call after the last add().
+	void clear();
+
+	OggPacketList();
+	~OggPacketList();
+};
 
 // Copies audio packets from [file_in] to [file_out].
 // Stops once a given number of samples, or the end of the input stream is reached
+// If [capture] is given, all written packets are appended to it. Only works with [sample_start] == 0.
+// Returns number of written samples
+ogg_int64_t ogg_packetcopy(FXFile& file_out, ogg_stream_state* stream_out, FXFile& file_in, ogg_stream_state* stream_in, ogg_sync_state* sync_in, vorbis_info* info_in = NULL, ogg_int64_t samples = -1, ogg_int64_t sample_start = 0, OggPacketList* capture = NULL);
+ogg_int64_t ogg_packetcopy(FXFile& file_out, ogg_stream_state* stream_out, OggVorbis_File* ov_in, ogg_int64_t sample_end = -1, ogg_int64_t sample_start = 0, OggPacketList* capture = NULL);
+
+// Writes the packets in [list] to [stream_out] again. Ends the stream after [sample_end] samples, just like ogg_packetcopy().
 // Returns number of written samples
-ogg_int64_t ogg_packetcopy(FXFile& file_out, ogg_stream_state* stream_out, FXFile& file_in, ogg_stream_state* stream_in, ogg_sync_state* sync_in, vorbis_info* info_in = NULL, ogg_int64_t samples = -1, ogg_int64_t sample_start = 0);
-ogg_int64_t ogg_packetcopy(FXFile& file_out, ogg_stream_state* stream_out, OggVorbis_File* ov_in, ogg_int64_t sample_end = -1, ogg_int64_t sample_start = 0);
+ogg_int64_t ogg_packetreplay(FXIO& file_out, ogg_stream_state* stream_out, OggPacketList* list, ogg_int64_t sample_end = -1);
 
 // Maps a Vorbis quality level to an average bitrate
 float vorbis_quality_to_bitrate(const float& q);
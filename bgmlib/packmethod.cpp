@@ -14,6 +14,7 @@
 #include "bgmlib.h"
 #include "ui.h"
 #include "packmethod.h"
+#include "bufpool.h"
 #ifdef SUPPORT_VORBIS_PM
 #include <FXPath.h>
 #include "utils.h"
@@ -176,11 +177,12 @@ bool PackMethod::Dump(GameInfo* GI, FXFile& In, const ulong& Pos, const ulong& S
 		return false;
 	}
 
-	char* DecBuf = new char[Size];
+	char* DecBuf = BufPool::Inst().Get(Size);
+	if(!DecBuf)	return false;
 
 	DecryptFile(GI, In, DecBuf, Pos, Size, p);
 	Dec.writeBlock(DecBuf, Size);
-	SAFE_DELETE_ARRAY(DecBuf);
+	POOL_RELEASE(DecBuf);
 
 	Dec.close();
 
@@ -72,6 +72,7 @@ enum mrerr
 
 namespace FX
 {
+	class FXIO;
 	class FXFile;
 }
 
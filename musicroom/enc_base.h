@@ -10,6 +10,7 @@
 // Forward declarations
 class ConfigParser;
 struct Extract_Vals;
+class PCMQueue;
 
 namespace FX
 {
@@ -19,6 +20,13 @@ namespace FX
 
 #define MAX_ENCODERS	16
 
+// Encoder-specific state of a single extraction job.
+// Encoders are shared between all worker threads, so anything that belongs to one track goes in here.
+struct EncState
+{
+	virtual ~EncState()	{}
+};
+
 // Encoder
 // -------
 struct Encoder
@@ -26,7 +34,7 @@ struct Encoder
 protected:
 	virtual void FmtReadConfig(ConfigParser* Sect)	{}
 
-	// Optional handling if encoding gets stopped by the user
+	// Optional handling if encoding gets stopped by the user. Must not wait for the jobs to finish.
 	virtual void FmtStop()	{}
 
 public:
@@ -52,24 +60,26 @@ public:
 	// Reads [Ext] and [Lossless], then calls FmtReadConfig for further processing
 	void ReadConfig(ConfigParser* Sect);
 
-	// Encodes [SrcFN] (PCM) to [DestFN] (target format).
+	// Encodes the PCM data coming out of [In] to [DestFN] (target format).
 	// Returns false if extraction has to be canceled, and true in _all_ other cases.
-	virtual bool Encode(const FXString& DestFN, const FXString& SrcFN, Extract_Vals& V)	{return false;}
+	virtual bool Encode(const FXString& DestFN, PCMQueue& In, Extract_Vals& V)	{return false;}
 
 	// Main extraction function.
 	// Returns true if [TI] was correctly extracted to [EncFN].
 	virtual bool Extract(TrackInfo* TI, FXString& EncFN, GameInfo* GI, Extract_Vals& V)	{return false;}
 
-	// Default implementation dumps [TI] to a PCM file, then calls Encode()
+	// Default implementation feeds [TI] through the PCM pipeline into Encode()
 	bool Extract_Default(TrackInfo* TI, FXString& EncFN, GameInfo* GI, Extract_Vals& V);
 
-	// Requests encoding cancellation. Sets <StopReq> and calls FmtStop
+	// Requests encoding cancellation of all running jobs. Sets <StopReq> and calls FmtStop
 	void Stop();	
 	virtual ~Encoder()	{}
 };
 // -------
 
 // Reads [size] bytes from [in] into [buffer]. Loops according to the info in [TI].
-ulong pcm_read_bgm(FXFile& in, char* buffer, const ulong& size, TrackInfo* TI);
+// With [LS], loop transitions are served from the splice instead of seeking on the spot.
+struct LoopSplice;
+ulong pcm_read_bgm(FXFile& in, char* buffer, const ulong& size, TrackInfo* TI, LoopSplice* LS = NULL);
 
 #endif /* MUSICROOM_ENC_BASE_H */
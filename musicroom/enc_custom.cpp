@@ -18,21 +18,72 @@
 #include <FXLabel.h>
 #include <FXTextField.h>
 #include <FXStat.h>
+#include <FXPath.h>
 #include <FXThread.h>
 #include <FXMessageBox.h>
 
 #include <FXIO.h>
 #include <FXFile.h>
 
+#include <bgmlib/bufpool.h>
+#include <bgmlib/libvorbis.h>
 #include "extract.h"
+#include "pipeline.h"
 #include "enc_custom.h"
 
 #ifdef WIN32
 #include <wchar.h>
 #include <windows.h>
-static PROCESS_INFORMATION ProcInf;
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+extern char** environ;
+
+// Single-quotes [Str] for sh, so that spaces and quotes in paths survive
+static FXString ShellQuote(const FXString& Str)
+{
+	FXString Ret = Str;
+	Ret.substitute("'", "'\\''");
+	return "'" + Ret + "'";
+}
+
+// Running encoder processes, each one leading its own process group
+static FXMutex ProcLock;
+static List<pid_t> Procs;
+
+// write() until everything is out
+static bool WriteAll(int Fd, const char* Buf, ulong Len)
+{
+	ssize_t Ret;
+	while(Len > 0)
+	{
+		Ret = write(Fd, Buf, Len);
+		if(Ret < 0)
+		{
+			if(errno == EINTR)	continue;
+			return false;
+		}
+		Buf += Ret;
+		Len -= Ret;
+	}
+	return true;
+}
 #endif
 
+// Input and output arguments for configs that don't have an "args" key yet.
+// flac and oggenc treat every bare argument as an input file and want the output after -o.
+static FXString DefaultArgs(const FXString& Encoder)
+{
+	FXString Exe = FXPath::title(Encoder).lower();
+	if(Exe.contains("flac") || Exe.contains("oggenc"))	return "-o %out% %in%";
+	return "%in% %out%";
+}
+
 // Settings
 // --------
 void Encoder_Custom::DlgCreate(FXVerticalFrame* Frame, FXDialogBox* Target, const FXuint& Msg)
@@ -89,31 +140,48 @@ bool Encoder_Custom::DlgApply(FXDialogBox* Parent)
 void Encoder_Custom::FmtReadConfig(ConfigParser* Sect)
 {
 	Sect->GetValue("help", TYPE_STRING, &Help);
+
 	Sect->LinkValue("encoder", TYPE_STRING, &CmdLine[0]);
 	Sect->LinkValue("options", TYPE_STRING, &CmdLine[1]);
+
+	// Linked, so that older configs get the key on the next save
+	Sect->LinkValue("args", TYPE_STRING, &Args);
+	if(Args.empty())	Args = DefaultArgs(CmdLine[0]);
 }
 
 bool Encoder::Extract_Default(TrackInfo* TI, FXString& EncFN, GameInfo* GI, Extract_Vals& V)
 {
 	Extractor& Ext = Extractor::Inst();
 	FXString Str;
-		
-	Str.format("%s...", V.DisplayFN + L"  ");
-	BGMLib::UI_Stat_Safe(Str);
+	bool Ret;
 
 	V.Init(TI, FMT_BYTE);
 
-	// load/decode source file
-	if(!Ext.PrepareInput(TI, GI, V))	return false;
+	// Multi-format extraction already runs the pipeline for all of us
+	if(V.Tap)
+	{
+		Ret = Encode(EncFN, *V.Tap, V);
+		V.Tap->Abort();
+	}
+	else
+	{
+		Str.format("%s...", V.DisplayFN + L"  ");
+		BGMLib::UI_Stat_Safe(Str);
+
+		// Source -> loops -> fade -> encoder, all in memory
+		if(!Ext.PrepareInput(TI, GI, V))	return false;
 
-	FXString& DumpFN = Ext.BuildPCM(TI, V);
-	V.In.close();
-	if(StopReq)	return StopReq = false;
+		PCMQueue& PCM = Ext.BuildPCM(TI, V);
 
-	// Encode
-	BGMLib::UI_Stat_Safe(L"ڵ ...");
+		// Encode
+		BGMLib::UI_Stat_Safe(L"ڵ ...");
 
-	if(!Encode(EncFN, DumpFN, V))
+		Ret = Encode(EncFN, PCM, V);
+		V.Pipe->Stop();
+	}
+	if(StopReq)	return false;
+
+	if(!Ret)
 	{
 		if(*V.Ret != 0)	*V.Ret = MBOX_CLICKED_CANCEL;
 		return false;
@@ -127,20 +195,60 @@ bool Encoder_Custom::Extract(TrackInfo *TI, FX::FXString &EncFN, GameInfo *GI, E
 	return Extract_Default(TI, EncFN, GI, V);
 }
 
-bool Encoder_Custom::Encode(const FXString& DestFN, const FXString& SrcFN, Extract_Vals& V)
+bool Encoder_Custom::Encode(const FXString& DestFN, PCMQueue& In, Extract_Vals& V)
 {
-	FXString Str, Cmd;
+	FXString Str, Cmd, Arg;
+	char Header[WAV_HEADER_SIZE];
+	ulong Read;
+	bool Fed;	// Encoder still accepts data
+
+	// The encoder reads a WAV file from its standard input, which we fill while the pipeline is still running
+	Arg = Args;
+	Arg.substitute("%in%", "-");
+#ifdef WIN32
+	Arg.substitute("%out%", "\"" + DestFN + "\"");
+#else
+	Arg.substitute("%out%", ShellQuote(DestFN));
+#endif
 
 	Cmd.format("%s%s", AppPath, CmdLine[0].text());
-	Str.format("%s %s \"%s\" \"%s\"", CmdLine[1], CmdLine[1], SrcFN, DestFN);
+	Str.format("%s %s %s", CmdLine[1], CmdLine[1], Arg);
+
+	makeheader(Header, V.Len, V.Freq);
+	V.Buf = BufPool::Inst().Resize(V.Buf, OV_BLOCK);
+	V.d = 0;
+	V.ProgConnect(V.Len);
 #ifdef WIN32
 	// Yes, we have to use this for Unicode compliance!
 
+	SECURITY_ATTRIBUTES SA = {sizeof(SECURITY_ATTRIBUTES), NULL, TRUE};
+	HANDLE PipeRead, PipeWrite, Null = INVALID_HANDLE_VALUE;
+	HANDLE StdOut = GetStdHandle(STD_OUTPUT_HANDLE);
+	HANDLE StdErr = GetStdHandle(STD_ERROR_HANDLE);
+	DWORD Written;
+
+	if(!CreatePipe(&PipeRead, &PipeWrite, &SA, OV_BLOCK))	return false;
+	SetHandleInformation(PipeWrite, HANDLE_FLAG_INHERIT, 0);	// Only the reading end goes to the encoder
+
+	// STARTF_USESTDHANDLES always sets all three handles, but we only want to redirect the input.
+	// We're a GUI process though, and usually don't have any output handles to pass on,
+	// so the encoder writes to NUL instead of into invalid handles.
+	if(!StdOut || StdOut == INVALID_HANDLE_VALUE || !StdErr || StdErr == INVALID_HANDLE_VALUE)
+	{
+		Null = CreateFileW(L"NUL", GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, &SA, OPEN_EXISTING, 0, NULL);
+		if(!StdOut || StdOut == INVALID_HANDLE_VALUE)	StdOut = Null;
+		if(!StdErr || StdErr == INVALID_HANDLE_VALUE)	StdErr = Null;
+	}
+
 	STARTUPINFO SI;
 	ZeroMemory(&SI, sizeof(STARTUPINFO));
 	SI.cb = sizeof(STARTUPINFO);
-	SI.dwFlags = STARTF_USESHOWWINDOW;
+	SI.dwFlags = STARTF_USESHOWWINDOW | STARTF_USESTDHANDLES;
 	SI.wShowWindow = SW_SHOWNOACTIVATE;
+	SI.hStdInput = PipeRead;
+	SI.hStdOutput = StdOut;
+	SI.hStdError = StdErr;
+	PROCESS_INFORMATION ProcInf;
 	ZeroMemory(&ProcInf, sizeof(PROCESS_INFORMATION));
 
 	wchar_t* CmdW = new FXnchar[Cmd.length() + 1];
@@ -156,26 +264,108 @@ bool Encoder_Custom::Encode(const FXString& DestFN, const FXString& SrcFN, Extra
 
 	SAFE_DELETE_ARRAY(CmdW);
 	SAFE_DELETE_ARRAY(StrW);
+	CloseHandle(PipeRead);
+	if(Null != INVALID_HANDLE_VALUE)	CloseHandle(Null);
 
 	if(!r)
 	{
+		CloseHandle(PipeWrite);
+		POOL_RELEASE(V.Buf);
 		Str.format("\n%s\n", CmdLine[0] + L"()   ϴ!\nġ   ϴ  ȮϽð,\nڴ  ٲּ.");
 		BGMLib::UI_Error_Safe(Str);
 		return false;
 	}
-#else
-	system(Str.text());
-#endif
+
+	Fed = WriteFile(PipeWrite, Header, WAV_HEADER_SIZE, &Written, NULL) != FALSE;
+	while(Fed && !StopReq && (Read = In.Read(V.Buf, OV_BLOCK)))
+	{
+		Fed = WriteFile(PipeWrite, V.Buf, Read, &Written, NULL) != FALSE;
+		V.d += Read;
+	}
+	CloseHandle(PipeWrite);	// EOF for the encoder
 	// ------
 
-	Ret = true;
 	WaitForSingleObject(ProcInf.hProcess, INFINITE);
-	
-	ZeroMemory(&ProcInf, sizeof(PROCESS_INFORMATION));
+	CloseHandle(ProcInf.hThread);
+	CloseHandle(ProcInf.hProcess);
+#else
+	// The options are the user's and stay unquoted, so that the shell splits them
+	FXString Line = ShellQuote(Cmd) + " " + CmdLine[1] + " " + Arg;
+	char* Argv[] = {(char*)"sh", (char*)"-c", (char*)Line.text(), NULL};
+	posix_spawn_file_actions_t FA;
+	posix_spawnattr_t SA;
+	ListEntry<pid_t>* Proc;
+	pid_t Pid;
+	siginfo_t Info;
+	int Pipe[2];
+	int r, Status;
+
+	// Both ends close-on-exec, so that encoders spawned in parallel don't keep each other's input open.
+	// pipe2() is a Linux extension rather than POSIX, but it's the only way to do that without a race against the other spawns.
+	if(pipe2(Pipe, O_CLOEXEC))
+	{
+		POOL_RELEASE(V.Buf);
+		return false;
+	}
+
+	posix_spawn_file_actions_init(&FA);
+	posix_spawn_file_actions_adddup2(&FA, Pipe[0], STDIN_FILENO);
+
+	// Own process group, so that FmtStop() reaches the shell and the encoder at once
+	posix_spawnattr_init(&SA);
+	posix_spawnattr_setpgroup(&SA, 0);
+	posix_spawnattr_setflags(&SA, POSIX_SPAWN_SETPGROUP);
+
+	{
+		FXMutexLock Lock(ProcLock);
+		r = posix_spawn(&Pid, "/bin/sh", &FA, &SA, Argv, environ);
+		if(!r)	Proc = Procs.Add(&Pid);
+	}
+	posix_spawn_file_actions_destroy(&FA);
+	posix_spawnattr_destroy(&SA);
+	close(Pipe[0]);
+
+	if(r)
+	{
+		close(Pipe[1]);
+		POOL_RELEASE(V.Buf);
+		Str.format("\n%s\n", CmdLine[0] + L"()   ϴ!\nġ   ϴ  ȮϽð,\nڴ  ٲּ.");
+		BGMLib::UI_Error_Safe(Str);
+		return false;
+	}
+
+	Fed = WriteAll(Pipe[1], Header, WAV_HEADER_SIZE);
+	while(Fed && !StopReq && (Read = In.Read(V.Buf, OV_BLOCK)))
+	{
+		Fed = WriteAll(Pipe[1], V.Buf, Read);
+		V.d += Read;
+	}
+	close(Pipe[1]);	// EOF for the encoder
+
+	// Wait without reaping, and only let the PID go once FmtStop() can't see it anymore.
+	// Otherwise, FmtStop() could kill a new process group that happened to get the same ID.
+	while(waitid(P_PID, Pid, &Info, WEXITED | WNOWAIT) < 0 && errno == EINTR);
+	{
+		FXMutexLock Lock(ProcLock);
+		Procs.Delete(Proc);
+	}
+	while((r = waitpid(Pid, &Status, 0)) < 0 && errno == EINTR);
+	// FmtStop() kills the encoder, so that's no error
+	if(!StopReq && (r < 0 || !WIFEXITED(Status) || WEXITSTATUS(Status) != 0))
+	{
+		POOL_RELEASE(V.Buf);
+		if(r >= 0 && WIFEXITED(Status))	Str.format("\n%s (exit code %d)\n", CmdLine[0].text(), WEXITSTATUS(Status));
+		else							Str.format("\n%s (terminated)\n", CmdLine[0].text());
+		BGMLib::UI_Error_Safe(Str);
+		return false;
+	}
+#endif
+	POOL_RELEASE(V.Buf);
 
-	return Ret;	// may be changed by FmtStop
+	return true;
 }
 
+#ifdef WIN32
 // Yay, how stupid.
 static BOOL CALLBACK EnumWndProc(HWND HWnd, LPARAM lParam)
 {
@@ -189,14 +379,17 @@ static BOOL CALLBACK EnumWndProc(HWND HWnd, LPARAM lParam)
 		SendMessage(HWnd, WM_QUIT, 0, 0);
 		SendMessage(HWnd, WM_CLOSE, 0, 0);
 		SendMessage(HWnd, WM_DESTROY, 0, 0);
-		return false;
 	}
-	return true;
+	return true;	// Parallel jobs may have more than one of them running
 }
+#endif
 
 FXString Encoder_Custom::Init(GameInfo* GI)
 {
 	FXString Ret;
+#ifndef WIN32
+	signal(SIGPIPE, SIG_IGN);	// An encoder quitting early should only fail our write()
+#endif
 	Ret.format("%s %s\n", L": " + CmdLine[0], CmdLine[1]);
 	if(GI->Vorbis)
 	{
@@ -210,19 +403,20 @@ FXString Encoder_Custom::Init(GameInfo* GI)
 
 void Encoder_Custom::FmtStop()
 {
-	if(ProcInf.hProcess != 0)
+	// The feeding loops see <StopReq> and close the pipes on their own, which ends the encoders.
+#ifdef WIN32
+	// Console windows still have to be closed though.
+	EnumWindows(EnumWndProc, (LPARAM)&CmdLine[0]);
+#else
+	// Don't wait for them to notice, though.
+	FXMutexLock Lock(ProcLock);
+	ListEntry<pid_t>* Cur = Procs.First();
+	while(Cur)
 	{
-		Ret = false;
-		HWND EncWnd = NULL;
-		EnumWindows(EnumWndProc, (LPARAM)&CmdLine[0]);
-		if(EncWnd)
-		{
-			SendMessage(EncWnd, WM_QUIT, 0, 0);
-			SendMessage(EncWnd, WM_CLOSE, 0, 0);
-			SendMessage(EncWnd, WM_DESTROY, 0, 0);
-		}
+		kill(-Cur->Data, SIGTERM);
+		Cur = Cur->Next();
 	}
-	else	while(StopReq)	FXThread::sleep(TIMEOUT);
+#endif
 }
 
 Encoder_Custom::~Encoder_Custom()
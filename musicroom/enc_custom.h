@@ -19,13 +19,13 @@ protected:
 	// Widget storage
 	FXTextField* Cmd[2];
 
-	bool Ret;
-	void FmtStop();	// Terminates the encoding process
+	void FmtStop();	// Terminates the encoding processes
 
 	void FmtReadConfig(ConfigParser* Sect);	// Reads [encoder] -> <CmdLine[0]> and [options] -> <CmdLine[1]>
 
 public:
 	FXString	CmdLine[2];	// Encoding command line
+	FXString	Args;		// Input and output file arguments. "%in%" becomes "-" (standard input), "%out%" the output file name.
 	FXString	Help;		// Encoder help text (displayed in the settings dialog)
 
 	// Settings
@@ -34,9 +34,9 @@ public:
 
 	FXString Init(GameInfo* GI);	// Displays the encoding command line
 
-	// Encodes [SrcFN] (PCM) to [DestFN] (target format).
+	// Encodes the PCM data coming out of [In] to [DestFN] (target format).
 	// Returns false if extraction has to be canceled, and true in _all_ other cases.
-	bool Encode(const FXString& DestFN, const FXString& SrcFN, Extract_Vals& V);
+	bool Encode(const FXString& DestFN, PCMQueue& In, Extract_Vals& V);
 
 	// Main extraction function.
 	// Returns true if [TI] was correctly extracted to [EncFN].
@@ -20,11 +20,15 @@
 
 #include <FXIO.h>
 #include <FXFile.h>
+#include <FXStat.h>
 
 #include "extract.h"
 #include "enc_vorbis.h"
 
 #include <bgmlib/libvorbis.h>
+#include <bgmlib/bufpool.h>
+#include "pipeline.h"
+#include "segcache.h"
 #include "tag_base.h"
 #include "tag_vorbis.h"
 #include "tagger.h"
@@ -80,36 +84,150 @@ bool Encoder_Vorbis::DlgApply(FXDialogBox* Parent)
 // Encoding
 // --------
 
-// Storage
-static OggVorbis_EncState ES;
-static OggVorbis_File VF;
-static MRTag_Ogg*	TF;
+// Encodes one region of a lossless track into its own logical stream in memory.
+// The intro, loop and fade of a chained file don't depend on each other, so they can be encoded at the same time.
+struct VorbisSegment : public FXThread
+{
+	// Parameters
+	GameInfo*	GI;
+	TrackInfo*	TI;
+	ulong	Pos;	// Source position in bytes
+	ulong	Bytes;	// Bytes to encode
+	long	Serial;
+	float	Quality;
+	vorbis_comment*	VC;
+	FadeAlg*	FA;	// Fades the whole segment if not NULL
+	volatile bool*	StopReq;
+
+	bool	Used;	// Has been started
+	bool	Ret;
+	volatile FXulong	d;	// Progress
+	VFile	Ogg;	// Result
+	SegKey	Key;	// Cache key
+
+	VorbisSegment()	{Used = Ret = false; d = 0;}
+
+	void Start(GameInfo* GI, TrackInfo* TI, const ulong& Pos, const ulong& Bytes, const long& Serial, const float& Quality, vorbis_comment* VC, FadeAlg* FA = NULL);
+
+	virtual FXint run();
+};
+
+void VorbisSegment::Start(GameInfo* _GI, TrackInfo* _TI, const ulong& _Pos, const ulong& _Bytes, const long& _Serial, const float& _Quality, vorbis_comment* _VC, FadeAlg* _FA)
+{
+	GI = _GI;
+	TI = _TI;
+	Pos = _Pos;
+	Bytes = _Bytes;
+	Serial = _Serial;
+	Quality = _Quality;
+	VC = _VC;
+	FA = _FA;
+	StopReq = &Encoder::StopReq;
+	Used = true;
+
+	FXString Src = GI->DiskFN(TI);
+	FXString Cmt;
+	FXStat SrcStat;
+	FXStat::statFile(Src, SrcStat);
+
+	// Length-prefixed, so that no two different headers end up as the same string
+	for(int c = 0; c < VC->comments; c++)	Cmt.append(FXString::value(VC->comment_lengths[c])).append(':').append(VC->user_comments[c], VC->comment_lengths[c]);
+
+	Key.Source = Src;
+	Key.SourceSize = SrcStat.size();
+	Key.SourceTime = SrcStat.modified();
+	Key.Pos = Pos;
+	Key.Bytes = Bytes;
+	Key.Quality = Quality;
+	Key.Fade = FA ? FA->Name : FXString::null;
+	Key.Serial = Serial;
+	Key.Tags = Cmt;
+	Key.Version = vorbis_version_string();
+
+	start();
+}
 
-static bool CheckRIFF(FXFile& In, uint* Freq = NULL, ulong* DataSize = NULL)
+FXint VorbisSegment::run()
 {
-	ulong Temp;
+	OggVorbis_EncState ES;
+	VFileIO Out(Ogg);
+	FXFile In;
+	char* Buf;
+	long Rem = Bytes;
+	long c = 0;
+	long Len = Bytes;
+	short* f;
 
-	In.readBlock(&Temp, 4);	// "RIFF"
-	if(memcmp(&Temp, "RIFF", 4))	return false;
-	
-	In.position(4, FXIO::Current);
-	In.readBlock(&Temp, 4);	// "WAVE"
-	if(memcmp(&Temp, "WAVE", 4))	return false;
+	Ret = false;
+	if(SegCache::Inst().Get(Key, Ogg))
+	{
+		d = Bytes;
+		return Ret = true;
+	}
+	Ogg.Clear();
 
-	In.position(12, FXIO::Current);
-	In.readBlock(&Temp, 4);	// Frequency
-	if(Freq)	*Freq = Temp;
+	if(!GI->OpenBGMFile(In, TI))	return 0;
+	In.position(Pos);
 
-	In.position(8, FXIO::Current);
-	In.readBlock(&Temp, 4);	// "data"
+	Buf = BufPool::Inst().Get(OV_BLOCK);
+	if(!Buf)	return 0;
 
-	if(memcmp(&Temp, "data", 4))	return false;
-	
-	In.readBlock(&Temp, 4);	// data size
-	if(DataSize)	*DataSize = Temp;
-	return true;
+	ES.setup(&Out, TI->Freq, Quality);
+	ogg_stream_init(&ES.stream_out, Serial);
+	vorbis_write_headers(Out, &ES.stream_out, &ES.vi, VC);
+
+	if(!FA)	Ret = ES.encode_file(In, Bytes, Buf, OV_BLOCK, d, StopReq);
+	else
+	{
+		while((Rem > 0) && !(*StopReq))
+		{
+			int Read = MIN(OV_BLOCK, Rem);
+
+			pcm_read_bgm(In, Buf, Read, TI);
+			Rem -= Read;
+
+			f = (short*)&Buf[0];
+			FA->Fade(f, c, Len - Rem, Len);
+
+			ES.encode_pcm(Buf, Read);
+			d += Read;
+		}
+		if(!(*StopReq))	ES.encode_pcm(NULL, 0);
+		Ret = !(*StopReq);
+	}
+	ogg_stream_clear(&ES.stream_out);
+	POOL_RELEASE(Buf);
+
+	if(Ret)	SegCache::Inst().Put(Key, Ogg);
+	return Ret;
 }
 
+// Storage of one job
+struct VorbisState : public EncState
+{
+	OggVorbis_EncState	ES;
+	OggVorbis_File	VF;
+	MRTag_Ogg*	TF;
+	VorbisSegment	Intro;
+	VorbisSegment	Loop;
+	VorbisSegment	Fade;
+
+	VorbisState()
+	{
+		memset(&VF, 0, sizeof(OggVorbis_File));
+		TF = NULL;
+	}
+
+	~VorbisState()
+	{
+		Intro.join();
+		Loop.join();
+		Fade.join();
+		ov_clear(&VF);
+		SAFE_DELETE(TF);
+	}
+};
+
 FXString Encoder_Vorbis::Init(GameInfo* GI)
 {
 	FXString Ret;
@@ -126,43 +244,39 @@ FXString Encoder_Vorbis::Init(GameInfo* GI)
 	return Ret;
 }
 
-bool Encoder_Vorbis::Encode(const FXString& DestFN, const FXString& SrcFN, Extract_Vals& V)
+bool Encoder_Vorbis::Encode(const FXString& DestFN, PCMQueue& In, Extract_Vals& V)
 {
+	VorbisState* S = (VorbisState*)V.Enc;
+	OggVorbis_EncState& ES = S->ES;
+	MRTag_Ogg*& TF = S->TF;
+
 	FXString Str;
-	uint Freq = 44100;
-	ulong	Temp = 0;
 	bool eos = false;
 
-	V.Buf = (char*)realloc(V.Buf, OV_BLOCK / 2);
+	V.Buf = BufPool::Inst().Resize(V.Buf, OV_BLOCK / 2);
 	V.d = 0;
 
-	V.In.open(SrcFN, FXIO::Reading);
 	V.Out.open(DestFN, FXIO::Writing);
+	V.ProgConnect(V.Len);
 
-	// In
-	CheckRIFF(V.In, &Freq, &Temp);
-	if(Temp > 0)	MW->ProgConnect(&V.d, Temp);
-
-	// Out
-	if(!ES.setup(&V.Out, Freq, Quality / 10.0f))	return false;
+	if(!ES.setup(&V.Out, V.Freq, Quality / 10.0f))	return false;
 
 	ogg_stream_init(&ES.stream_out, rand());
 	vorbis_write_headers(V.Out, &ES.stream_out, &ES.vi, &TF->vc);
 
 	while(!eos && !StopReq)
 	{
-		int Read = V.In.readBlock(V.Buf, OV_BLOCK / 2);
+		int Read = In.Read(V.Buf, OV_BLOCK / 2);
 		ES.encode_pcm(V.Buf, Read);
 		V.d += Read;
 		if(Read == 0)	eos = true;
 	}
 	ES.clear();
-	V.In.close();
 	V.Out.close();
-	SAFE_FREE(V.Buf);
+	POOL_RELEASE(V.Buf);
 
 	SAFE_DELETE(TF);
-	if(StopReq)	return StopReq = false;
+	if(StopReq)	return false;
 	else		return true;
 }
 
@@ -170,22 +284,34 @@ bool Encoder_Vorbis::Extract(TrackInfo* TI, FXString& EncFN, GameInfo* GI, Extra
 {
 	Extractor& Ext = Extractor::Inst();
 
+	VorbisState* S = new VorbisState;
+	OggVorbis_EncState& ES = S->ES;
+	OggVorbis_File& VF = S->VF;
+	MRTag_Ogg*& TF = S->TF;
+
 	FXString Str;
 	bool CSA;	// Local chain stream assemble
 
-	memset(&VF, 0, sizeof(OggVorbis_File));
+	SAFE_DELETE(V.Enc);
+	V.Enc = S;
 
 	// The most special cases...
 	// -------------------------
 	if(GI->Vorbis && TI->FS != 0)
 	{
-		if( (TI->Loop == 0) || (FadeDur == 0.0f && LoopCnt == 1) )
+		if( (TI->Loop == 0) || (ExtFadeDur() == 0.0f && ExtLoopCnt() == 1) )
 		{
 			Str.format("Directly copying %s...", V.DisplayFN.text());
 			BGMLib::UI_Stat_Safe(Str);
 
-			DumpDecrypt(GI, TI, EncFN);
-			if(StopReq)	return StopReq = false;
+			// We don't read the shared PCM, so let the other formats go ahead
+			if(V.Tap)	V.Tap->Abort();
+
+			V.d = 0;
+			V.ProgConnect(TI->FS);
+			DumpDecrypt(GI, TI, EncFN, &V.d);
+			V.ProgConnect();
+			if(StopReq)	return false;
 			
 			return V.TagEngine = true;
 		}
@@ -207,7 +333,7 @@ bool Encoder_Vorbis::Extract(TrackInfo* TI, FXString& EncFN, GameInfo* GI, Extra
 				ulong Start;
 
 				// Directly decode from the original BGM file
-				if(ov_open_callbacks(&V.In, &VF, NULL, 0, OV_CALLBACKS_FXFILE))	return false;
+				if(!OpenVorbisFile(V.In, VF, GI, TI))	return false;
 				if(VF.links == 1)	CSA = false;
 
 				// This is necessary because seeking to 0 apparently breaks the codebooks
@@ -229,6 +355,7 @@ bool Encoder_Vorbis::Extract(TrackInfo* TI, FXString& EncFN, GameInfo* GI, Extra
 
 	T.TagBasic(TF, ActiveGame, TI);
 	T.TagExt(TF, ActiveGame, TI);
+	T.TagLoop(TF, TI);
 	// -------------------------
 
 	if(CSA)	BGMLib::UI_Stat_Safe("(chained) ");
@@ -239,6 +366,7 @@ bool Encoder_Vorbis::Extract(TrackInfo* TI, FXString& EncFN, GameInfo* GI, Extra
 	}
 
 	// Alright, from here on, we're in bitstream assembling mode
+	if(V.Tap)	V.Tap->Abort();	// (see above)
 	Str.format("Building %s...", V.DisplayFN.text());
 	BGMLib::UI_Stat_Safe(Str);
 
@@ -252,12 +380,13 @@ bool Encoder_Vorbis::Extract(TrackInfo* TI, FXString& EncFN, GameInfo* GI, Extra
 	ogg_int64_t StartSample = 0;
 	ogg_int64_t StreamLen;
 	long EncLen;
+	bool Open = false;	// <ES.stream_out> has its headers, but no audio yet
 
 	long c = 0;
 	
 	short* f;
 
-	V.Buf = (char*)malloc(OV_BLOCK);
+	V.Buf = BufPool::Inst().Resize(V.Buf, OV_BLOCK);
 	
 	// Start transfer
 	// --------------
@@ -268,9 +397,9 @@ bool Encoder_Vorbis::Extract(TrackInfo* TI, FXString& EncFN, GameInfo* GI, Extra
 		V.FadeStart >>= 2;
 	}
 
-	srand(FXThread::time());	// This is no crypto-system, but we still aren't as stupid as Sony
-
-	serialno = rand();
+	// Deterministic, so that cached segments fit into the chain.
+	// Intro = base, loop = base + 1, loop copies = base + 2 and up, lossless fade = base - 1.
+	serialno = (long)((GI->DiskFN(TI).hash() ^ V.ts_data) & 0x3FFFFFFF) + 1;
 	StartSample = V.ts_ext - V.ts_data;
 
 	if(!GI->Vorbis || V.FadeBytes != 0)	ES.setup(&V.Out, TI->Freq, Quality / 10.0f);
@@ -285,19 +414,18 @@ bool Encoder_Vorbis::Extract(TrackInfo* TI, FXString& EncFN, GameInfo* GI, Extra
 
 		StreamLen = ov_pcm_total(&VF, Link);
 
-		EncLen = TI->GetByteLength(SilResolve(), LoopCnt, FadeDur);
+		EncLen = TI->GetByteLength(SilResolve(), ExtLoopCnt(), ExtFadeDur());
 	}
 	else
 	{
 		BGMLib::UI_Stat_Safe("intro...");
-		vorbis_write_headers(V.Out, &ES.stream_out, &ES.vi, &TF->vc);
 
-		EncLen = TI->GetByteLength(SilResolve(), 1, fabs(FadeDur));
+		EncLen = TI->GetByteLength(SilResolve(), 1, fabs(ExtFadeDur()));
 		if(V.FadeStart < EncLen)	EncLen = V.FadeStart + V.FadeBytes;
 
 		StreamLen = V.tl - ( (TI->FS != 0) ? 0 : V.ts_data);
 	}
-	MW->ProgConnect(&V.d, EncLen);
+	V.ProgConnect(EncLen);
 
 	if(StreamLen > V.FadeStart)
 	{
@@ -306,10 +434,43 @@ bool Encoder_Vorbis::Extract(TrackInfo* TI, FXString& EncFN, GameInfo* GI, Extra
 	}
 	else	V.FadeStart -= (StreamLen - StartSample);
 
+	// Lossless sources: intro, loop and fade don't depend on each other.
+	// Encode them on their own threads (or get them from the cache) and pick them up when they're due.
+	if(!GI->Vorbis)
+	{
+		ulong IntroPos = TI->GetStart(FMT_BYTE, SilResolve());
+		ulong FadePos = IntroPos + (StreamLen - StartSample);	// right behind the intro
+		ogg_int64_t FadeCopy = CopySamples;
+
+		S->Intro.Start(GI, TI, IntroPos, (StreamLen - StartSample), serialno, Quality / 10.0f, &TF->vc);
+
+		if(V.FadeStart > 0)
+		{
+			long Rem = MIN( (V.te - V.tl), (ulong)V.FadeStart);
+			ogg_int64_t Left = V.FadeStart >> 2;
+
+			S->Loop.Start(GI, TI, V.tl, Rem, serialno + 1, Quality / 10.0f, &TF->vc);
+
+			// Same bookkeeping as the copy loop below
+			for(ushort l = 0; (l < ExtLoopCnt()) && (Left != 0); l++)
+			{
+				if((Rem >> 2) >= Left)
+				{
+					FadeCopy = Left;
+					Left = 0;
+				}
+				else	Left -= (Rem >> 2);
+			}
+			FadePos = V.tl + ((FadeCopy == -1) ? 0 : (FadeCopy << 2));
+		}
+		if(V.FadeBytes != 0 && FadeCopy != 0)	S->Fade.Start(GI, TI, FadePos, V.FadeBytes, serialno - 1, Quality / 10.0f, &TF->vc, V.FA);
+	}
+
 	if(GI->Vorbis)
 	{
 		V.d += ogg_packetcopy(V.Out, &ES.stream_out, &VF, CopySamples, StartSample) * 4;
-		if(StopReq)	return StopReq = false;
+		if(StopReq)	return false;
+		Open = (CopySamples == 0);
 		if(CopySamples == -1)
 		{
 			// It's better to assume that the bitstreams of one track are adjacent
@@ -318,41 +479,28 @@ bool Encoder_Vorbis::Extract(TrackInfo* TI, FXString& EncFN, GameInfo* GI, Extra
 		}
 		else					ov_pcm_seek(&VF, V.ts_ext + CopySamples);
 	}
-	else if(!ES.encode_file(V.In, (StreamLen - StartSample), V.Buf, OV_BLOCK, V.d, &StopReq))	return StopReq = false;
+	else
+	{
+		S->Intro.join();
+		V.d += S->Intro.d;
+		if(!S->Intro.Ret)	return false;
+		V.Out.writeBlock(S->Intro.Ogg.Buf, S->Intro.Ogg.Size);
+	}
 	
 	V.Out.flush();
 
-	// If we're lossless, we'll always need to encode the loop at this point.
-	FXFile LF;
+	// If we're lossless, the loop has been encoded alongside the intro.
+	// It's kept in memory and copied from there.
 	if(!GI->Vorbis && V.FadeStart > 0)
 	{
-		bool Ret;
-		OggVorbis_EncState LS;
-		long Rem = MIN( (V.te - V.tl), (ulong)V.FadeStart);
 		BGMLib::UI_Stat_Safe("loop...");
 
-		LF.open(DecodeFile, FXIO::Writing);
-		LS.setup(&LF, TI->Freq, Quality / 10.0f);
-
-		ogg_stream_init(&LS.stream_out, ++serialno);
-		vorbis_write_headers(LF, &LS.stream_out, &LS.vi, &TF->vc);
-		LF.flush();
-
-		Ret = LS.encode_file(V.In, Rem, V.Buf, OV_BLOCK, V.d, &StopReq);
-		
-		// Reset encoding to outfile
-		LS.clear();
-		LF.close();
-
-		if(!Ret)
-		{
-			FXFile::removeFiles(DecodeFile);
-			return StopReq = false;
-		}
-
-		LF.open(DecodeFile);
+		S->Loop.join();
+		V.d += S->Loop.d;
+		if(!S->Loop.Ret)	return false;
+		++serialno;
 
-		ov_open_callbacks(&LF, &VF, NULL, 0, OV_CALLBACKS_FXFILE);
+		ov_open_callbacks(&S->Loop.Ogg, &VF, NULL, 0, OV_CALLBACKS_VFILE);
 		ov_bitstream_seek(&VF, 0, true);
 		Link = -1;
 		V.FadeStart >>= 2;
@@ -361,7 +509,9 @@ bool Encoder_Vorbis::Extract(TrackInfo* TI, FXString& EncFN, GameInfo* GI, Extra
 	}
 		
 	// Can we still copy?
-	for(ushort l = 0; (l < LoopCnt) && (V.FadeStart != 0); l++)
+	// The first full copy of the loop link is captured, every further one is replayed from memory.
+	OggPacketList Replay;
+	for(ushort l = 0; (l < ExtLoopCnt()) && (V.FadeStart != 0); l++)
 	{
 		ogg_int64_t Ret;
 
@@ -376,12 +526,18 @@ bool Encoder_Vorbis::Extract(TrackInfo* TI, FXString& EncFN, GameInfo* GI, Extra
 		}
 		else	V.FadeStart -= StreamLen;
 
-		Ret = ogg_packetcopy(V.Out, &ES.stream_out, &VF, CopySamples);
-		if(StopReq)	return StopReq = false;
+		if(Replay.count)	Ret = ogg_packetreplay(V.Out, &ES.stream_out, &Replay, CopySamples);
+		else				Ret = ogg_packetcopy(V.Out, &ES.stream_out, &VF, CopySamples, 0, (CopySamples == -1) ? &Replay : NULL);
+		if(StopReq)	return false;
+		Open = (CopySamples == 0);
+
+		if(GI->Vorbis)	V.d += Ret * 4;
+
+		// With a replay, only the position behind the last copy still matters
+		if(Replay.count && V.FadeStart != 0 && (l + 1) < ExtLoopCnt())	continue;
 
 		if(GI->Vorbis)
 		{
-			V.d += Ret * 4;
 			if(CopySamples == -1)	ov_raw_seek(&VF, VF.offsets[VF.current_link]);
 			else					ov_pcm_seek(&VF, V.tl + CopySamples);
 		}
@@ -402,8 +558,18 @@ bool Encoder_Vorbis::Extract(TrackInfo* TI, FXString& EncFN, GameInfo* GI, Extra
 	V.Out.flush();
 	assert(V.FadeStart == 0);
 
+	// Lossless fades come out of their own thread as well
+	if(S->Fade.Used)
+	{
+		BGMLib::UI_Stat_Safe("fade...");
+
+		S->Fade.join();
+		V.d += S->Fade.d;
+		if(!S->Fade.Ret)	return false;
+		V.Out.writeBlock(S->Fade.Ogg.Buf, S->Fade.Ogg.Size);
+	}
 	// (Decode and re-)encode fades
-	if(V.FadeBytes != 0 && !StopReq)
+	else if(V.FadeBytes != 0 && !StopReq)
 	{
 		if(GI->Vorbis)
 		{
@@ -415,7 +581,9 @@ bool Encoder_Vorbis::Extract(TrackInfo* TI, FXString& EncFN, GameInfo* GI, Extra
 		// Sometimes, the dsp state happens to break, so...
 		ES.clear();
 		ES.setup(&V.Out, TI->Freq, Quality / 10.0f);
-		if(CopySamples != 0)
+		// Only an intro that was cut down to nothing can take the fade.
+		// Everything else (including lossless intros, which come out of their own thread) needs a new logical stream.
+		if(!Open)
 		{
 			ogg_stream_clear(&ES.stream_out);
 			ogg_stream_init(&ES.stream_out, ++serialno);
@@ -428,21 +596,38 @@ bool Encoder_Vorbis::Extract(TrackInfo* TI, FXString& EncFN, GameInfo* GI, Extra
 		//	   vorbis_encode_ctl(&vi,OV_ECTL_RATEMANAGE2_SET,NULL) ||
 		//		vorbis_encode_setup_init(&vi));
 
-		if(StopReq)	return StopReq = false;
+		if(StopReq)	return false;
 		
 		long Rem = V.FadeBytes;
-		while((Rem > 0) && !StopReq)
+		if(GI->Vorbis)
+		{
+			// Stay in float from the decoder through the fade right into the encoder
+			long Len = V.FadeBytes >> 2;
+			Rem = Len;
+			while((Rem > 0) && !StopReq)
+			{
+				long Read = MIN(OV_BLOCK >> 2, Rem);
+				float** pcm = ES.analysis_buffer(Read);
+
+				ov_read_float_bgm(&VF, pcm, Read, TI);
+				V.FA->EvalFloat(pcm, Read, c, Len);
+				ES.encode_wrote(Read);
+
+				Rem -= Read;
+				V.d += Read << 2;
+			}
+		}
+		else while((Rem > 0) && !StopReq)
 		{
 			int Read = MIN(OV_BLOCK, Rem);
 
 			// Yup, that former streaming function takes care of everything
-			if(GI->Vorbis)	ov_read_bgm(&VF, V.Buf, Read, TI);
-			else			pcm_read_bgm(V.In, V.Buf, Read, TI);
+			pcm_read_bgm(V.In, V.Buf, Read, TI);
 
 			Rem -= Read;
 
 			f = (short*)&V.Buf[0];
-			for(c; c < V.FadeBytes - Rem; c += 4)	f = V.FA->Eval(f, c, V.FadeBytes);
+			V.FA->Fade(f, c, V.FadeBytes - Rem, V.FadeBytes);
 
 			ES.encode_pcm(V.Buf, Read);
 
@@ -451,10 +636,10 @@ bool Encoder_Vorbis::Extract(TrackInfo* TI, FXString& EncFN, GameInfo* GI, Extra
 		// Finalize
 		ES.encode_pcm(NULL, 0);
 	}
-	if(StopReq)	return StopReq = false;
-	MW->ProgConnect();
+	if(StopReq)	return false;
+	V.ProgConnect();
 
-	SAFE_FREE(V.Buf);
+	POOL_RELEASE(V.Buf);
 	// --------------
 	V.In.close();
 	
@@ -467,11 +652,3 @@ bool Encoder_Vorbis::Extract(TrackInfo* TI, FXString& EncFN, GameInfo* GI, Extra
 	return true;
 }
 
-void Encoder_Vorbis::FmtStop()
-{
-	while(StopReq)	FXThread::sleep(TIMEOUT);
-	ES.clear();
-	ogg_stream_clear(&ES.stream_out);
-	ov_clear(&VF);
-	SAFE_DELETE(TF);
-}
@@ -26,7 +26,6 @@ protected:
 	FXCheckButton* MS;
 
 	void FmtReadConfig(ConfigParser* Sect);
-	void FmtStop();
 
 public:
 	float	Quality;	// Vorbis quality setting
@@ -37,7 +36,7 @@ public:
 
 	FXString Init(GameInfo* GI);
 
-	bool Encode(const FXString& DestFN, const FXString& SrcFN, Extract_Vals& V);
+	bool Encode(const FXString& DestFN, PCMQueue& In, Extract_Vals& V);
 
 	// Main extraction function.
 	// Returns true if [TI] was correctly extracted to [EncFN].
@@ -0,0 +1,312 @@
+// Music Room Interface
+// --------------------
+// enc_wav.cpp - Built-in WAV output
+// --------------------
+// "" Nmlgc, 2011
+
+#include "musicroom.h"
+#include <bgmlib/ui.h>
+#include <bgmlib/list.h>
+
+#include <FXHash.h>
+#include <FXStream.h>
+#include <FXObject.h>
+#include <FXThread.h>
+#include <FXIO.h>
+#include <FXFile.h>
+
+#include <bgmlib/libvorbis.h>
+#include <bgmlib/bufpool.h>
+#include "extract.h"
+#include "pipeline.h"
+#include "enc_wav.h"
+
+#ifdef __linux__
+#include <errno.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#endif
+
+const ulong WAV_COPY_CHUNK = 0x1000000;	// 16 MiB per kernel call, so that we still notice StopReq
+const ulong WAV_CLONE_ALIGN = 0x1000;	// Block size FICLONERANGE needs on both ends
+const ushort WAV_SMPL_SIZE = 68;	// Sampler chunk with one loop, incl. chunk header
+
+// Writes a WAV header whose sample data starts at the same offset modulo <WAV_CLONE_ALIGN> as [SrcPos] does in the source,
+// padding it with a JUNK chunk. Only then can the file system share blocks between the two.
+// [Pad] receives the size of the JUNK chunk. Returns false on error.
+static bool WriteAlignedHeader(FXFile& Out, Extract_Vals& V, const FXlong& SrcPos, ulong& Pad)
+{
+	char Header[WAV_HEADER_SIZE];
+	char* Junk;
+	FXuint i;
+	ulong Data = WAV_HEADER_SIZE + 8;	// Earliest possible start, with an empty JUNK chunk
+	bool Ret;
+
+	Data += (ulong)((SrcPos - Data) & (WAV_CLONE_ALIGN - 1));
+	Pad = Data - WAV_HEADER_SIZE;
+
+	makeheader(Header, V.Len, V.Freq);
+	i = WAV_HEADER_SIZE - 8 + V.Len + Pad;
+	memcpy(Header + 4, &i, 4);
+
+	Junk = (char*)calloc(Pad, 1);
+	if(!Junk)	return false;
+	memcpy(Junk, "JUNK", 4);
+	i = Pad - 8;
+	memcpy(Junk + 4, &i, 4);
+
+	// RIFF and fmt, JUNK, data
+	Ret = Out.writeBlock(Header, WAV_HEADER_SIZE - 8) == (FXival)(WAV_HEADER_SIZE - 8);
+	Ret = Ret && Out.writeBlock(Junk, Pad) == (FXival)Pad;
+	Ret = Ret && Out.writeBlock(Header + WAV_HEADER_SIZE - 8, 8) == 8;
+	free(Junk);
+	return Ret;
+}
+
+// Appends a sampler chunk with the loop points of [V] and fixes the RIFF size accordingly.
+// Call right after the sample data has been written. [Pad]: Size of any other chunk before the sample data.
+// Returns false on error.
+static bool WriteSmpl(FXFile& Out, Extract_Vals& V, const ulong& Pad = 0)
+{
+	char Chunk[WAV_SMPL_SIZE];
+	FXuint i;
+
+	memset(Chunk, 0, WAV_SMPL_SIZE);
+	memcpy(Chunk, "smpl", 4);
+	i = WAV_SMPL_SIZE - 8;
+	memcpy(Chunk + 4, &i, 4);
+	i = 1000000000 / V.Freq;	// Sample period
+	memcpy(Chunk + 16, &i, 4);
+	i = 60;	// MIDI unity note
+	memcpy(Chunk + 20, &i, 4);
+	i = 1;	// Loop count
+	memcpy(Chunk + 36, &i, 4);
+
+	// Forward loop. The end is inclusive.
+	i = V.LoopStart;
+	memcpy(Chunk + 52, &i, 4);
+	i = V.LoopStart + V.LoopLen - 1;
+	memcpy(Chunk + 56, &i, 4);
+
+	if(Out.writeBlock(Chunk, WAV_SMPL_SIZE) != WAV_SMPL_SIZE)	return false;
+
+	i = WAV_HEADER_SIZE - 8 + V.Len + Pad + WAV_SMPL_SIZE;
+	return Out.position(4) == 4 && Out.writeBlock(&i, 4) == 4;
+}
+
+bool Encoder_WAV::Encode(const FXString& DestFN, PCMQueue& In, Extract_Vals& V)
+{
+	char Header[WAV_HEADER_SIZE];
+	ulong Read;
+	bool Ret;
+
+	if(!V.Out.open(DestFN, FXIO::Writing))	return false;
+
+	V.Buf = BufPool::Inst().Resize(V.Buf, OV_BLOCK);
+	V.d = 0;
+	V.ProgConnect(V.Len);
+
+	makeheader(Header, V.Len, V.Freq);
+	Ret = V.Out.writeBlock(Header, WAV_HEADER_SIZE) == WAV_HEADER_SIZE;
+	while(Ret && !StopReq && (Read = In.Read(V.Buf, OV_BLOCK)))
+	{
+		if(V.Out.writeBlock(V.Buf, Read) != (FXival)Read)	Ret = false;
+		V.d += Read;
+	}
+	if(Ret && V.LoopLen && !StopReq)	Ret = WriteSmpl(V.Out, V);
+	V.Out.close();
+	POOL_RELEASE(V.Buf);
+	return Ret;
+}
+
+#ifdef __linux__
+// copy_file_range() loop. Advances [In] and [Out], returns the number of bytes copied.
+static ulong KernelCopy(FXFile& Dst, FXFile& Src, loff_t& In, loff_t& Out, const ulong& Len, Extract_Vals& V)
+{
+	ulong Done = 0;
+	ssize_t Ret;
+
+	while(Done < Len && !Encoder::StopReq)
+	{
+		Ret = copy_file_range(Src.handle(), &In, Dst.handle(), &Out, MIN(Len - Done, WAV_COPY_CHUNK), 0);
+		if(Ret <= 0)
+		{
+			if(Ret < 0 && errno == EINTR)	continue;
+			break;
+		}
+		Done += Ret;
+		V.d += Ret;
+	}
+	return Done;
+}
+#endif
+
+bool Encoder_WAV::CopyRange(FXFile& Dst, FXFile& Src, const FXlong& SrcPos, const ulong& Len, Extract_Vals& V, WAVCopyStats& St)
+{
+	ulong Rem = Len;
+	FXlong Read;
+
+#ifdef __linux__
+	loff_t In = SrcPos;
+	loff_t Out = Dst.position();
+	ulong Head = (ulong)(-Out & (WAV_CLONE_ALIGN - 1));	// Up to the next block boundary
+	ulong Body = 0;
+	ulong Done;
+	struct file_clone_range FCR;
+
+	// Reflinks need block-aligned offsets on both sides.
+	// If source and destination are misaligned by the same amount, everything but the head and the tail can still be cloned.
+	if(((In ^ Out) & (WAV_CLONE_ALIGN - 1)) == 0 && Len > Head)	Body = (Len - Head) & ~(WAV_CLONE_ALIGN - 1);
+	if(Body)
+	{
+		Done = KernelCopy(Dst, Src, In, Out, Head, V);
+		Rem -= Done;
+		St.Kernel += Done;
+
+		FCR.src_fd = Src.handle();
+		FCR.src_offset = In;
+		FCR.src_length = Body;
+		FCR.dest_offset = Out;
+		if(Done == Head && ioctl(Dst.handle(), FICLONERANGE, &FCR) == 0)
+		{
+			In += Body;
+			Out += Body;
+			Rem -= Body;
+			V.d += Body;
+			St.Cloned += Body;
+		}
+	}
+
+	// In-kernel copy
+	Done = KernelCopy(Dst, Src, In, Out, Rem, V);
+	Rem -= Done;
+	St.Kernel += Done;
+	Dst.position(Out);
+	if(!Rem || StopReq)	return Rem == 0;
+#endif
+	// Not supported across these file systems (or at all). Through user space it is, then.
+	Src.position(SrcPos + (Len - Rem));
+	while(Rem > 0 && !StopReq)
+	{
+		Read = Src.readBlock(V.Buf, MIN(Rem, (ulong)OV_BLOCK));
+		if(Read <= 0)	return false;
+		if(Dst.writeBlock(V.Buf, Read) != Read)	return false;
+		Rem -= Read;
+		V.d += Read;
+		St.User += Read;
+	}
+	return Rem == 0;
+}
+
+bool Encoder_WAV::ExtractRanges(TrackInfo* TI, FXString& EncFN, GameInfo* GI, Extract_Vals& V)
+{
+	FXString Str;
+	ulong Intro, LoopLen, Verbatim;
+	ulong o = 0;	// Output position
+	ulong Size, Part, Src;
+	ulong Pad = 0;	// JUNK chunk
+	FXlong LoopPos;
+	short* f;
+	long c = 0, End;
+	bool Ret = true;
+	WAVCopyStats St;
+#ifdef PROFILING_LIBS
+	FXTime Time = FXThread::time();
+#endif
+
+	Str.format("Copying %s...", V.DisplayFN.text());
+	BGMLib::UI_Stat_Safe(Str);
+
+	V.Init(TI, FMT_BYTE);
+	if(!GI->OpenBGMFile(V.In, TI))	return false;
+	if(!V.Out.open(EncFN, FXIO::Writing))	return false;
+
+	V.Buf = BufPool::Inst().Resize(V.Buf, OV_BLOCK);
+	V.d = 0;
+	V.ProgConnect(V.Len);
+
+	// Same offsets as the PCM pipeline
+	if(V.tl != 0)
+	{
+		Intro = V.tl - ((TI->FS != 0) ? 0 : V.ts_ext);
+		LoopLen = V.te - V.tl;
+	}
+	else
+	{
+		Intro = V.Len;
+		LoopLen = 0;
+	}
+	LoopPos = V.ts_ext + Intro;
+	Verbatim = V.FadeBytes ? V.FadeStart : V.Len;
+	if(Verbatim > (ulong)V.Len)	Verbatim = V.Len;
+
+	// Aligned to the intro, which usually is the largest range
+	Ret = WriteAlignedHeader(V.Out, V, V.ts_ext, Pad);
+
+	// Intro and full or partial loops, straight from the file
+	Size = MIN(Intro, Verbatim);
+	Ret = Ret && CopyRange(V.Out, V.In, V.ts_ext, Size, V, St);
+	o = Size;
+	while(Ret && LoopLen && o < Verbatim && !StopReq)
+	{
+		Size = MIN(LoopLen, Verbatim - o);
+		Ret = CopyRange(V.Out, V.In, LoopPos, Size, V, St);
+		o += Size;
+	}
+
+	// Fade, which still has to wrap around the loop end on its own
+	while(Ret && o < (ulong)V.Len && !StopReq)
+	{
+		Size = MIN((ulong)OV_BLOCK, V.Len - o);
+		for(Part = 0; Part < Size; )
+		{
+			Src = o + Part;
+			if(Src < Intro || !LoopLen)
+			{
+				V.In.position(V.ts_ext + Src);
+				Src = LoopLen ? MIN(Size - Part, Intro - Src) : (Size - Part);
+			}
+			else
+			{
+				Src = (Src - Intro) % LoopLen;
+				V.In.position(LoopPos + Src);
+				Src = MIN(Size - Part, LoopLen - Src);
+			}
+			if(V.In.readBlock(V.Buf + Part, Src) != (FXival)Src)	memset(V.Buf + Part, 0, Src);
+			Part += Src;
+		}
+
+		End = (long)(o + Size) - V.FadeStart;
+		f = (short*)V.Buf;
+		V.FA->Fade(f, c, End, V.FadeBytes);
+
+		if(V.Out.writeBlock(V.Buf, Size) != (FXival)Size)	Ret = false;
+		o += Size;
+		V.d += Size;
+	}
+	if(Ret && V.LoopLen && !StopReq)	Ret = WriteSmpl(V.Out, V, Pad);
+	V.Out.close();
+	V.In.close();
+	POOL_RELEASE(V.Buf);
+	V.ProgConnect();
+
+#ifdef PROFILING_LIBS
+	Str.format("%s: %lu bytes cloned, %lu copied in-kernel, %lu through user space, %lu faded; %.1f ms\n", V.DisplayFN.text(),
+		(unsigned long)St.Cloned, (unsigned long)St.Kernel, (unsigned long)St.User, (unsigned long)(V.Len - Verbatim),
+		(double)(FXThread::time() - Time) / 1000000.0);
+	BGMLib::UI_Stat_Safe(Str);
+#endif
+
+	if(StopReq)	return false;
+	return Ret;
+}
+
+bool Encoder_WAV::Extract(TrackInfo* TI, FXString& EncFN, GameInfo* GI, Extract_Vals& V)
+{
+	V.TagEngine = false;	// Nothing to tag in plain RIFF WAVE
+
+	// Shared pipelines of multi-format jobs have to be read anyway
+	if(!GI->Vorbis && !V.Tap)	return ExtractRanges(TI, EncFN, GI, V);
+	return Extract_Default(TI, EncFN, GI, V);
+}
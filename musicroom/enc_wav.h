@@ -0,0 +1,43 @@
+// Music Room Interface
+// --------------------
+// enc_wav.h - Built-in WAV output
+// --------------------
+// "" Nmlgc, 2011
+
+#ifndef MUSICROOM_ENC_WAV_H
+#define MUSICROOM_ENC_WAV_H
+
+namespace FX
+{
+	class FXFile;
+}
+
+// Bytes that went through each of the copy paths
+struct WAVCopyStats
+{
+	FXulong	Cloned;	// FICLONERANGE
+	FXulong	Kernel;	// copy_file_range()
+	FXulong	User;	// read() and write()
+
+	WAVCopyStats()	{Cloned = Kernel = User = 0;}
+};
+
+struct Encoder_WAV : public Encoder
+{
+protected:
+	// Raw PCM sources: the intro and the loops are just verbatim ranges of the BGM file, only the fade needs processing.
+	bool ExtractRanges(TrackInfo* TI, FXString& EncFN, GameInfo* GI, Extract_Vals& V);
+
+public:
+	// Copies [Len] bytes from [Src] at [SrcPos] to the current position of [Dst]. Returns false on error.
+	// Clones or copies inside the kernel where possible. [V] provides the buffer and the progress.
+	bool CopyRange(FXFile& Dst, FXFile& Src, const FXlong& SrcPos, const ulong& Len, Extract_Vals& V, WAVCopyStats& St);
+
+	bool Encode(const FXString& DestFN, PCMQueue& In, Extract_Vals& V);
+
+	// Main extraction function.
+	// Returns true if [TI] was correctly extracted to [EncFN].
+	bool Extract(TrackInfo* TI, FXString& EncFN, GameInfo* GI, Extract_Vals& V);
+};
+
+#endif /* MUSICROOM_ENC_WAV_H */
@@ -7,6 +7,7 @@
 #include "musicroom.h"
 #include <fx.h>
 #include <bgmlib/config.h>
+#include <bgmlib/libvorbis.h>
 #include "widgets.h"
 #include "enc_base.h"
 #include "encode.h"
@@ -25,9 +26,8 @@ void Encoder::ReadConfig(ConfigParser* Sect)
 
 void Encoder::Stop()
 {
-	StopReq = true;
+	StopReq = true;	// stays set until the next extraction starts, so that all running jobs see it
 	if(Active)	FmtStop();
-	StopReq = false;
 }
 // ------------------
 
@@ -100,7 +100,8 @@ long EncSettingDlg::onUpdate(FXObject* Sender, FXSelector Msg, void* ptr)
 // ---------------
 
 // Reads [size] bytes from [in] into [buffer]. Loops according to the info in [TI].
-ulong pcm_read_bgm(FXFile& in, char* buffer, const ulong& size, TrackInfo* TI)
+// With [LS], loop transitions are served from the splice instead of seeking on the spot.
+ulong pcm_read_bgm(FXFile& in, char* buffer, const ulong& size, TrackInfo* TI, LoopSplice* LS)
 {
 	long ReadSize;
 	long Rem = size;
@@ -108,9 +109,28 @@ ulong pcm_read_bgm(FXFile& in, char* buffer, const ulong& size, TrackInfo* TI)
 
 	ulong S, L, E;
 	TI->GetPos(FMT_BYTE, true, &S, &L, &E);
+	if(L == E)	L = S;
+
+	if(LS && LS->TI != TI)	LS->Reset(TI);
 	
 	while(Rem > 0)
 	{
+		if(LS)
+		{
+			if(LS->Active())
+			{
+				Rem -= LS->Get(buffer + size - Rem, Rem);
+				pos = LS->Pos + LS->Read;
+				continue;
+			}
+			if(LS->Seek)
+			{
+				// Catch up behind the splice
+				in.position(pos);
+				LS->Seek = false;
+			}
+		}
+
 		if((pos + Rem) >= E)	ReadSize = E - pos;
 		else					ReadSize = Rem;
 			
@@ -120,8 +140,26 @@ ulong pcm_read_bgm(FXFile& in, char* buffer, const ulong& size, TrackInfo* TI)
 
 		if(pos == E)
 		{
-			if(L != E)	pos = L;
-			else		pos = S;
+			pos = L;
+			if(LS && !LS->Len && LS->Alloc())
+			{
+				// First time around, read the splice. That leaves [in] right behind it.
+				in.position(L);
+				ReadSize = in.readBlock(LS->Buf, MIN((ulong)LoopSplice::MaxSize, E - L));
+				if(ReadSize > 0)
+				{
+					LS->Pos = L;
+					LS->Len = ReadSize;
+					LS->Read = 0;
+					continue;
+				}
+			}
+			else if(LS && LS->Len)
+			{
+				LS->Read = 0;
+				LS->Seek = true;
+				continue;
+			}
 			in.position(pos);
 		}
 	}
@@ -18,21 +18,76 @@
 
 #include <FXStat.h>
 #include <FXSystem.h>
+#include <FXPath.h>
 
 #include <bgmlib/libvorbis.h>
+#include <bgmlib/bufpool.h>
 #include "extract.h"
+#include "pipeline.h"
 #include "tagger.h"
 #include <bgmlib/ui.h>
 #include <bgmlib/packmethod.h>
 
-const ushort WAV_HEADER_SIZE = 44;
+// Vorbis master handle
+// --------------------
+// The streamer, the scanner and the extractor all open the same BGM files over and over.
+// The first open of a file parses its headers and link tables into [MasterVF],
+// every handle given out afterwards is a cheap ov_dup() of it.
+static FXMutex	MasterLock;
+static FXFile	MasterFile;
+static OggVorbis_File	MasterVF;
+static FXString	MasterFN;
+
+static void CloseVorbisMaster_Locked()
+{
+	if(MasterFN.empty())	return;
+	ov_clear(&MasterVF);	// closes [MasterFile]
+	MasterFN.clear();
+}
+
+void CloseVorbisMaster()
+{
+	FXMutexLock Lock(MasterLock);
+	CloseVorbisMaster_Locked();
+}
+
+// Opens [GI->BGMFile] and writes handles to [File] and [VF]
+bool OpenVorbisFile(FXFile& File, OggVorbis_File& VF, GameInfo* GI, TrackInfo* TI)
+{
+	FXMutexLock Lock(MasterLock);
+
+	if(!GI->OpenBGMFile(File, TI))	return false;
+
+	FXString FN = GI->DiskFN(TI);
+	if(FN != MasterFN)
+	{
+		CloseVorbisMaster_Locked();
+		if(!GI->OpenBGMFile(MasterFile, TI))
+		{
+			File.close();
+			return false;
+		}
+		if(ov_open_callbacks(&MasterFile, &MasterVF, NULL, 0, OV_CALLBACKS_FXFILE))
+		{
+			MasterFile.close();
+			File.close();
+			return false;
+		}
+		MasterFN = FN;
+	}
+	if(ov_dup(&MasterVF, &VF, &File, OV_CALLBACKS_FXFILE))
+	{
+		File.close();
+		return false;
+	}
+	return true;
+}
 
 // Opens [GI->BGMFile], writes handles to [File] and [VF], and seeks to [TI]
 bool OpenVorbisBGM(FXFile& File, OggVorbis_File& VF, GameInfo* GI, TrackInfo* TI)
 {
-	if(!GI->OpenBGMFile(File, TI))	return false;
+	if(!OpenVorbisFile(File, VF, GI, TI))	return false;
 
-	if(ov_open_callbacks(&File, &VF, NULL, 0, OV_CALLBACKS_FXFILE))	return false;
 	ov_pcm_seek(&VF, TI->GetStart(FMT_SAMPLE, SilResolve()));
 	return true;
 }
@@ -65,35 +120,140 @@ void makeheader(char *header,int datasize, uint Freq)
 	memcpy(header+40,&i,4);
 }
 
-class FadeAlg_Linear : public FadeAlg
+// Fade engine
+// -----------
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define FADE_SSE2
+#include <emmintrin.h>
+#endif
+
+const int FADE_BLOCK = 256;	// Frames per gain curve block
+
+// Multiplies [Frames] interleaved 16-bit stereo frames with one gain per frame.
+// Truncates like the scalar double conversion did, and saturates.
+static void fade_s16(short* f, const float* g, const long& Frames)
 {
-public:
-	short*	Eval(short* f, long& c, long& Len)
+	long s = 0;
+#ifdef FADE_SSE2
+	for(; (s + 4) <= Frames; s += 4)
 	{
-		double Step = (double)c / (double)Len;
-		*f = (double)*f * (1.0 - Step);	f++;
-		*f = (double)*f * (1.0 - Step);	f++;
-		return f;
+		__m128i x = _mm_loadu_si128((__m128i*)&f[s << 1]);
+		__m128 gv = _mm_loadu_ps(&g[s]);
+		__m128 lo = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16));
+		__m128 hi = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16));
+
+		lo = _mm_mul_ps(lo, _mm_unpacklo_ps(gv, gv));
+		hi = _mm_mul_ps(hi, _mm_unpackhi_ps(gv, gv));
+		x = _mm_packs_epi32(_mm_cvttps_epi32(lo), _mm_cvttps_epi32(hi));
+		_mm_storeu_si128((__m128i*)&f[s << 1], x);
 	}
+#endif
+	for(; s < Frames; s++)
+	{
+		float l = f[(s << 1)] * g[s];
+		float r = f[(s << 1) + 1] * g[s];
+		f[(s << 1)]     = (short)MAX(MIN(l, 32767.0f), -32768.0f);
+		f[(s << 1) + 1] = (short)MAX(MIN(r, 32767.0f), -32768.0f);
+	}
+}
 
-	FadeAlg_Linear()	{Name = L"";}
-	SINGLETON(FadeAlg_Linear);
+// Multiplies [Samples] planar float samples with one gain per sample.
+static void fade_float(float* f, const float* g, const long& Samples)
+{
+	long s = 0;
+#ifdef FADE_SSE2
+	for(; (s + 4) <= Samples; s += 4)	_mm_storeu_ps(&f[s], _mm_mul_ps(_mm_loadu_ps(&f[s]), _mm_loadu_ps(&g[s])));
+#endif
+	for(; s < Samples; s++)	f[s] *= g[s];
+}
+
+short* FadeAlg::Fade(short* f, long& c, const long& End, const long& Len)
+{
+	long Frames = (End - c) >> 2;
+	if(Frames <= 0)	return f;
+	Apply(f, Frames, c, Len);
+	return f + (Frames << 1);
+}
+
+// Fade curves. Apart from Gain(), each one fills a block with [n] gains, starting at [Step] and [Inc] apart.
+struct FadeCurve_Linear
+{
+	static double Gain(const double& Step)	{return 1.0 - Step;}
+
+	static void Fill(float* g, double Step, const double& Inc, const int& n)
+	{
+		for(int i = 0; i < n; i++, Step += Inc)	g[i] = (float)(1.0 - Step);
+	}
 };
 
-class FadeAlg_Exp : public FadeAlg
+struct FadeCurve_Exp
+{
+	static double Gain(const double& Step)	{return -pow(0.05, Step) * (Step - 1.0);}
+
+	// One pow() per block, the rest is a running product
+	static void Fill(float* g, double Step, const double& Inc, const int& n)
+	{
+		double p = pow(0.05, Step);
+		const double r = pow(0.05, Inc);
+		for(int i = 0; i < n; i++, Step += Inc, p *= r)	g[i] = (float)(-p * (Step - 1.0));
+	}
+};
+
+// Block fader on top of a fade curve. Only one virtual call per buffer.
+template <class Curve> class FadeAlg_Block : public FadeAlg
 {
 public:
-	short*	Eval(short* f, long& c, long& Len)
+	double	Gain(const double& Step)	{return Curve::Gain(Step);}
+
+	void	Apply(short* f, const long& Frames, long& c, const long& Len)
+	{
+		float g[FADE_BLOCK];
+		long Rem = Frames;
+		int n;
+
+		while(Rem > 0)
+		{
+			n = MIN(Rem, (long)FADE_BLOCK);
+			Curve::Fill(g, (double)c / (double)Len, 4.0 / (double)Len, n);
+			fade_s16(f, g, n);
+			f += n << 1;
+			c += n << 2;
+			Rem -= n;
+		}
+	}
+
+	void	EvalFloat(float** f, const long& Samples, long& c, const long& Len)
 	{
-		double Step = (double)c / (double)Len;
-		*f = (double)*f * (-pow(0.05, Step) * (Step - 1.0));	f++;
-		*f = (double)*f * (-pow(0.05, Step) * (Step - 1.0));	f++;
-		return f;
+		float g[FADE_BLOCK];
+		long s = 0;
+		int n;
+
+		while(s < Samples)
+		{
+			n = MIN(Samples - s, (long)FADE_BLOCK);
+			Curve::Fill(g, (double)c / (double)Len, 1.0 / (double)Len, n);
+			fade_float(f[0] + s, g, n);
+			fade_float(f[1] + s, g, n);
+			c += n;
+			s += n;
+		}
 	}
+};
 
+class FadeAlg_Linear : public FadeAlg_Block<FadeCurve_Linear>
+{
+public:
+	FadeAlg_Linear()	{Name = L"";}
+	SINGLETON(FadeAlg_Linear);
+};
+
+class FadeAlg_Exp : public FadeAlg_Block<FadeCurve_Exp>
+{
+public:
 	FadeAlg_Exp()	{Name = L"Լ";}
 	SINGLETON(FadeAlg_Exp);
 };
+// -----------
 
 // Decryption thread
 // -----------------
@@ -109,18 +269,18 @@ FXint Decrypter::run()
 
 	Ret = (GI->PM->DecryptFile(GI, In, VF->Buf, TI->GetStart(), VF->Size, &VF->Write) != 0);
 	In.close();
-	detach();
 	return Ret;
 }
 
 ulong Decrypter::Start(GameInfo* _GI, TrackInfo* _TI, VFile* _VF)
 {
 	if(running())	return 0;
+	join();	// Previous run
 
-	Src = _GI->DiskFN(TI);
 	GI = _GI;
 	TI = _TI;
 	VF = _VF;
+	Src = GI->DiskFN(TI);
 
 	start();
 	return TI->FS;
@@ -134,6 +294,15 @@ void Decrypter::Stop()
 
 Extractor::Extractor()
 {
+	NextJob = NULL;
+	Workers = NULL;
+	Enc = NULL;
+	EncCount = 0;
+	WorkerCount = 0;
+	Done = 0;
+	Failed = false;
+	FA = NULL;
+
 	FAs.Add()->Data = &FadeAlg_Linear::Inst();
 	FAs.Add()->Data = &FadeAlg_Exp::Inst();
 }
@@ -141,8 +310,16 @@ Extractor::Extractor()
 Extract_Vals::Extract_Vals()
 {
 	ts_data = ts_ext = tl = te = 0;
-	Len = FadeStart = FadeBytes = f = 0;
+	Len = FadeStart = FadeBytes = 0;
+	LoopStart = LoopLen = 0;
+	Freq = 0;
 	Buf = NULL;
+	Pipe = NULL;
+	Tap = NULL;
+	Enc = NULL;
+	FA = NULL;
+	TagEngine = false;
+	Solo = true;
 	d = 0;
 	StopReq = &Encoder::StopReq;
 	Ret = &Extractor::Ret;
@@ -159,198 +336,80 @@ void Extract_Vals::Init(TrackInfo* TI, const bool& Fmt)
 	TI->GetPos(Fmt, SilResolve(), &ts_ext, &tl, &te);
 	TI->GetPos(Fmt, false, &ts_data);
 
-	Len = TI->GetByteLength(SilResolve(), LoopCnt, FadeDur);
+	Len = TI->GetByteLength(SilResolve(), ExtLoopCnt(), ExtFadeDur());
+	Freq = TI->Freq;
+
+	if(!LoopMeta || !LoopPoints(TI, &LoopStart, &LoopLen))	LoopStart = LoopLen = 0;
 
-	FadeBytes = (ulong)(fabs(FadeDur) * TI->Freq * 4.0f);
+	FadeBytes = (ulong)(fabs(ExtFadeDur()) * TI->Freq * 4.0f);
 	
 	if( (tl == te) || (tl == 0)) FadeBytes = 0;
 
 	FadeBytes = MIN(FadeBytes, Len);
 	FadeStart = Len - FadeBytes;
-	f = 0;
 }
 
 void Extract_Vals::Clear()
 {
+	SAFE_DELETE(Pipe);
+	SAFE_DELETE(Enc);
+	Tap = NULL;
 	In.close();
 	Out.close();
-	SAFE_FREE(Buf);
+	POOL_RELEASE(Buf);
 	d = 0;
 	ts_data = ts_ext = tl = te = 0;
-	Len = FadeStart = FadeBytes = f = 0;
+	Len = FadeStart = FadeBytes = 0;
+	LoopStart = LoopLen = 0;
 }
 
-static void CalcFade(Extract_Vals& V, long& BufSize, FadeAlg* FA)
+void Extract_Vals::ProgConnect(const FXuint& Max)
 {
-	V.FadeStart -= BufSize;
-
-	if(V.FadeStart <= 0)
-	{
-		short* f = (short*)&V.Buf[MAX(BufSize + V.FadeStart, 0)];
-		for(; V.f < -(V.FadeStart); V.f += 4)	f = FA->Eval(f, V.f, V.FadeBytes);
-	}
+	if(!Solo)	return;
+	if(Max)	MW->ProgConnect(&d, Max);
+	else	MW->ProgConnect();
 }
 
 volatile FXuint Extractor::Ret;
 
 // Single track extraction main function
-bool Extractor::ExtractTrack(TrackInfo* TI, FXString& OutFN)
+bool Extractor::ExtractTrack(ExtractJob* Job, Extract_Vals& V)
 {
+	TrackInfo* TI = Job->TI;
 	bool Ret;
-	EncFN.format("%d.%s", TI->Number, Enc->Ext.lower());
-	Enc->Active = true;
-	Ret = Enc->Extract(TI, EncFN, ActiveGame, V);
-	Enc->Active = (*V.StopReq) = false;
-	if(!Ret)	return false;
 
-	if(Move(EncFN, OutFN))
-	{
-		if(V.TagEngine)	Tag(TI, OutFN);
-	}
-	Cleanup();
-	return true;
-}
+	if(EncCount > 1)	return ExtractFormats(Job, V);
 
-// Ensures [In] to have the (original) PCM data from [TI]. Decodes the file, if necessary.
-bool Extractor::PrepareInput(TrackInfo* TI, GameInfo* GI, Extract_Vals& V)
-{
-	if(!GI->Vorbis)
-	{
-		if(!ActiveGame->OpenBGMFile(V.In, TI))	return false;
-		V.In.position(V.ts_ext);
-	}
-	else
-	{
-		Decrypter& Dec = Decrypter::Inst();
-		OggVorbis_File VF;
-		VFile BGM;
-		long ret;
-		int Link;
-		ulong Size;
-		bool ReadConn = false;
-		
-		BGMLib::UI_Stat_Safe(L"ڵ ...");
-
-		V.Buf = (char*)realloc(V.Buf, OV_BLOCK);
-
-		// Directly decode from the original BGM file
-		if(GI->CryptKind)
-		{
-			// Open a virtual file
-			Dec.Start(GI, TI, &BGM);
-
-			// Wait for the first block...
-			while(BGM.Write < (OV_BLOCK * 2));
-
-			ov_open_callbacks(&BGM, &VF, NULL, 0, OV_CALLBACKS_VFILE);
-		}
-		else
-		{
-			if(!OpenVorbisBGM(V.In, VF, GI, TI))	return false;
-		}
-		Size = TI->GetByteLength(SilResolve(), 1, 0);
-		V.d = 0;
+	V.DisplayFN = Job->DisplayFN;
+	V.EncFN.format("%s%s%d.%s", FXSystem::getTempDirectory().text(), SlashString, TI->Number, Ext.text());
 
-		V.Out.open(DecodeFile, FXIO::Writing);
-		do
+	Ret = Enc->Extract(TI, V.EncFN, ActiveGame, V);
+	if(Ret)
+	{
+		FXMutexLock Lock(TagLock);
+		if(Move(V.EncFN, Job->OutFN))
 		{
-			ret = ov_read(&VF, V.Buf, OV_BLOCK, 0, 2, 1, &Link);
-			V.d += V.Out.writeBlock(V.Buf, MAX(ret, 0));
-
-			if(Dec.running())	sleep(2000);
-			else if(!ReadConn)
-			{
-				MW->ProgConnect(&V.d, Size);
-				ReadConn = true;
-			}
-			if(*V.StopReq)	{Dec.Stop();	break;}
+			if(V.TagEngine)	Tag(TI, Job->OutFN, Ext);
 		}
-		while(V.d < Size);
-		
-		ov_clear(&VF);
-
-		V.Out.close();
-		if(GI->CryptKind)	BGM.Clear();
-		else				V.In.close();
-
-		if(*V.StopReq)	return *V.StopReq = false;
-		else			MW->ProgConnect();
-
-		V.In.open(DecodeFile, FXIO::Reading);
-		SAFE_FREE(V.Buf);
 	}
-	return true;
+	BGMLib::UI_Stat_Safe("\n");
+	V.ProgConnect();
+	V.Clear();
+	FX::FXFile::remove(V.EncFN);
+	return Ret;
 }
 
-FXString& Extractor::BuildPCM(TrackInfo* TI, Extract_Vals& V)
+// Opens the source of [TI] and starts delivering its (original) PCM data into <V.Pipe>. Decodes the file, if necessary.
+bool Extractor::PrepareInput(TrackInfo* TI, GameInfo* GI, Extract_Vals& V)
 {
-	char Header[WAV_HEADER_SIZE];
-	long BufSize;
-	long c = 0;	// Fade progression
-
-	DumpFN.format("%d.wav", TI->Number);
-	
-	V.Out.open(DumpFN, FXIO::Writing);
-
-	makeheader(Header, V.Len, TI->Freq);
-	V.Out.writeBlock(Header, WAV_HEADER_SIZE);
-
-	// Start transfer
-	// --------------
-	// Intro
-	if(TI->FS != 0)	BufSize = V.tl;
-	else			BufSize = V.tl - V.ts_ext;
-
-	V.Buf = (char*)realloc(V.Buf, BufSize);
-	V.In.readBlock(V.Buf, BufSize);
-
-	CalcFade(V, BufSize, V.FA);
-
-	V.Out.writeBlock(V.Buf, BufSize);
-
-	// Loops
-	BufSize = V.te - V.tl;
-	if(BufSize > 0)
-	{
-		V.Buf = (char*)realloc(V.Buf, BufSize);
-
-		for(ushort l = 0; l < LoopCnt && !(*V.StopReq); l++)
-		{
-			V.In.readBlock(V.Buf, BufSize);
-
-			CalcFade(V, BufSize, V.FA);
-
-			V.Out.writeBlock(V.Buf, BufSize);
-			V.In.position(V.tl);
-		}
-	}
-
-	// Fade
-	if(V.FadeBytes != 0)
-	{
-		long Rem = V.FadeBytes - c;
-		short* f;
-
-		if(Rem > BufSize)	V.Buf = (char*)realloc(V.Buf, BufSize);
-		BufSize = Rem;
-
-		while(Rem > 0 && !(*V.StopReq))
-		{
-			ulong Read = MIN(V.te - V.tl, (ulong)Rem);
-
-			V.In.readBlock(V.Buf, Read);
-			Rem -= Read;
-		
-			f = (short*)&V.Buf[0];
-			for(c; c < BufSize - Rem; c += 4)	f = V.FA->Eval(f, c, V.FadeBytes);
+	if(!V.Pipe)	V.Pipe = new PCMPipeline;
+	return V.Pipe->Open(GI, TI, V);
+}
 
-			V.Out.writeBlock(V.Buf, Read);
-			V.In.position(V.tl);
-		}
-	}
-	SAFE_FREE(V.Buf);
-	V.Out.close();
-	return DumpFN;
+// Starts looping and fading the PCM data of [TI], according to [V]. Returns the queue the encoder reads it from.
+PCMQueue& Extractor::BuildPCM(TrackInfo* TI, Extract_Vals& V)
+{
+	return V.Pipe->Start(TI, V);
 }
 
 bool Extractor::Move(FXString& EncFN, FXString& OutFN)
@@ -363,7 +422,7 @@ bool Extractor::Move(FXString& EncFN, FXString& OutFN)
 		FXuint Cancel;
 
 		Str.format("%s", OutFN + L" Ͽ   ϴ!\n ΰ     ֽϴ.\n Ͻðڽϱ?");
-		MW->ThreadMsg(this, Str, &Cancel, MBOX_YES_NO);
+		MW->ThreadMsg(FXThread::self(), Str, &Cancel, MBOX_YES_NO);
 
 		if(Cancel == MBOX_CLICKED_YES)
 		{
@@ -379,7 +438,7 @@ bool Extractor::Move(FXString& EncFN, FXString& OutFN)
 	return true;
 }
 
-uint Extractor::Tag(TrackInfo* TI, FXString& OutFN)
+uint Extractor::Tag(TrackInfo* TI, FXString& OutFN, FXString& Ext)
 {
 	if(!Active)	return Ret;
 
@@ -391,13 +450,114 @@ uint Extractor::Tag(TrackInfo* TI, FXString& OutFN)
 
 uint Extractor::Cleanup()
 {
-	BGMLib::UI_Stat_Safe("\n");
 	MW->ProgConnect();
+	Jobs.Clear();
+	NextJob = NULL;
+
+	return Ret;
+}
+
+// Worker
+// ------
+FXint ExtractWorker::run()
+{
+	Extractor& Ext = Extractor::Inst();
+	ExtractJob* Job = NULL;
+	bool Ret = true;
+
+	while((Job = Ext.Next(Job, Ret)))	Ret = Ext.ExtractTrack(Job, V);
+
+	V.Clear();
+	return 1;
+}
+
+ExtractJob* Extractor::Next(ExtractJob* Prev, const bool& PrevRet)
+{
+	FXMutexLock Lock(JobLock);
+	ExtractJob* Job;
+
+	if(Prev)
+	{
+		Done++;
+		if(!PrevRet)	Failed = true;
+	}
+	if(!NextJob || Failed || Ret == 0 || Ret == MBOX_CLICKED_CANCEL)	return NULL;
+
+	Job = &NextJob->Data;
+	NextJob = NextJob->Next();
+	return Job;
+}
+// ------
+
+FXString Extractor::FormatFN(const FXString& OutFN, const ushort& e)
+{
+	if(e == 0)	return OutFN;
+	return FXPath::stripExtension(OutFN) + "." + EncExt[e];
+}
+
+bool Extractor::ExtractFormats(ExtractJob* Job, Extract_Vals& V)
+{
+	TrackInfo* TI = Job->TI;
+	FormatWorker* FW;
+	PCMPipeline Pipe;
+	PCMQueue* Taps;
+	FXString Str;
+	ushort e;
+	bool Ret = true;
+
+	Str.format("%s...", Job->DisplayFN + L"  ");
+	BGMLib::UI_Stat_Safe(Str);
+
+	// Decode, loop and fade once...
+	V.Init(TI, FMT_BYTE);
+	if(!Pipe.Open(ActiveGame, TI, V))	return false;
+	Taps = Pipe.Fan(TI, V, EncCount);
+	if(!Taps)	return false;
+
+	// ...and encode everywhere
+	FW = new FormatWorker[EncCount];
+	for(e = 0; e < EncCount; e++)
+	{
+		FW[e].Enc = Encs[e];
+		FW[e].TI = TI;
+		FW[e].OutFN = FormatFN(Job->OutFN, e);
+		FW[e].EncFN.format("%s%s%d_%d.%s", FXSystem::getTempDirectory().text(), SlashString, TI->Number, e, EncExt[e].text());
+		FW[e].V.DisplayFN = FXPath::name(FW[e].OutFN);
+		FW[e].V.FA = V.FA;
+		FW[e].V.Solo = V.Solo && (e == 0);
+		FW[e].V.Tap = &Taps[e];
+		FW[e].start();
+	}
+	for(e = 0; e < EncCount; e++)	FW[e].join();
+	Pipe.Stop();
+
+	for(e = 0; e < EncCount; e++)
+	{
+		if(FW[e].Ret)
+		{
+			FXMutexLock Lock(TagLock);
+			if(Move(FW[e].EncFN, FW[e].OutFN))
+			{
+				if(FW[e].V.TagEngine)	Tag(TI, FW[e].OutFN, EncExt[e]);
+			}
+		}
+		else	Ret = false;
+		FX::FXFile::remove(FW[e].EncFN);
+	}
+	SAFE_DELETE_ARRAY(FW);
+
+	BGMLib::UI_Stat_Safe("\n");
+	V.ProgConnect();
 	V.Clear();
-	FX::FXFile::remove(DumpFN);
-	FX::FXFile::remove(EncFN);
-	FX::FXFile::remove(DecodeFile);
+	return Ret;
+}
 
+FXint FormatWorker::run()
+{
+	Ret = Enc->Extract(TI, EncFN, ActiveGame, V);
+	V.Tap->Abort();	// in case [Enc] didn't need it
+	V.ProgConnect();
+	V.Clear();
 	return Ret;
 }
 
@@ -411,15 +571,41 @@ bool Extractor::Start(const short& ExtStart, const short& ExtEnd, const ushort&
 	Last = ExtEnd;
 
 	Enc = Encoders.Get(EncFmt - 1)->Data;
-	Ext = Enc->Ext.lower();
-	V.FA = FAs.Get(MIN(FadeAlgID, FAs.Size() - 1))->Data;
+	Ext = Enc->Ext;
+	Ext.lower();
+	FA = FAs.Get(MIN(FadeAlgID, FAs.Size() - 1))->Data;
+
+	// Additional formats
+	Encs[0] = Enc;
+	EncExt[0] = Ext;
+	EncCount = 1;
+	for(FXint s = 0; s <= AlsoEnc.contains(','); s++)
+	{
+		FXString Tok = AlsoEnc.section(',', s);
+		ListEntry<Encoder*>* CurEnc = Encoders.First();
+		ushort e;
+
+		Tok.trim();
+		Tok.lower();
+		while(CurEnc && FXString(CurEnc->Data->Ext).lower() != Tok)	CurEnc = CurEnc->Next();
+		if(!CurEnc || EncCount >= MAX_ENCODERS)	continue;
+
+		for(e = 0; e < EncCount && Encs[e] != CurEnc->Data; e++);
+		if(e == EncCount)
+		{
+			Encs[EncCount] = CurEnc->Data;
+			EncExt[EncCount++] = Tok;
+		}
+	}
 
 	Stat = L"\n ۵Ǿϴ.\n";
-	Stat.append(Enc->Init(ActiveGame));
+	for(ushort e = 0; e < EncCount; e++)	Stat.append(Encs[e]->Init(ActiveGame));
 	Stat.append("-------------------\n");
 	BGMLib::UI_Stat_Safe(Stat);
 
 	Ret = MBOX_CLICKED_YES;
+	Encoder::StopReq = false;
+	Enc->Active = true;
 
 	cancel();
 	start();
@@ -429,34 +615,59 @@ bool Extractor::Start(const short& ExtStart, const short& ExtEnd, const ushort&
 
 int Extractor::run()
 {
-	FXString OutFN, Str;
-	
-	FXSystem::setCurrentDirectory(FXSystem::getTempDirectory());
+	ListEntry<TrackInfo>* CurTrack;
+	ExtractJob* Job;
+	FXString OutFN, DisplayFN, Str;
+	ushort w, e;
 
+	// Collect the jobs first, so that all questions are asked before the workers start
+	Jobs.Clear();
 	CurTrack = ActiveGame->Track.Get(Cur);
 	do
 	{
 		if(!CurTrack->Data.Start[0] && !ActiveGame->BGMFile.empty())	continue;
 
-		V.DisplayFN = PatternFN(&CurTrack->Data);
-		OutFN = OutPath + V.DisplayFN;
+		DisplayFN = PatternFN(&CurTrack->Data);
+		OutFN = OutPath + DisplayFN;
 		
-		if(FXStat::exists(OutFN))
+		for(e = 0; e < EncCount && !FXStat::exists(FormatFN(OutFN, e)); e++);
+		if(e < EncCount)
 		{
 			if(Ret != MBOX_CLICKED_YESALL && Ret != MBOX_CLICKED_NOALL)
 			{
-				Str = OutFN + L"() ̹ մϴ.\nðڽϱ?";
+				Str = FormatFN(OutFN, e) + L"() ̹ մϴ.\nðڽϱ?";
 				MW->ThreadMsg(this, Str, &Ret, MBOX_YES_YESALL_NO_NOALL_CANCEL);
 			}
 			if(Ret == MBOX_CLICKED_CANCEL)	break;
 			if((Ret != MBOX_CLICKED_YES) && (Ret != MBOX_CLICKED_YESALL))	continue;
 		}
 
-		if(!ExtractTrack(&CurTrack->Data, OutFN) || Ret == 0)	break;
-		if(Ret == MBOX_CLICKED_CANCEL)	break;
+		Job = &Jobs.Add()->Data;
+		Job->TI = &CurTrack->Data;
+		Job->DisplayFN = DisplayFN;
+		Job->OutFN = OutFN;
 	}
 	while( CurTrack && (CurTrack = CurTrack->Next()) && ++Cur < Last);
 
+	// Run them, on as many threads as requested
+	NextJob = Jobs.First();
+	Failed = false;
+	Done = 0;
+
+	WorkerCount = ExtractThreads ? ExtractThreads : FXThread::processors();
+	WorkerCount = MAX(1, MIN(WorkerCount, Jobs.Size()));
+	Workers = new ExtractWorker[WorkerCount];
+
+	if(WorkerCount > 1)	MW->ProgConnect(&Done, Jobs.Size());
+	for(w = 0; w < WorkerCount; w++)
+	{
+		Workers[w].V.FA = FA;
+		Workers[w].V.Solo = (WorkerCount == 1);
+		Workers[w].start();
+	}
+	for(w = 0; w < WorkerCount; w++)	Workers[w].join();
+	SAFE_DELETE_ARRAY(Workers);
+
 	Finish();
 
 	return 1;
@@ -466,7 +677,7 @@ void Extractor::Stop()
 {
 	if(!Active)	return;
 	Ret = 0;
-	Enc->Stop();
+	for(ushort e = 0; e < EncCount; e++)	Encs[e]->Stop();
 }
 
 bool Extractor::Finish()
@@ -481,7 +692,7 @@ bool Extractor::Finish()
 
 	Cleanup();
 
-	CurTrack = NULL;
+	Enc->Active = false;
 	Cur = Last = 0;
 	MW->ActFinish();
 
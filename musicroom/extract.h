@@ -7,7 +7,11 @@
 #ifndef MUSICROOM_EXTRACT_H
 #define MUSICROOM_EXTRACT_H
 
-extern const ushort WAV_HEADER_SIZE;
+const ushort WAV_HEADER_SIZE = 44;	// Needs to be a constant expression everywhere, for buffers
+void makeheader(char *header,int datasize, uint Freq);
+
+class PCMPipeline;
+class PCMQueue;
 
 // Fade algorithms
 class FadeAlg
@@ -15,7 +19,17 @@ class FadeAlg
 public:
 	FXString	Name;
 
-	virtual short*	Eval(short* f, long& c, long& Len) = 0;
+	virtual double	Gain(const double& Step) = 0;	// Volume at [Step] (0.0 - 1.0) through the fade
+
+	// Fades [Frames] interleaved 16-bit stereo frames at [f], starting [c] bytes into a fade of [Len] bytes. Advances [c].
+	virtual void	Apply(short* f, const long& Frames, long& c, const long& Len) = 0;
+
+	// Fades [Samples] planar stereo float samples, starting [c] samples into a fade of [Len] samples. Advances [c].
+	virtual void	EvalFloat(float** f, const long& Samples, long& c, const long& Len) = 0;
+
+	// Fades all whole frames from [f] until [c] reaches [End]. Returns the position behind the last faded frame.
+	short*	Fade(short* f, long& c, const long& End, const long& Len);
+
 	virtual ~FadeAlg()	{}
 };
 
@@ -25,6 +39,7 @@ struct Extract_Vals
 	FXFile In;
 	FXFile Out;
 	FXString DisplayFN;
+	FXString EncFN;	// Temporary path to the encoded file in the temporary directory (e.g. 01.mp3)
 
 	// All of these are absolute!
 	ulong	ts_data;	// digital track start
@@ -33,24 +48,65 @@ struct Extract_Vals
 	ulong	te;			// loop position
 
 	long	Len;	// Total track length, incl. loops and fades
+	ulong	Freq;	// Sampling rate
 
 	FadeAlg*	FA;
 	long	FadeStart;
 	long	FadeBytes;
-	long	f;	// Fade progression
+
+	// Loop points to write as metadata, in samples. Both 0 unless <LoopMeta> is set.
+	ulong	LoopStart;
+	ulong	LoopLen;
 
 	char*	Buf;	// Temporary extraction buffer
+	PCMPipeline*	Pipe;	// PCM stages feeding the encoder
+	PCMQueue*	Tap;	// If set, the encoder reads from this shared pipeline output instead of building <Pipe>
+	EncState*	Enc;	// Encoder-specific state of this job
 	bool	TagEngine;	// Should the tag engine tag this one?
 
 	// Thread
 	volatile bool* StopReq;	// points to Encoder::StopReq
 	volatile FXulong d;		// Progress
 	volatile uint*	Ret;	// points to Extractor::Ret
+	bool	Solo;	// No other jobs running in parallel, <d> may use the progress bar
 
 	Extract_Vals();
 	Extract_Vals(TrackInfo* TI, const bool& Fmt);
 	void Init(TrackInfo* TI, const bool& Fmt);
 	void Clear();
+
+	void ProgConnect(const FXuint& Max = 0);	// Connects <d> to the progress bar if we're <Solo>. Call without [Max] to disconnect.
+};
+
+// One track to extract
+struct ExtractJob
+{
+	TrackInfo*	TI;
+	FXString	OutFN;
+	FXString	DisplayFN;
+};
+
+// Runs one encoder of a multi-format job, reading from its own tap of the shared pipeline
+class FormatWorker : public FXThread
+{
+public:
+	Encoder*	Enc;
+	TrackInfo*	TI;
+	FXString	EncFN;
+	FXString	OutFN;
+	Extract_Vals	V;
+	bool	Ret;
+
+	virtual FXint run();
+};
+
+// Extraction worker thread. Takes jobs off the Extractor until there are none left.
+class ExtractWorker : public FXThread
+{
+public:
+	Extract_Vals	V;
+
+	virtual FXint run();
 };
 
 class Extractor : public FXThread, FXObject
@@ -58,17 +114,36 @@ class Extractor : public FXThread, FXObject
 protected:
 	Extractor();
 	
-	Extract_Vals V;
-
-	ListEntry<TrackInfo>* CurTrack;
 	short Cur, Last;
 
-	FXString DumpFN;	// Temporary extraction wave file, created in a temporary directory (e.g. extract.wav)
-	FXString EncFN; 	// Temporary path to the encoded file in the temporary directory (e.g. extract.mp3)
 	FXString Ext;		// Final file extension
+	FadeAlg*	FA;	// Selected fade algorithm
+
+	Encoder*	Encs[MAX_ENCODERS];	// Selected encoder first, then the ones from <AlsoEnc>
+	FXString	EncExt[MAX_ENCODERS];	// Lowercase extension of each of <Encs>. FXString::lower() works in place, so the workers must not call it on the shared encoders.
+	ushort	EncCount;
+
+	// Jobs
+	// ----
+	FXMutex	JobLock;	// Guards <NextJob>
+	List<ExtractJob>	Jobs;
+	ListEntry<ExtractJob>*	NextJob;
+
+	ExtractWorker*	Workers;
+	ushort	WorkerCount;
+	volatile FXulong	Done;	// Finished jobs, shown on the progress bar if more than one worker is running
+	bool	Failed;	// A job failed, don't start any more
+
+	FXMutex	TagLock;	// Moving and tagging is done one job at a time
+	// ----
 	
 	bool Move(FXString& Dest, FXString& Src);	// Moves [Src] to [Dest] and returns true if successful. It's that simple.
-	uint Tag(TrackInfo* TI, FXString& OutFN);	// Cross-format tagging
+	uint Tag(TrackInfo* TI, FXString& OutFN, FXString& Ext);	// Cross-format tagging
+
+	FXString FormatFN(const FXString& OutFN, const ushort& e);	// Output file name of [OutFN] for <Encs[e]>
+
+	// Multi-format extraction. Decodes, loops and fades once and broadcasts the result to all <Encs>, which run in parallel.
+	bool ExtractFormats(ExtractJob* Job, Extract_Vals& V);
 	bool Finish();	// Only called by the thread function
 
 public:
@@ -78,24 +153,25 @@ public:
 	
 	// Helper functions
 	// ------
-	// Ensures [In] to have the (original) PCM data from [TI]. Decodes the file, if necessary.
+	// Opens the source of [TI] and starts delivering its (original) PCM data into <V.Pipe>. Decodes the file, if necessary.
 	bool PrepareInput(TrackInfo* TI, GameInfo* GI, Extract_Vals& V);
 
-	// Writes a looped and faded PCM dump of [TI], according to [V]. Returns it's filename
-	FXString& BuildPCM(TrackInfo* TI, Extract_Vals& V);
+	// Starts looping and fading the PCM data of [TI], according to [V]. Returns the queue the encoder reads it from.
+	PCMQueue& BuildPCM(TrackInfo* TI, Extract_Vals& V);
 	// ------
 
-	bool ExtractTrack(TrackInfo* TI, FXString& OutFN);	// Single track extraction main function
+	bool ExtractTrack(ExtractJob* Job, Extract_Vals& V);	// Single track extraction main function. Called by the workers.
+	ExtractJob* Next(ExtractJob* Prev, const bool& PrevRet);	// Finishes [Prev] and returns the next job to do, or NULL if we're done or have been stopped
 
 	bool Active;
 	List<FadeAlg*>	FAs;
 
-	virtual FXint run();	// FOX Thread function. Runs the extraction loop
+	virtual FXint run();	// FOX Thread function. Collects the jobs and runs the workers on them
 
 	bool Start(const short& ExtStart, const short& ExtEnd, const ushort& FadeAlgID);
 	void Stop();
 
-	uint Cleanup();	// Removes temporary files
+	uint Cleanup();	// Stops the PCM stages and removes temporary files
 
 	SINGLETON(Extractor);
 
@@ -105,6 +181,7 @@ public:
 // Used to speed up the extraction process, because we don't need seeking there.
 // The caller links the thread to a progress variable.
 // This way, decrypted bytes can be used immediately.
+// Every source reader owns one, so that parallel jobs don't get in each other's way.
 // -----------------
 
 class VFile;
@@ -112,8 +189,6 @@ class VFile;
 class Decrypter : public FXThread, FXObject
 {
 protected:
-	Decrypter()	{}
-
 	// Parameters
 	FXString Src;
 	GameInfo* GI;
@@ -123,10 +198,10 @@ protected:
 	virtual FXint run();
 
 public:
+	Decrypter()	{}
+
 	ulong Start(GameInfo* GI, TrackInfo* TI, VFile* VF);	// Starts threaded decryption, returns size of decrypted file
 	void Stop();
-
-	SINGLETON(Decrypter);
 };
 // -----------------
 
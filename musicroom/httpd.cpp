@@ -0,0 +1,605 @@
+// Music Room Interface
+// --------------------
+// httpd.cpp - Local HTTP streaming server
+// --------------------
+// "" Nmlgc, 2011
+
+#ifdef WIN32
+#include <winsock2.h>	// before anything pulls in <windows.h>
+#else
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <unistd.h>
+typedef int SOCKET;
+#define INVALID_SOCKET	(-1)
+#define SD_BOTH	SHUT_RDWR
+#define closesocket	::close
+#endif
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL	0
+#endif
+
+#include "musicroom.h"
+#include <math.h>
+#include <FXHash.h>
+#include <FXStream.h>
+#include <FXObject.h>
+#include <FXFile.h>
+#include <FXPath.h>
+#include <FXAtomic.h>
+#include <bgmlib/bgmlib.h>
+#include <bgmlib/libvorbis.h>
+#include <bgmlib/bufpool.h>
+#include <bgmlib/ui.h>
+#include "extract.h"
+#include "stream.h"
+#include "httpd.h"
+
+static const FXint MaxHeader = 0x2000;	// Maximum size of a request header
+
+// Connection
+// ----------
+HTTPConn::HTTPConn(const FXival& _Sock)
+{
+	Sock = _Sock;
+	Chunked = false;
+	access = ReadWrite;
+}
+
+FXbool HTTPConn::isOpen() const
+{
+	return Sock != (FXival)INVALID_SOCKET;
+}
+
+FXival HTTPConn::readBlock(void* Data, FXival Count)
+{
+	if(!isOpen())	return -1;
+	return recv((SOCKET)Sock, (char*)Data, (int)Count, 0);
+}
+
+FXival HTTPConn::Send(const void* Data, const FXival& Len)
+{
+	const char* Cur = (const char*)Data;
+	FXival Rem = Len;
+	int Ret;
+
+	while(Rem > 0)
+	{
+		if(!isOpen())	return -1;
+		Ret = send((SOCKET)Sock, Cur, (int)Rem, MSG_NOSIGNAL);
+		if(Ret <= 0)
+		{
+			// Client went away
+			close();
+			return -1;
+		}
+		Cur += Ret;
+		Rem -= Ret;
+	}
+	return Len;
+}
+
+FXival HTTPConn::writeBlock(const void* Data, FXival Count)
+{
+	FXString Size;
+
+	if(Count <= 0)	return 0;	// An empty chunk would end the response
+	if(Chunked)
+	{
+		Size.format("%lx\r\n", (unsigned long)Count);
+		if(Send(Size.text(), Size.length()) < 0)	return -1;
+	}
+	if(Send(Data, Count) < 0)	return -1;
+	if(Chunked && Send("\r\n", 2) < 0)	return -1;
+	return Count;
+}
+
+bool HTTPConn::WriteString(const FXString& Str)
+{
+	return Send(Str.text(), Str.length()) >= 0;
+}
+
+bool HTTPConn::Finish()
+{
+	if(!Chunked)	return isOpen();
+	Chunked = false;
+	return Send("0\r\n\r\n", 5) >= 0;
+}
+
+void HTTPConn::Shutdown()
+{
+	if(isOpen())	shutdown((SOCKET)Sock, SD_BOTH);
+}
+
+FXbool HTTPConn::close()
+{
+	if(!isOpen())	return false;
+	closesocket((SOCKET)Sock);
+	Sock = (FXival)INVALID_SOCKET;
+	return true;
+}
+
+HTTPConn::~HTTPConn()
+{
+	close();
+}
+// ----------
+
+// Only games the user already opened in this session have their track and silence data
+static bool GameReady(GameInfo* GI)
+{
+	return !GI->Path.empty() && GI->HaveTrackData && GI->Scanned;
+}
+
+static GameInfo* FindGame(const FXString& GameNum)
+{
+	ListEntry<GameInfo>* Cur = BGMLib::Game.First();
+	while(Cur)
+	{
+		if(GameReady(&Cur->Data) && Cur->Data.GameNum == GameNum)	return &Cur->Data;
+		Cur = Cur->Next();
+	}
+	return NULL;
+}
+
+static TrackInfo* FindTrack(GameInfo* GI, const FXuint& Number)
+{
+	ListEntry<TrackInfo>* Cur = GI->Track.First();
+	while(Cur)
+	{
+		TrackInfo* TI = &Cur->Data;
+		if(TI->Number == Number && TI->Number <= GI->TrackCount)	return TI;
+		Cur = Cur->Next();
+	}
+	return NULL;
+}
+
+// Client
+// ------
+HTTPClient::HTTPClient(const FXival& Sock) : Conn(Sock)
+{
+	HTTP11 = false;
+	StopReq = false;
+	Done = 0;
+}
+
+bool HTTPClient::ReadRequest()
+{
+	char Buf[1024];
+	FXString Req, Line, Target;
+	FXival Ret;
+	FXint End, Pos, Next;
+
+	while((End = Req.find("\r\n\r\n")) < 0)
+	{
+		if(Req.length() >= MaxHeader)	return false;
+		Ret = Conn.readBlock(Buf, sizeof(Buf));
+		if(Ret <= 0)	return false;
+		Req.append(Buf, (FXint)Ret);
+	}
+
+	// Request line
+	Next = Req.find("\r\n");
+	Line = Req.left(Next);
+	Method = Line.section(' ', 0);
+	Target = Line.section(' ', 1);
+	HTTP11 = Line.section(' ', 2) == "HTTP/1.1";
+
+	Path = Target.before('?');
+	Query = Target.after('?');
+
+	// Only the Host header is interesting, for building playlist URLs
+	for(Pos = Next + 2; Pos < End; Pos = Next + 2)
+	{
+		Next = Req.find("\r\n", Pos);
+		Line = Req.mid(Pos, Next - Pos);
+		if(comparecase(Line.left(5), "Host:") == 0)
+		{
+			Host = Line.mid(5, Line.length() - 5);
+			Host.trim();
+		}
+	}
+	return !Method.empty() && !Path.empty();
+}
+
+FXString HTTPClient::Param(const FXString& Key)
+{
+	FXString Cur;
+	FXint Count = Query.contains('&') + 1;
+
+	for(FXint c = 0; c < Count; c++)
+	{
+		Cur = Query.section('&', c);
+		if(Cur.before('=') == Key)	return Cur.after('=');
+	}
+	return FXString::null;
+}
+
+bool HTTPClient::Respond(const FXString& Status, const FXString& Type, const FXString& Body)
+{
+	FXString Str;
+
+	Str.format("HTTP/1.%d %s\r\nContent-Type: %s\r\nContent-Length: %d\r\nConnection: close\r\n\r\n",
+		HTTP11, Status.text(), Type.text(), Body.length());
+	return Conn.WriteString(Str) && Conn.WriteString(Body);
+}
+
+bool HTTPClient::Header(const FXString& Type)
+{
+	FXString Str;
+
+	// HTTP/1.0 clients just read until we close the connection
+	Str.format("HTTP/1.%d 200 OK\r\nContent-Type: %s\r\n%sConnection: close\r\n\r\n",
+		HTTP11, Type.text(), HTTP11 ? "Transfer-Encoding: chunked\r\n" : "");
+	if(!Conn.WriteString(Str))	return false;
+	Conn.Chunked = HTTP11;
+	return true;
+}
+
+void HTTPClient::Playlist()
+{
+	FXString Body = "#EXTM3U\r\n", Str, Addr = Host;
+	ListEntry<GameInfo>* CurGame = BGMLib::Game.First();
+
+	if(Addr.empty())	Addr.format("127.0.0.1:%u", HTTPServer::Inst().Port);
+
+	while(CurGame)
+	{
+		GameInfo* GI = &CurGame->Data;
+		ListEntry<TrackInfo>* CurTrack = GameReady(GI) ? GI->Track.First() : NULL;
+		while(CurTrack)
+		{
+			TrackInfo* TI = &CurTrack->Data;
+			if(TI->Number <= GI->TrackCount)
+			{
+				Str.format("#EXTINF:%u,%s - %s\r\nhttp://%s/%s/%u.ogg\r\n",
+					(FXuint)(TI->GetByteLength(Set.Sil, Set.Loops, Set.Fade) / 4 / TI->Freq),
+					GI->Name[Set.Lang].text(), TI->Name[Set.Lang].text(), Addr.text(), GI->GameNum.text(), TI->Number);
+				Body += Str;
+			}
+			CurTrack = CurTrack->Next();
+		}
+		CurGame = CurGame->Next();
+	}
+	Respond("200 OK", "audio/x-mpegurl", Body);
+}
+
+// PlayFile::Close() only clears Vorbis files it opened from disk
+static void CloseTrack(PlayFile& P, const bool& Mem)
+{
+	if(Mem)	ov_clear(&P.SF);
+	P.Close();
+}
+
+bool HTTPClient::StreamTrack(GameInfo* GI, TrackInfo* TI, const bool& Ogg)
+{
+	Extractor& Ext = Extractor::Inst();
+	PlayFile P;
+	VFile Dec;	// Decrypted Vorbis tracks
+	bool Mem = false;	// <P.SF> reads from <Dec>
+	volatile FXulong Prog = 0;	// Keeps DecryptFile() away from the progress bar
+	OggVorbis_EncState ES;
+	vorbis_comment VC;
+	FadeAlg* FA;
+	FXString Str;
+	char WAVHeader[WAV_HEADER_SIZE];
+	char* Buf;
+	bool Sil = Set.Sil;
+
+	ushort Loops = Set.Loops;
+	float Fade = Set.Fade;
+	float Quality = 5.0f;
+
+	ulong Len, Sent, Read, S, L, E;
+	long FadeStart, FadeBytes;
+	long c = 0;	// Fade progression
+	short* f;
+
+	Str = Param("loops");
+	if(!Str.empty())	Loops = (ushort)MIN(MAX(Str.toUInt(), 1), (FXuint)HTTPServer::MaxLoops);
+	Str = Param("fade");
+	if(!Str.empty())	Fade = MIN(MAX(Str.toFloat(), 0.0f), (float)HTTPServer::MaxFade);	// also catches NaN
+	Str = Param("q");
+	if(!Str.empty())	Quality = MIN(MAX(Str.toFloat(), -1.0f), 10.0f);
+
+	// Open the source. Encrypted tracks are decrypted into memory, nothing goes to disk.
+	if(GI->Vorbis)
+	{
+		if(GI->CryptKind)
+		{
+			if(!DecryptBGM(GI, TI, Dec, &Prog))	return Respond("500 Internal Server Error", "text/plain", "Couldn't decrypt the track.\r\n");
+			if(ov_open_callbacks(&Dec, &P.SF, NULL, 0, OV_CALLBACKS_VFILE))	return Respond("500 Internal Server Error", "text/plain", "Couldn't open the track.\r\n");
+			Mem = true;
+		}
+		else if(!OpenVorbisBGM(P.File, P.SF, GI, TI))	return Respond("500 Internal Server Error", "text/plain", "Couldn't open the track.\r\n");
+	}
+	else
+	{
+		if(!GI->OpenBGMFile(P.File, TI))	return Respond("500 Internal Server Error", "text/plain", "Couldn't open the track.\r\n");
+		P.File.position(TI->GetStart(FMT_BYTE, Sil));
+	}
+
+	// Same lengths as the extractor would write
+	Len = TI->GetByteLength(Sil, Loops, Fade) & ~3;
+	TI->GetPos(FMT_BYTE, Sil, &S, &L, &E);
+	FadeBytes = (long)(Fade * TI->Freq * 4.0f) & ~3;
+	if((L == E) || (L == 0))	FadeBytes = 0;
+	FadeBytes = MIN(FadeBytes, (long)Len);
+	FadeStart = Len - FadeBytes;
+	FA = Ext.FAs.Get(MIN(Set.FadeAlg, Ext.FAs.Size() - 1))->Data;
+
+	if(Ogg)
+	{
+		if(!ES.setup(&Conn, TI->Freq, Quality / 10.0f))
+		{
+			CloseTrack(P, Mem);
+			return Respond("500 Internal Server Error", "text/plain", "Couldn't set up the encoder.\r\n");
+		}
+		if(!Header("application/ogg"))	{CloseTrack(P, Mem);	return false;}
+
+		ogg_stream_init(&ES.stream_out, rand());
+		vorbis_comment_init(&VC);
+		vorbis_comment_add_tag(&VC, "TITLE", TI->Name[Set.Lang].text());
+		vorbis_comment_add_tag(&VC, "ALBUM", GI->Name[Set.Lang].text());
+		vorbis_comment_add_tag(&VC, "TRACKNUMBER", TI->GetNumber().text());
+		ES.write_headers(&VC);
+		vorbis_comment_clear(&VC);
+	}
+	else
+	{
+		if(!Header("audio/wav"))	{CloseTrack(P, Mem);	return false;}
+		makeheader(WAVHeader, Len, TI->Freq);
+		Conn.writeBlock(WAVHeader, WAV_HEADER_SIZE);
+	}
+
+	Buf = BufPool::Inst().Get(OV_BLOCK);
+	for(Sent = 0; Buf && (Sent < Len) && !StopReq && Conn.isOpen(); Sent += Read)
+	{
+		Read = MIN((ulong)OV_BLOCK, Len - Sent);
+
+		// Bit-exact loops, thanks to the splice
+		if(GI->Vorbis)	ov_read_bgm(&P.SF, Buf, Read, TI, &P.Splice);
+		else			pcm_read_bgm(P.File, Buf, Read, TI, &P.Splice);
+
+		if((long)(Sent + Read) > FadeStart)
+		{
+			f = (short*)&Buf[MAX(FadeStart - (long)Sent, 0L)];
+			FA->Fade(f, c, (long)(Sent + Read) - FadeStart, FadeBytes);
+		}
+
+		if(Ogg)	ES.encode_pcm(Buf, Read);
+		else	Conn.writeBlock(Buf, Read);
+	}
+	POOL_RELEASE(Buf);
+
+	if(Ogg)
+	{
+		// Finalize
+		if(Sent >= Len && Conn.isOpen())	ES.encode_pcm(NULL, 0);
+		ogg_stream_clear(&ES.stream_out);
+	}
+	CloseTrack(P, Mem);
+	return (Sent >= Len) && Conn.Finish();
+}
+
+FXint HTTPClient::run()
+{
+	GameInfo* GI;
+	TrackInfo* TI;
+	FXString File, Ext;
+
+	if(ReadRequest())
+	{
+		HTTPServer& Srv = HTTPServer::Inst();
+
+		Set = Srv.Settings();
+		Srv.ReadLockGames();
+
+		File = Path.section('/', 2);
+		Ext = FXPath::extension(File).lower();
+
+		if(Method != "GET")	Respond("405 Method Not Allowed", "text/plain", "Only GET is supported.\r\n");
+		else if(Path == "/")	Playlist();
+		else if(!(GI = FindGame(Path.section('/', 1))))	Respond("404 Not Found", "text/plain", "No such game, or it hasn't been loaded yet.\r\n");
+		else if(!(TI = FindTrack(GI, FXPath::title(File).toUInt())))	Respond("404 Not Found", "text/plain", "No such track.\r\n");
+		else if(Ext != "wav" && Ext != "ogg")	Respond("404 Not Found", "text/plain", "Only .wav and .ogg are available.\r\n");
+		else	StreamTrack(GI, TI, Ext == "ogg");
+
+		Srv.ReadUnlockGames();
+	}
+	Conn.close();
+	atomicSet(&Done, 1);
+	return 1;
+}
+
+void HTTPClient::Stop()
+{
+	StopReq = true;
+	Conn.Shutdown();
+}
+// ------
+
+// Server
+// ------
+HTTPServer::HTTPServer()
+{
+	Listen = (FXival)INVALID_SOCKET;
+	Port = 0;
+	Started = false;
+	StopReq = false;
+}
+
+bool HTTPServer::Init(const ushort& NewPort, const bool& LAN)
+{
+	sockaddr_in Addr;
+	SOCKET S;
+	int Yes = 1;
+	FXString Str;
+
+	if(!NewPort || running())	return false;
+
+#ifdef WIN32
+	WSADATA WSA;
+	if(WSAStartup(MAKEWORD(2, 2), &WSA))	return false;
+#endif
+	Started = true;
+
+	S = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if(S == INVALID_SOCKET)	return false;
+	setsockopt(S, SOL_SOCKET, SO_REUSEADDR, (const char*)&Yes, sizeof(Yes));
+
+	memset(&Addr, 0, sizeof(Addr));
+	Addr.sin_family = AF_INET;
+	Addr.sin_port = htons(NewPort);
+	Addr.sin_addr.s_addr = htonl(LAN ? INADDR_ANY : INADDR_LOOPBACK);
+
+	if(bind(S, (sockaddr*)&Addr, sizeof(Addr)) || listen(S, MaxClients))
+	{
+		closesocket(S);
+		Str.format("HTTP server: Couldn't listen on port %u!\n", NewPort);
+		BGMLib::UI_Stat(Str);
+		return false;
+	}
+	Listen = (FXival)S;
+	Port = NewPort;
+	StopReq = false;
+	start();
+
+	Str.format("HTTP server listening on %s port %u.\n", LAN ? "all interfaces," : "localhost,", Port);
+	BGMLib::UI_Stat(Str);
+	return true;
+}
+
+#if defined(_DEBUG) || defined(PROFILING_LIBS)
+FXString HTTPServer::Request(const char* Req)
+{
+	sockaddr_in Addr;
+	SOCKET S;
+	char Buf[1024];
+	int Ret;
+	FXString Resp;
+
+	S = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if(S == INVALID_SOCKET)	return Resp;
+
+	memset(&Addr, 0, sizeof(Addr));
+	Addr.sin_family = AF_INET;
+	Addr.sin_port = htons(Port);
+	Addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	if(!connect(S, (sockaddr*)&Addr, sizeof(Addr)))
+	{
+		send(S, Req, (int)strlen(Req), MSG_NOSIGNAL);
+		while((Ret = recv(S, Buf, sizeof(Buf), 0)) > 0)	Resp.append(Buf, Ret);
+	}
+	closesocket(S);
+	return Resp;
+}
+#endif
+
+void HTTPServer::Publish()
+{
+	FXMutexLock L(Lock);
+	Set.Loops = LoopCnt;
+	Set.Fade = FadeDur;
+	Set.Sil = SilResolve();
+	Set.FadeAlg = FadeAlgID;
+	Set.Lang = Lang;
+}
+
+HTTPSettings HTTPServer::Settings()
+{
+	FXMutexLock L(Lock);
+	return Set;
+}
+
+void HTTPServer::LockGames()
+{
+	{
+		// Running streams would hold the read lock for minutes
+		FXMutexLock L(Lock);
+		ListEntry<HTTPClient*>* Cur = Clients.First();
+		while(Cur)
+		{
+			Cur->Data->Stop();
+			Cur = Cur->Next();
+		}
+	}
+	GameLock.writeLock();
+}
+
+void HTTPServer::UnlockGames()
+{
+	GameLock.writeUnlock();
+}
+
+void HTTPServer::Reap(const bool& Wait)
+{
+	ListEntry<HTTPClient*>* Cur = Clients.First();
+	while(Cur)
+	{
+		ListEntry<HTTPClient*>* Next = Cur->Next();
+		HTTPClient* C = Cur->Data;
+		if(Wait)	C->Stop();
+		if(Wait || C->Done)
+		{
+			C->join();
+			SAFE_DELETE(C);
+			Clients.Delete(Cur);
+		}
+		Cur = Next;
+	}
+}
+
+FXint HTTPServer::run()
+{
+	SOCKET S;
+	HTTPClient* New;
+
+	while(!StopReq)
+	{
+		S = accept((SOCKET)Listen, NULL, NULL);
+		if(S == INVALID_SOCKET)
+		{
+			if(!StopReq)	sleep(TIMEOUT);
+			continue;
+		}
+
+		FXMutexLock L(Lock);
+		Reap();
+		if(Clients.Size() >= MaxClients)
+		{
+			HTTPConn Busy((FXival)S);
+			Busy.WriteString("HTTP/1.0 503 Service Unavailable\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+			continue;
+		}
+		New = new HTTPClient((FXival)S);
+		Clients.Add(&New);
+		New->start();
+	}
+	return 1;
+}
+
+void HTTPServer::Exit()
+{
+	if(Listen != (FXival)INVALID_SOCKET)
+	{
+		StopReq = true;
+
+		// Wakes up accept()
+		shutdown((SOCKET)Listen, SD_BOTH);
+		closesocket((SOCKET)Listen);
+		join();
+		Listen = (FXival)INVALID_SOCKET;
+	}
+	// Clients only ever take <Lock> for Settings(), and the server thread is gone
+	Reap(true);
+
+#ifdef WIN32
+	if(Started)	WSACleanup();
+#endif
+	Started = false;
+}
+// ------
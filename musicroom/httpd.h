@@ -0,0 +1,132 @@
+// Music Room Interface
+// --------------------
+// httpd.h - Local HTTP streaming server
+// --------------------
+// "" Nmlgc, 2011
+
+#ifndef MUSICROOM_HTTPD_H
+#define MUSICROOM_HTTPD_H
+
+#include <FXIO.h>
+#include <FXThread.h>
+
+// Client socket. With <Chunked> set, every block written goes out as one HTTP/1.1 chunk.
+class HTTPConn : public FXIO
+{
+protected:
+	FXival	Sock;	// SOCKET on Windows, file descriptor elsewhere
+
+	FXival	Send(const void* Data, const FXival& Len);	// Raw write, blocks until everything is sent
+
+public:
+	bool	Chunked;
+
+	HTTPConn(const FXival& Sock);
+
+	virtual FXbool isOpen() const;
+	virtual FXival readBlock(void* Data, FXival Count);
+	virtual FXival writeBlock(const void* Data, FXival Count);
+	virtual FXbool close();
+
+	bool	WriteString(const FXString& Str);	// Ignores <Chunked>, for the response header
+	bool	Finish();	// Terminates a chunked response
+	void	Shutdown();	// Makes every blocking call on the socket return. Can be called from any thread.
+
+	virtual ~HTTPConn();
+};
+
+// Copy of the global settings the clients need, made on the GUI thread
+struct HTTPSettings
+{
+	ushort	Loops;
+	float	Fade;
+	bool	Sil;	// SilResolve()
+	ushort	FadeAlg;
+	ushort	Lang;
+};
+
+// One client connection, served in its own thread
+class HTTPClient : public FXThread
+{
+protected:
+	HTTPConn	Conn;
+
+	// Request
+	FXString	Method;
+	FXString	Path;
+	FXString	Query;
+	FXString	Host;
+	bool	HTTP11;	// Client understands chunked responses
+
+	HTTPSettings	Set;	// Taken at the start of the request
+
+	bool	ReadRequest();
+	FXString	Param(const FXString& Key);	// Query parameter value, empty if not given
+
+	bool	Respond(const FXString& Status, const FXString& Type, const FXString& Body);
+	bool	Header(const FXString& Type);	// Sends "200 OK" for a streamed body of [Type]
+
+	void	Playlist();	// Serves an M3U of every track we can stream
+	bool	StreamTrack(GameInfo* GI, TrackInfo* TI, const bool& Ogg);
+
+public:
+	volatile bool	StopReq;
+	volatile FXint	Done;
+
+	HTTPClient(const FXival& Sock);
+
+	virtual FXint run();
+	void Stop();	// Aborts the connection. Join afterwards.
+};
+
+// Streams loop-expanded tracks of every loaded game to other players, as WAV or Ogg, decoded and encoded on the fly.
+//	GET /					M3U playlist of all tracks
+//	GET /<game>/<track>.wav	WAV stream of that track
+//	GET /<game>/<track>.ogg	Ogg Vorbis stream of that track
+// Parameters: loops=<loop count>, fade=<fade duration in seconds>, q=<Vorbis quality>
+//
+// Clients hold a read lock on <GameLock> for their whole request.
+// The GUI thread has to call LockGames() and UnlockGames() around everything that changes the game list or game data.
+class HTTPServer : public FXThread
+{
+protected:
+	FXival	Listen;	// Listening socket
+	FXMutex	Lock;	// Guards <Clients> and <Set>
+	List<HTTPClient*>	Clients;
+	HTTPSettings	Set;
+	FXReadWriteLock	GameLock;
+	bool	Started;
+
+	volatile bool	StopReq;
+
+	void	Reap(const bool& Wait = false);	// Deletes finished clients. With [Wait], stops and deletes all of them.
+
+	HTTPServer();
+
+public:
+	static const int MaxClients = 8;
+	static const ushort MaxLoops = 10;	// Same ranges as the main window
+	static const int MaxFade = 60;
+
+	ushort	Port;
+
+	bool	Init(const ushort& Port, const bool& LAN);	// [LAN]: Accept connections from other machines, not just localhost
+	virtual FXint run();
+	void	Exit();
+
+	void	Publish();	// GUI thread: hands the current settings to new requests
+	HTTPSettings	Settings();
+
+	void	LockGames();	// GUI thread: aborts running streams and blocks new requests until UnlockGames()
+	void	UnlockGames();
+	void	ReadLockGames()	{GameLock.readLock();}
+	void	ReadUnlockGames()	{GameLock.readUnlock();}
+
+#if defined(_DEBUG) || defined(PROFILING_LIBS)
+	FXString	Request(const char* Req);	// Sends [Req] to ourselves over the loopback interface and returns the complete response
+#endif
+
+	SINGLETON(HTTPServer);
+};
+
+#endif /* MUSICROOM_HTTPD_H */
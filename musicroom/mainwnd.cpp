@@ -11,6 +11,7 @@
 #include "parse.h"
 #include <bgmlib/config.h>
 #include <bgmlib/packmethod.h>
+#include <bgmlib/libvorbis.h>
 #include <bgmlib/bgmlib.h>
 #include <bgmlib/ui.h>
 #include <th_tool_shared/utils.h>
@@ -20,6 +21,7 @@
 #include "extract.h"
 #include "tagger.h"
 #include "scan.h"
+#include "httpd.h"
 #include <tchar.h>
 
 extern MainWnd* MWBack;
@@ -42,9 +44,14 @@ FXDEFMAP(MainWnd) MMMainWnd[] =
 	FXMAPFUNC(SEL_COMMAND, MainWnd::MW_UPDATE_LENGTHS, MainWnd::onCmdLengths),
 	FXMAPFUNC(SEL_CHANGED, MainWnd::MW_UPDATE_LENGTHS, MainWnd::onCmdLengths),
 	FXMAPFUNC(SEL_CHANGED, MainWnd::MW_CHANGE_TRACK, MainWnd::onChangeTrack),
+	FXMAPFUNC(SEL_MOTION, MainWnd::MW_CHANGE_TRACK, MainWnd::onHoverTrack),
 	FXMAPFUNC(SEL_TIMEOUT, MainWnd::MW_PROG_REDRAW, MainWnd::onProgRedraw),
 	FXMAPFUNC(SEL_COMMAND, MainWnd::MW_TOGGLE_PLAY, MainWnd::onTogglePlay),
 	FXMAPFUNC(SEL_TIMEOUT, MainWnd::MW_PLAY_STAT, MainWnd::onPlayStat),
+	FXMAPFUNC(SEL_COMMAND, MainWnd::MW_VOLUME, MainWnd::onVolume),
+	FXMAPFUNC(SEL_CHANGED, MainWnd::MW_VOLUME, MainWnd::onVolume),
+	FXMAPFUNC(SEL_COMMAND, MainWnd::MW_SEEK, MainWnd::onSeek),
+	FXMAPFUNC(SEL_CHANGED, MainWnd::MW_SEEK, MainWnd::onSeek),
 	FXMAPFUNC(SEL_CHANGED, MainWnd::MW_FN_PATTERN, MainWnd::onFNPattern),
 	FXMAPFUNCS(SEL_COMMAND, MainWnd::MW_UPDATE_ENC, MainWnd::MW_UPDATE_ENC_END, MainWnd::onUpdEnc),
 	FXMAPFUNC(SEL_COMMAND, MainWnd::MW_ENC_SETTINGS, MainWnd::onEncSettings),
@@ -92,6 +99,7 @@ MainWnd::MainWnd(FXApp* App, FXIcon* Ico)
 	EncBtn = NULL;
 	CFGFail = false;
 	Lock = false;
+	Seeking = false;
 	Monospace = new FXFont(getApp(), "Courier New", 8);
 
 	Main = new FXVerticalFrame(this, LAYOUT_FILL);
@@ -124,7 +132,7 @@ MainWnd::MainWnd(FXApp* App, FXIcon* Ico)
 	new FXLabel(LabelFrame, L"Ʈ ", NULL, LABEL_NORMAL | LAYOUT_LEFT);
 
 #ifdef _WIN32
-		VolDT.connect(Volume);
+		VolDT.connect(Volume, this, MW_VOLUME);
 		TrackVol = new FXSlider(LabelFrame, &VolDT, FXDataTarget::ID_VALUE, SLIDER_NORMAL | SLIDER_HORIZONTAL | SLIDER_ARROW_DOWN | SLIDER_TICKS_BOTTOM | LAYOUT_RIGHT | LAYOUT_FIX_WIDTH, 0, 0, 100);
 		TrackPlay = new FXCheckButton(LabelFrame, L" Ʈ ", this, MW_TOGGLE_PLAY, CHECKBUTTON_NORMAL | LAYOUT_RIGHT, 0, 0, 0, 0, 0, 25);
 
@@ -222,6 +230,8 @@ MainWnd::MainWnd(FXApp* App, FXIcon* Ico)
 			new FXLabel(FadeFrame, "sec", NULL, LABEL_NORMAL | LAYOUT_CENTER_Y);
 
 		AlgDT.connect(FadeAlgID);
+		AlgDT.setTarget(this);	// The streaming server wants to know
+		AlgDT.setSelector(MW_UPDATE_LENGTHS);
 
 			new FXLabel(ParamFrame, L"̵ : ", NULL, LABEL_NORMAL | LAYOUT_RIGHT | LAYOUT_CENTER_Y);
 			AlgBox = new FXListBox(ParamFrame, &AlgDT, FXDataTarget::ID_VALUE, FRAME_SUNKEN | FRAME_THICK | LAYOUT_FILL_X);
@@ -266,6 +276,8 @@ MainWnd::MainWnd(FXApp* App, FXIcon* Ico)
 		FXColor Base = getApp()->getBaseColor();
 		PlayStat = new FXStatusLine(StatFrame, NULL, LAYOUT_BOTTOM | LAYOUT_FILL_X);
 		PlayStat->hide();
+		PlaySeek = new FXSlider(StatFrame, this, MW_SEEK, SLIDER_NORMAL | SLIDER_HORIZONTAL | LAYOUT_BOTTOM | LAYOUT_FILL_X);
+		PlaySeek->hide();
 
 	handle(this, FXSEL(SEL_COMMAND, MW_CHANGE_ACTION_STATE), false);
 }
@@ -278,6 +290,8 @@ void MainWnd::create()
 	getApp()->beginWaitCursor();
 
 	StreamerFront::Inst().Init(id());
+	HTTPServer::Inst().Publish();
+	HTTPServer::Inst().Init(HTTPPort, HTTPLAN);
 
 	RemoveSilence->handle(this, FXSEL(SEL_COMMAND, SilResolve() ? ID_CHECK : ID_UNCHECK), (void*)SilResolve());
 	TrackPlay->handle(this, FXSEL(SEL_COMMAND, Play ? ID_CHECK : ID_UNCHECK), (void*)Play);
@@ -401,7 +415,12 @@ void MainWnd::LoadGame(GameInfo* GI)
 	StreamerFront& Str = StreamerFront::Inst();
 	PrevTrackID = -1;
 
-	if(GI && !GI->HaveTrackData)	GI->ParseTrackData();
+	if(GI && !GI->HaveTrackData)
+	{
+		HTTPServer::Inst().LockGames();
+		GI->ParseTrackData();
+		HTTPServer::Inst().UnlockGames();
+	}
 
 	ActiveGame = GI;
 	GameList->setCurrentItem(GameList->findItemByData(ActiveGame), true);
@@ -464,6 +483,7 @@ void MainWnd::LoadGame(GameInfo* GI)
 	}
 
 	handle(FNField, FXSEL(SEL_CHANGED, MW_FN_PATTERN), NULL);
+	HTTPServer::Inst().Publish();	// <RemEnabled> might have changed
 }
 
 void MainWnd::LoadGame(FXString& Path)
@@ -471,10 +491,13 @@ void MainWnd::LoadGame(FXString& Path)
 	StreamerFront& Str = StreamerFront::Inst();
 	if(Play)	Str.Stop();
 	Str.CloseFile();
+	CloseVorbisMaster();
 
+	HTTPServer::Inst().LockGames();
 	ActiveGame = BGMLib::ScanGame(Path);
 	if(!ActiveGame || !ActiveGame->Init(Path))	ActiveGame = NULL;
 	else										PerformScans(ActiveGame);
+	HTTPServer::Inst().UnlockGames();
 	LoadGame(ActiveGame);
 }
 
@@ -514,6 +537,8 @@ long MainWnd::onSwitchGame(FXObject* Sender, FXSelector Message, void* ptr)
 
 		if(!New->Path.empty())
 		{
+			HTTPServer::Inst().LockGames();
+
 			// Verify if the path is still correct
 			if(FXSystem::setCurrentDirectory(New->Path) &&
 				(Verify = New->PM->Scan(New->Path)) &&
@@ -531,6 +556,7 @@ long MainWnd::onSwitchGame(FXObject* Sender, FXSelector Message, void* ptr)
 				New->Path.clear();
 			}
 			FXSystem::setCurrentDirectory(AppPath);
+			HTTPServer::Inst().UnlockGames();
 		}
 	}
 
@@ -604,6 +630,7 @@ long MainWnd::onCmdStrings(FXObject* Sender, FXSelector Message, void* ptr)
 
 	ushort NewLang = (ushort)ptr;
 
+	HTTPServer::Inst().Publish();
 	TranslateGameNames(Stat, NewLang);
 
 	// Update list box game names
@@ -652,6 +679,7 @@ long MainWnd::onCmdLengths(FXObject* Sender, FXSelector Message, void* ptr)
 	LoopCnt = LoopField->getValue();
 	FadeDur = FadeField->getValue();
 	SilRem = RemoveSilence->getCheck() == TRUE;
+	HTTPServer::Inst().Publish();
 
 	if(!ActiveGame || !ActiveGame->Scanned)	return 1;
 
@@ -665,7 +693,7 @@ long MainWnd::onCmdLengths(FXObject* Sender, FXSelector Message, void* ptr)
 			continue;
 		}
 
-		Len = TI->GetByteLength(SilResolve(), LoopCnt, FadeDur);
+		Len = TI->GetByteLength(SilResolve(), ExtLoopCnt(), ExtFadeDur());
 
 		TrackView->setItemText(Row, 2, TI->LengthString(Len));
 
@@ -713,6 +741,18 @@ long MainWnd::onChangeTrack(FXObject* Sender, FXSelector Message, void* ptr)
 	return 1;
 }
 
+long MainWnd::onHoverTrack(FXObject* Sender, FXSelector Message, void* ptr)
+{
+	LCTable* Table = (LCTable*)(Sender);
+	FXint Row = (FXint)(FXival)ptr;
+	TrackInfo* TI = NULL;
+
+	if(Row >= 0 && Table->getItem(Row, 0))	TI = (TrackInfo*)Table->getItem(Row, 0)->getData();
+
+	StreamerFront::Inst().Prefetch(TI);
+	return 1;
+}
+
 long MainWnd::onTogglePlay(FXObject* Sender, FXSelector Message, void* ptr)
 {
 	Play = ptr != 0;
@@ -723,6 +763,25 @@ long MainWnd::onTogglePlay(FXObject* Sender, FXSelector Message, void* ptr)
 	return 1;
 }
 
+long MainWnd::onVolume(FXObject* Sender, FXSelector Message, void* ptr)
+{
+	StreamerFront::Inst().SetVolume();
+	return 1;
+}
+
+long MainWnd::onSeek(FXObject* Sender, FXSelector Message, void* ptr)
+{
+	StreamerFront& Str = StreamerFront::Inst();
+	TrackInfo* TI = Str.CurTrack();
+
+	// Only jump once the slider is released
+	Seeking = (FXSELTYPE(Message) == SEL_CHANGED);
+	if(Seeking || !TI)	return 1;
+
+	Str.Seek((ulong)((FXint)(FXival)ptr * TI->Freq));
+	return 1;
+}
+
 long MainWnd::onPlayStat(FXObject* Sender, FXSelector Message, void* ptr)
 {
 	FXString Stat;
@@ -741,8 +800,18 @@ long MainWnd::onPlayStat(FXObject* Sender, FXSelector Message, void* ptr)
 
 		PlayStat->setNormalText(Stat);
 		if(!Show)	PlayStat->show();
+
+		// Intro, loops and fade, as they'd be extracted
+		Len = TI->GetByteLength(SilResolve(), LoopCnt, FadeDur);
+		PlaySeek->setRange(0, MAX((FXint)(Len / 4 / TI->Freq), 1));
+		if(!Seeking)	PlaySeek->setValue((FXint)(Str.Time() / TI->Freq));
+		if(!Show)	PlaySeek->show();
+	}
+	else if(Show)
+	{
+		PS->hide();
+		PlaySeek->hide();
 	}
-	else if(Show)	PS->hide();
 
 	if(PS->shown() != Show)
 	{
@@ -945,6 +1014,7 @@ FXbool MainWnd::close(FXbool notify)
 	if(!Str.empty())	OutPath = Str;
 
 	onStop(this, FXSEL(SEL_COMMAND, MW_STOP), NULL);
+	HTTPServer::Inst().Exit();
 	StreamerFront::Inst().Exit();
 
 	SAFE_DELETE_ARRAY(EncBtn);
@@ -1020,10 +1090,13 @@ long MainWnd::onThreadMsg(FXObject* Sender, FXSelector Message, void* ptr)
 
 long MainWnd::onThreadStat(FXObject* Sender, FXSelector Message, void* ptr)
 {
-	// Let's be extra safe
-	FXint Len = StatCache.length();
-	PrintStat(StatCache);
-	StatCache.erase(0, Len);
+	FXString Stat;
+	{
+		FXMutexLock Lock(StatLock);
+		Stat = StatCache;
+		StatCache.clear();
+	}
+	if(!Stat.empty())	PrintStat(Stat);
 	return 1;
 }
 
@@ -1051,6 +1124,7 @@ void BGMLib::UI_Stat(const FXString& Msg)
 
 void BGMLib::UI_Stat_Safe(const FXString& Msg)
 {
+	FXMutexLock Lock(MWBack->StatLock);
 	MWBack->StatCache.append(Msg);
 	MWBack->getApp()->addChore(MWBack, FXSEL(SEL_CHORE, MainWnd::MW_THREAD_STAT), NULL);
 }
@@ -70,6 +70,8 @@ protected:
 	FXProgressBar*	ProgBar;
 		FXDataTarget ProgDT;
 	FXStatusLine*	PlayStat;
+	FXSlider*	PlaySeek;	// Playback timeline of the current track, in seconds
+	bool	Seeking;	// <PlaySeek> is being dragged
 
 	bool CheckOutDir();
 
@@ -79,6 +81,7 @@ public:
 	MainWnd(FXApp* App, FXIcon* AppIcon = NULL);
 
 	FXString StatCache;	// PrintStat collector
+	FXMutex	StatLock;	// Guards <StatCache>, extraction workers write to it at the same time
 	FXString Notice;	// Personal appeal cache
 	LCListBox*	GameList;
 
@@ -111,6 +114,8 @@ public:
 		
 		MW_TOGGLE_PLAY,
 		MW_PLAY_STAT,
+		MW_VOLUME,
+		MW_SEEK,
 
 		MW_UPDATE_ENC,
 		MW_UPDATE_ENC_END = MW_UPDATE_ENC + MAX_ENCODERS,
@@ -145,9 +150,12 @@ public:
 	MSG_FUNC(onLoadGame);	// Loads the game in the [ptr] directory
 	MSG_FUNC(onSwitchGame);
 	MSG_FUNC(onChangeTrack);
+	MSG_FUNC(onHoverTrack);	// Prefetches the track under the mouse cursor
 	MSG_FUNC(onProgRedraw);
 	MSG_FUNC(onTogglePlay);
 	MSG_FUNC(onPlayStat);	// Displays playing status tooltip
+	MSG_FUNC(onVolume);	// Forwards volume slider changes to the streamer
+	MSG_FUNC(onSeek);	// Jumps to the released <PlaySeek> position
 	MSG_FUNC(onStream);
 	MSG_FUNC(onUpdEnc);	// Selects a new encoder
 	MSG_FUNC(onEncSettings);	// Shows encoding settings dialog
@@ -8,8 +8,11 @@
 #include <math.h>
 #include <fx.h>
 #include "mainwnd.h"
+#include "selftest.h"
 #include <bgmlib/config.h>
 #include <bgmlib/bgmlib.h>
+#include <bgmlib/libvorbis.h>
+#include <bgmlib/bufpool.h>
 #include <th_tool_shared/utils.h>
 #include <locale.h>
 
@@ -43,6 +46,10 @@ bool SilRem = true;	// Remove opening silence?
 bool RemEnabled = true;
 bool SilResolve() { return SilRem && RemEnabled; }
 int Volume = 100;
+uint StreamBuffer;	// Decode-ahead buffer length in milliseconds
+FXString AudioOut;	// Audio sink selection
+ushort HTTPPort;	// Streaming server port, 0 turns it off
+bool HTTPLAN;	// Streaming server accepts connections from other machines
 // ---
 
 // Game
@@ -61,10 +68,29 @@ FXString WikiURL;
 List<Encoder*> Encoders;
 FXushort EncFmt;
 bool ShowConsole; // Show encoding console during the process
+uint ExtractThreads;	// Number of tracks extracted in parallel, 0 = one per processor
+FXString AlsoEnc;	// Extensions of further encoders to run on the same PCM, comma-separated
 // --------
 
 ushort LoopCnt;	// Song loop count (2 = song gets repeated once)
 float FadeDur;	// Fade duration
+bool LoopMeta;	// Extract intro + one loop and write the loop points, instead of repeating and fading
+
+ushort ExtLoopCnt()	{return LoopMeta ? 1 : LoopCnt;}
+float ExtFadeDur()	{return LoopMeta ? 0.0f : FadeDur;}
+
+bool LoopPoints(TrackInfo* TI, ulong* Start, ulong* Len)
+{
+	ulong S, L, E;
+
+	TI->GetPos(FMT_SAMPLE, SilResolve(), &S, &L, &E);
+	if(L == 0 || L == E)	return false;
+
+	// Same intro length as the PCM pipeline
+	*Start = L - ((TI->FS != 0) ? 0 : S);
+	*Len = E - L;
+	return true;
+}
 FXString AppPath;
 FXString OutPath;	// Output directory
 
@@ -78,8 +104,6 @@ const FXString NoGame = L"(
       FXString CfgFile = "musicroom.cfg";
 	  FXString LGDFile = "gamedirs.cfg";
 const FXString Example = L": ";
-const FXString DumpFile = "extract";
-const FXString DecodeFile = DumpFile + ".raw";
       FXString OggDumpFile = "decode.ogg";
 	  FXString OggPlayFile = "play.ogg";
 const FXString Cmp[LANG_COUNT] = {L"", "Composer", L"۰"};
@@ -130,6 +154,15 @@ int main(int argc, char* argv[])
 	MWBack->show(PLACEMENT_SCREEN);
 
 	if(argc > 1)	MWBack->handle(NULL, FXSEL(SEL_COMMAND, MainWnd::MW_LOAD_GAME), argv[1]);
+#ifdef PROFILING_LIBS
+	// musicroom <game directory> -bench: 5 seconds of every track.
+	// Games are loaded through the main window, so this still needs a display. Without a sound card, set output = null.
+	// Headless Linux boxes can run it under xvfb-run.
+	if(argc > 2 && !strcmp(argv[2], "-bench"))	StreamerFront::Inst().Benchmark(5000000000LL);
+#endif
+#if defined(_DEBUG) || defined(PROFILING_LIBS)
+	if(argc > 2 && !strcmp(argv[2], "-selftest"))	SelfTest();
+#endif
 
 	FXint Ret = App.run();
 
@@ -154,6 +187,8 @@ int main(int argc, char* argv[])
 
 	MW->Clear();
 
+	CloseVorbisMaster();
+	BufPool::Inst().Trim();
 	BGMLib::Clear();
 
 	SAFE_DELETE(AppIcon);
@@ -67,7 +67,11 @@ public:
 
 	TrackInfo*	CurTrack();
 	ulong	Pos();
+	ulong	Time();	// Play cursor on the looped playback timeline of the current track, in samples
 	void RequestTrackSwitch(TrackInfo* NewTrack);
+	void Seek(const ulong& Time);	// Jumps to [Time] samples into the looped playback of the current track
+	void Prefetch(TrackInfo* TI);	// Hints that [TI] might be selected soon
+	void SetVolume();	// Call after changing <Volume>
 
 	void Play();
 	void Stop();	// Waits with returning until thread is done!
@@ -75,6 +79,13 @@ public:
 	void CloseFile();
 	void Exit();
 
+#ifdef PROFILING_LIBS
+	// Plays the first [Dur] ns of every track of <ActiveGame> through the configured sink
+	// and prints decode-ahead margin, underruns and switch latency.
+	// Part of the GUI binary, since that's what loads games and owns the streamer.
+	void Benchmark(const FXTime& Dur);
+#endif
+
 	SINGLETON(StreamerFront);
 };
 
@@ -89,6 +100,10 @@ extern ushort FadeAlgID;	// Fade algorithm
 extern bool SilRem;	// Remove opening silence?
 extern bool RemEnabled; // Remove Silience Button enabled?
 extern int Volume;
+extern uint StreamBuffer;	// Decode-ahead buffer length in milliseconds
+extern FXString AudioOut;	// Audio sink selection: empty for the sound card, "null", or a .wav file to record into
+extern ushort HTTPPort;	// Streaming server port, 0 turns it off
+extern bool HTTPLAN;	// Streaming server accepts connections from other machines, not just localhost
 extern FXFont*	Monospace;
 extern bool SilResolve();
 // ---
@@ -109,10 +124,20 @@ extern FXString WikiURL;
 extern List<Encoder*> Encoders;
 extern FXushort EncFmt;
 extern bool ShowConsole; // Show encoding console during the process
+extern uint ExtractThreads;	// Number of tracks extracted in parallel, 0 = one per processor
+extern FXString AlsoEnc;	// Extensions of further encoders to run on the same PCM, comma-separated
 // --------
 
 extern ushort LoopCnt;	// Song loop count (2 = song gets repeated once)
 extern float FadeDur;	// Fade duration
+extern bool LoopMeta;	// Extract intro + one loop and write the loop points, instead of repeating and fading
+
+// Loop count and fade duration actually used for extraction
+extern ushort ExtLoopCnt();
+extern float ExtFadeDur();
+
+// Gets the loop of [TI] in samples, relative to the start of the extracted file. Returns false if [TI] doesn't loop.
+extern bool LoopPoints(TrackInfo* TI, ulong* Start, ulong* Len);
 extern FXString AppPath;
 extern FXString OutPath;	// Output directory
 // =======
@@ -124,8 +149,6 @@ extern const FXString NoGame;
 extern       FXString CfgFile;
 extern       FXString LGDFile;
 extern const FXString Example;
-extern const FXString DumpFile;
-extern const FXString DecodeFile;
 extern       FXString OggDumpFile;
 extern       FXString OggPlayFile;
 extern const FXString Cmp[LANG_COUNT];
@@ -13,6 +13,7 @@
 #include <FXPath.h>
 #include "enc_custom.h"
 #include "enc_vorbis.h"
+#include "enc_wav.h"
 #include "pm.h"
 #include "parse.h"
 
@@ -122,7 +123,7 @@ FXString PatternFN(TrackInfo* Track)
 	if(EncFmt > 0)
 	{
 		FN.append(".");
-		FN.append(Encoders.Get(EncFmt - 1)->Data->Ext.lower());
+		FN.append(FXString(Encoders.Get(EncFmt - 1)->Data->Ext).lower());
 	}
 
 	return FN;
@@ -158,11 +159,19 @@ bool ReadConfig(ConfigFile* Cfg)
 
 	Default->LinkValue("play", TYPE_BOOL, &Play);
 	Default->LinkValue("showconsole", TYPE_BOOL, &ShowConsole);
+	Default->LinkValue("extractthreads", TYPE_UINT, &ExtractThreads);
+	Default->LinkValue("alsoenc", TYPE_STRING, &AlsoEnc);
 	Default->LinkValue("removesilence", TYPE_BOOL, &SilRem);
 	Default->LinkValue("fadealg", TYPE_USHORT, &FadeAlgID);
 	Default->LinkValue("loop", TYPE_USHORT, &LoopCnt);
 	Default->LinkValue("fade", TYPE_FLOAT, &FadeDur);
+	Default->LinkValue("loopmeta", TYPE_BOOL, &LoopMeta);
 	Default->LinkValue("volume", TYPE_INT, &Volume);
+	Default->LinkValue("streambuffer", TYPE_UINT, &StreamBuffer);
+	if(!StreamBuffer)	StreamBuffer = 500;
+	Default->LinkValue("output", TYPE_STRING, &AudioOut);
+	Default->LinkValue("httpport", TYPE_USHORT, &HTTPPort);
+	Default->LinkValue("httplan", TYPE_BOOL, &HTTPLAN);
 	Default->LinkValue("enc", TYPE_USHORT, &EncFmt);
 	Default->LinkValue("pattern", TYPE_STRING, &FNPattern);
 	Default->LinkValue("outpath", TYPE_STRING, &OutPath);
@@ -190,6 +199,15 @@ bool ReadConfig(ConfigFile* Cfg)
 		New->Data = new Encoder_Custom;
 		New->Data->ReadConfig(CurEnc);
 	}
+
+	// Appended last, to keep the indices of the encoders above stable
+	if(CurEnc = Cfg->FindSection("enc_wav"))
+	{
+		New = Encoders.Add();
+
+		New->Data = new Encoder_WAV;
+		New->Data->ReadConfig(CurEnc);
+	}
 	return true;
 }
 
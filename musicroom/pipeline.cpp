@@ -0,0 +1,399 @@
+// Music Room Interface
+// --------------------
+// pipeline.cpp - Streaming extraction pipeline
+// --------------------
+// "" Nmlgc, 2011
+
+#include "musicroom.h"
+#include <FXHash.h>
+#include <FXStream.h>
+#include <FXObject.h>
+#include <FXFile.h>
+#include <FXThread.h>
+#include <bgmlib/libvorbis.h>
+#include <bgmlib/bufpool.h>
+#include "extract.h"
+#include "pipeline.h"
+
+// Queue
+// -----
+PCMQueue::PCMQueue()
+{
+	Buf = NULL;
+	Size = Head = Fill = 0;
+	Closed = Aborted = false;
+}
+
+bool PCMQueue::Create(const ulong& Bytes)
+{
+	FXMutexLock Lock(M);
+
+	if(Size != Bytes)
+	{
+		POOL_RELEASE(Buf);
+		Buf = BufPool::Inst().Get(Bytes);
+	}
+	Size = Buf ? Bytes : 0;
+	Head = Fill = 0;
+	Closed = Aborted = false;
+	return Buf != NULL;
+}
+
+void PCMQueue::Clear()
+{
+	FXMutexLock Lock(M);
+
+	POOL_RELEASE(Buf);
+	Size = Head = Fill = 0;
+}
+
+bool PCMQueue::Write(const char* Src, ulong Len)
+{
+	FXMutexLock Lock(M);
+	ulong Tail, Copy;
+
+	if(!Buf)	return false;
+	while(Len > 0)
+	{
+		while(Fill == Size && !Aborted)	CanWrite.wait(M);
+		if(Aborted)	return false;
+
+		Tail = (Head + Fill) % Size;
+		Copy = MIN(Len, MIN(Size - Fill, Size - Tail));
+
+		memcpy(Buf + Tail, Src, Copy);
+		Src += Copy;
+		Len -= Copy;
+		Fill += Copy;
+		CanRead.signal();
+	}
+	return true;
+}
+
+void PCMQueue::Close()
+{
+	FXMutexLock Lock(M);
+	Closed = true;
+	CanRead.broadcast();
+}
+
+ulong PCMQueue::Read(char* Dst, const ulong& Len)
+{
+	FXMutexLock Lock(M);
+	ulong Done = 0, Copy;
+
+	while(Done < Len)
+	{
+		while(!Fill && !Closed && !Aborted)	CanRead.wait(M);
+		if(Aborted || !Fill)	break;
+
+		Copy = MIN(Len - Done, MIN(Fill, Size - Head));
+
+		memcpy(Dst + Done, Buf + Head, Copy);
+		Head = (Head + Copy) % Size;
+		Fill -= Copy;
+		Done += Copy;
+		CanWrite.signal();
+	}
+	return Done;
+}
+
+void PCMQueue::Abort()
+{
+	FXMutexLock Lock(M);
+	Aborted = true;
+	CanRead.broadcast();
+	CanWrite.broadcast();
+}
+
+PCMQueue::~PCMQueue()
+{
+	Clear();
+}
+// -----
+
+// Source reader
+// -------------
+PCMSource::PCMSource()
+{
+	GI = NULL;
+	TI = NULL;
+	Len = 0;
+	memset(&VF, 0, sizeof(OggVorbis_File));
+}
+
+bool PCMSource::Open(GameInfo* _GI, TrackInfo* _TI, Extract_Vals& V)
+{
+	Close();
+
+	GI = _GI;
+	Len = V.Len;
+
+	// Same offsets as TrackInfo::GetByteLength()
+	if(V.tl != 0)
+	{
+		Intro = V.tl - ((_TI->FS != 0) ? 0 : V.ts_ext);
+		LoopLen = V.te - V.tl;
+	}
+	else
+	{
+		Intro = Len;
+		LoopLen = 0;
+	}
+
+	if(!GI->Vorbis)
+	{
+		if(!GI->OpenBGMFile(File, _TI))	return false;
+		File.position(V.ts_ext);
+	}
+	else if(GI->CryptKind)
+	{
+		// Decode while the rest is still being decrypted
+		Dec.Start(GI, _TI, &BGM);
+
+		// Wait for the first block...
+		while(BGM.Write < (ulong)(OV_BLOCK * 2) && Dec.running())	FXThread::sleep(2000);
+
+		if(ov_open_callbacks(&BGM, &VF, NULL, 0, OV_CALLBACKS_VFILE))
+		{
+			Dec.join();
+			BGM.Clear();
+			return false;
+		}
+	}
+	else if(!OpenVorbisBGM(File, VF, GI, _TI))	return false;
+
+	TI = _TI;
+	if(!Out.Create())
+	{
+		Close();
+		return false;
+	}
+	start();
+	return true;
+}
+
+FXint PCMSource::run()
+{
+	char* Buf = BufPool::Inst().Get(OV_BLOCK);
+	ulong d = 0;
+	ulong End = LoopLen ? MIN(Intro, Len) : Len;	// End of the current intro or loop pass
+	bool Looping = false;
+	ogg_int64_t LoopSample = 0;
+	FXlong LoopPos = 0;
+	long Read;
+	int Link;
+
+	while(Buf && d < Len)
+	{
+		if(d == End)
+		{
+			// Remember where the loop starts the first time, seek back there every other time
+			if(!Looping)
+			{
+				if(GI->Vorbis)	LoopSample = ov_pcm_tell(&VF);
+				else			LoopPos = File.position();
+				Looping = true;
+			}
+			else if(GI->Vorbis)	ov_pcm_seek(&VF, LoopSample);
+			else				File.position(LoopPos);
+
+			End = MIN(d + LoopLen, Len);
+		}
+		Read = MIN((ulong)OV_BLOCK, End - d);
+
+		if(GI->Vorbis)	Read = ov_read(&VF, Buf, Read, 0, 2, 1, &Link);
+		else			Read = File.readBlock(Buf, Read);
+
+		if(Read == OV_HOLE)	continue;
+		if(Read <= 0)
+		{
+			// Caught up with the decrypter?
+			if(BGM.Buf && Dec.running())
+			{
+				FXThread::sleep(2000);
+				continue;
+			}
+			break;
+		}
+		if(!Out.Write(Buf, Read))	break;
+		d += Read;
+	}
+	POOL_RELEASE(Buf);
+	Out.Close();
+	return 1;
+}
+
+void PCMSource::Close()
+{
+	Out.Abort();
+	join();
+
+	if(TI)
+	{
+		if(GI->Vorbis)
+		{
+			ov_clear(&VF);	// closes [File], if we used it
+			memset(&VF, 0, sizeof(OggVorbis_File));
+		}
+		if(BGM.Buf)
+		{
+			// The decrypter still writes to [BGM]
+			Dec.join();
+			BGM.Clear();
+		}
+	}
+	File.close();
+	Out.Clear();
+	TI = NULL;
+}
+
+PCMSource::~PCMSource()
+{
+	Close();
+}
+// -------------
+
+// Loop expander
+// -------------
+void PCMExpander::Start(PCMQueue* _In, TrackInfo* TI, Extract_Vals& V)
+{
+	In = _In;
+	FA = V.FA;
+
+	Len = V.Len;
+	FadeStart = V.FadeStart;
+	FadeBytes = V.FadeBytes;
+
+	Out.Create();
+	start();
+}
+
+void PCMExpander::Fetch(char* Dst, const ulong& Size)
+{
+	ulong Read = In->Read(Dst, Size);
+	if(Read < Size)	memset(Dst + Read, 0, Size - Read);
+}
+
+bool PCMExpander::Forward(char* Buf, const ulong& Size)
+{
+	long End = (long)(Pos + Size) - FadeStart;
+
+	if(FadeBytes != 0 && End > 0)
+	{
+		short* f = (short*)&Buf[MAX(FadeStart - (long)Pos, 0L)];
+		FA->Fade(f, c, End, FadeBytes);
+	}
+	Pos += Size;
+	return Out.Write(Buf, Size);
+}
+
+FXint PCMExpander::run()
+{
+	char* Buf = BufPool::Inst().Get(OV_BLOCK);
+	ulong Size;
+	bool Ret = Buf != NULL;
+
+	Pos = 0;
+	c = 0;
+
+	while(Ret && Pos < Len)
+	{
+		Size = MIN((ulong)OV_BLOCK, Len - Pos);
+		Fetch(Buf, Size);
+		Ret = Forward(Buf, Size);
+	}
+	POOL_RELEASE(Buf);
+
+	In->Abort();	// We don't need anything else
+	Out.Close();
+	return 1;
+}
+// -------------
+
+// Tee
+// ---
+bool PCMTee::Start(PCMQueue* _In, const ushort& _Count)
+{
+	In = _In;
+	Count = MIN(_Count, MAX_ENCODERS);
+	for(ushort t = 0; t < Count; t++)
+	{
+		if(!Taps[t].Create())	return false;
+	}
+	start();
+	return true;
+}
+
+FXint PCMTee::run()
+{
+	char* Buf = BufPool::Inst().Get(OV_BLOCK);
+	bool Alive[MAX_ENCODERS];
+	ushort t, Left = Count;
+	ulong Read;
+
+	for(t = 0; t < Count; t++)	Alive[t] = true;
+
+	while(Buf && Left && (Read = In->Read(Buf, OV_BLOCK)))
+	{
+		for(t = 0; t < Count; t++)
+		{
+			if(Alive[t] && !Taps[t].Write(Buf, Read))
+			{
+				Alive[t] = false;
+				Left--;
+			}
+		}
+	}
+	POOL_RELEASE(Buf);
+
+	if(!Left)	In->Abort();	// Nobody's listening anymore
+	for(t = 0; t < Count; t++)	Taps[t].Close();
+	return 1;
+}
+
+void PCMTee::Stop()
+{
+	ushort t;
+	for(t = 0; t < MAX_ENCODERS; t++)	Taps[t].Abort();
+	join();
+	for(t = 0; t < MAX_ENCODERS; t++)	Taps[t].Clear();
+}
+// ---
+
+// Pipeline
+// --------
+bool PCMPipeline::Open(GameInfo* GI, TrackInfo* TI, Extract_Vals& V)
+{
+	Stop();
+	return Src.Open(GI, TI, V);
+}
+
+PCMQueue& PCMPipeline::Start(TrackInfo* TI, Extract_Vals& V)
+{
+	Exp.Start(&Src.Out, TI, V);
+	return Exp.Out;
+}
+
+PCMQueue* PCMPipeline::Fan(TrackInfo* TI, Extract_Vals& V, const ushort& Count)
+{
+	Exp.Start(&Src.Out, TI, V);
+	if(!Tee.Start(&Exp.Out, Count))	return NULL;
+	return Tee.Taps;
+}
+
+void PCMPipeline::Stop()
+{
+	Exp.Out.Abort();
+	Src.Out.Abort();
+	Tee.Stop();
+	Exp.join();
+	Src.Close();
+	Exp.Out.Clear();
+}
+
+PCMPipeline::~PCMPipeline()
+{
+	Stop();
+}
+// --------
@@ -0,0 +1,145 @@
+// Music Room Interface
+// --------------------
+// pipeline.h - Streaming extraction pipeline
+// --------------------
+// "" Nmlgc, 2011
+
+#ifndef MUSICROOM_PIPELINE_H
+#define MUSICROOM_PIPELINE_H
+
+#include <FXFile.h>
+#include <FXThread.h>
+
+class FadeAlg;
+struct Extract_Vals;
+
+// Bounded, blocking byte queue between two pipeline stages on different threads
+class PCMQueue
+{
+protected:
+	FXMutex	M;
+	FXCondition	CanRead;	// Signaled after writing and closing
+	FXCondition	CanWrite;	// Signaled after reading
+
+	char*	Buf;
+	ulong	Size;
+	ulong	Head;	// Read position in <Buf>
+	ulong	Fill;	// Bytes waiting to be read
+	bool	Closed;	// Writer is done
+	bool	Aborted;	// Both sides should give up
+
+public:
+	static const ulong DefaultSize = 0x40000;	// 256 KiB, about 1.5 seconds of 44.1 kHz stereo
+
+	PCMQueue();
+	~PCMQueue();
+
+	bool	Create(const ulong& Bytes = DefaultSize);	// Also resets the state
+	void	Clear();
+
+	// Writer side. Blocks until all of [Len] was queued. Returns false if the queue was aborted in the meantime.
+	bool	Write(const char* Src, ulong Len);
+	void	Close();	// End of stream
+
+	// Reader side. Blocks until [Len] bytes were read, or the stream ended. Returns the number of bytes read.
+	ulong	Read(char* Dst, const ulong& Len);
+
+	void	Abort();	// Wakes up and stops both sides. Can be called from any thread.
+};
+
+// Source reader.
+// Delivers the PCM of a track from the extraction start, seeking back to the loop start at every loop end until the track length is reached.
+// That way, nothing longer than a block has to be kept in memory, however long the loop is.
+// Vorbis tracks are decoded on the fly, encrypted ones out of a decrypted copy in memory.
+class PCMSource : public FXThread
+{
+protected:
+	GameInfo*	GI;
+	TrackInfo*	TI;	// NULL if nothing is open
+	ulong	Len;	// Bytes to deliver
+	ulong	Intro;	// Bytes before the loop body
+	ulong	LoopLen;	// Loop body size, 0 if the track doesn't loop
+
+	FXFile	File;
+	OggVorbis_File	VF;
+	VFile	BGM;	// Decrypted Vorbis file
+	Decrypter	Dec;	// Fills <BGM>
+
+	virtual FXint run();
+
+public:
+	PCMQueue	Out;
+
+	PCMSource();
+
+	bool	Open(GameInfo* GI, TrackInfo* TI, Extract_Vals& V);	// Opens [TI] and starts delivering
+	void	Close();	// Stops the thread and closes the file
+
+	~PCMSource();
+};
+
+// Fade stage.
+// Passes the looped PCM through up to the track length, fading out everything after <FadeStart> on the way.
+class PCMExpander : public FXThread
+{
+protected:
+	PCMQueue*	In;
+	FadeAlg*	FA;
+
+	ulong	Len;	// Total output size
+	long	FadeStart;
+	long	FadeBytes;
+
+	ulong	Pos;	// Bytes written to <Out>
+	long	c;	// Fade progression
+
+	void	Fetch(char* Dst, const ulong& Size);	// Reads [Size] bytes from <In>, padding a premature end with silence
+	bool	Forward(char* Buf, const ulong& Size);	// Fades [Buf] where necessary and writes it to <Out>. Returns false if <Out> was aborted.
+
+	virtual FXint run();
+
+public:
+	PCMQueue	Out;
+
+	void	Start(PCMQueue* In, TrackInfo* TI, Extract_Vals& V);
+};
+
+// Broadcasts one PCM stream to several encoders.
+// Taps that are aborted by their reader are simply left out from then on.
+class PCMTee : public FXThread
+{
+protected:
+	PCMQueue*	In;
+	ushort	Count;
+
+	virtual FXint run();
+
+public:
+	PCMQueue	Taps[MAX_ENCODERS];
+
+	bool	Start(PCMQueue* In, const ushort& Count);
+	void	Stop();
+};
+
+// Source reader -> loop expander -> fade -> encoder.
+// The stages before the encoder run on their own threads, the encoder just reads the final PCM from Out().
+class PCMPipeline
+{
+protected:
+	PCMSource	Src;
+	PCMExpander	Exp;
+	PCMTee	Tee;
+
+public:
+	bool	Open(GameInfo* GI, TrackInfo* TI, Extract_Vals& V);	// Starts the source reader
+	PCMQueue&	Start(TrackInfo* TI, Extract_Vals& V);	// Starts the loop expander. Returns the end of the pipeline.
+	PCMQueue*	Fan(TrackInfo* TI, Extract_Vals& V, const ushort& Count);	// Starts the loop expander and broadcasts its output to [Count] queues. Returns the first one.
+
+	PCMQueue&	Out()	{return Exp.Out;}
+
+	void	Stop();	// Aborts and joins all stages
+
+	~PCMPipeline();
+};
+
+#endif /* MUSICROOM_PIPELINE_H */
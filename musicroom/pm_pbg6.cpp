@@ -9,6 +9,7 @@
 #include <bgmlib/packmethod.h>
 #include <bgmlib/config.h>
 #include <bgmlib/utils.h>
+#include <bgmlib/bufpool.h>
 #include "pm.h"
 
 bool PM_PBG6::ParseGameInfo(ConfigFile &NewGame, GameInfo *GI)
@@ -152,19 +153,25 @@ ulong PM_PBG6::DecryptFile(GameInfo* GI, FXFile& In, char* Out, const ulong& Pos
 	ulong r;
 	FXulong t;
 	volatile FXulong& d = p ? *p : t;
+	// Only borrow the progress bar if nobody tracks us and we're on the GUI thread.
+	// Extraction workers, the prefetcher and stream clients all run in their own threads.
+	bool Bar = !p && (Size > THRESHOLD_BYTES) && !FXThread::self();
 	
 	if(!Out)	return false;
-	if(!(Crypt = new char[Size]))	return false;
+	if(!(Crypt = BufPool::Inst().Get(Size)))	return false;
 
-	if(!In.position(Pos))	return false;
-	if(!In.readBlock(Crypt, Size))	return false;
+	if(!In.position(Pos) || !In.readBlock(Crypt, Size))
+	{
+		POOL_RELEASE(Crypt);
+		return false;
+	}
 
-	if(Size > THRESHOLD_BYTES)	MW->ProgConnect(&d, Size);
+	if(Bar)	MW->ProgConnect(&d, Size);
 
 	r = Decrypt(d, Out, Crypt, Size);
-	SAFE_DELETE_ARRAY(Crypt);
+	POOL_RELEASE(Crypt);
 
-	if(Size > THRESHOLD_BYTES)	MW->ProgConnect();
+	if(Bar)	MW->ProgConnect();
 
 	return r;
 }
@@ -0,0 +1,407 @@
+// Music Room Interface
+// --------------------
+// prefetch.cpp - Adjacent track prefetching
+// --------------------
+// "" Nmlgc, 2011
+
+#include "musicroom.h"
+#include <FXFile.h>
+#include <bgmlib/libvorbis.h>
+#include <bgmlib/bufpool.h>
+#include <FXAtomic.h>
+#include "stream.h"
+#include <bgmlib/packmethod.h>
+
+// Files
+// -----
+PlayFile::PlayFile()
+{
+	Track = NULL;
+	FNHash = 0;
+	Sil = false;
+	Buf = NULL;
+	Len = 0;
+	Chunks = 0;
+	memset(&SF, 0, sizeof(OggVorbis_File));
+}
+
+void PlayFile::Close()
+{
+	if(File.isOpen())
+	{
+		ov_clear(&SF);
+		File.close();
+	}
+	if(!TempFN.empty())
+	{
+		FXFile::remove(TempFN);
+		TempFN.clear();
+	}
+	if(Buf)	POOL_RELEASE(Buf);
+	Track = NULL;
+	Len = 0;
+	Chunks = 0;
+	Splice.Reset(NULL);
+}
+// -----
+
+TrackPrefetch::TrackPrefetch()
+{
+	for(ushort s = 0; s < HINT_COUNT; s++)
+	{
+		Want[s] = NULL;
+		Slot[s] = new PlayFile;
+	}
+	Busy = NULL;
+	BusyTrack = NULL;
+	TempID = 0;
+	Loader = NULL;
+	StopReq = Abort = false;
+}
+
+bool TrackPrefetch::Wanted(TrackInfo* TI)
+{
+	for(ushort h = 0; h < HINT_COUNT; h++)
+	{
+		if(Want[h] == TI)	return true;
+	}
+	return false;
+}
+
+PlayFile* TrackPrefetch::NextJob(TrackInfo*& TI)
+{
+	ushort h, s;
+	TrackInfo* Playing = Streamer::Inst().Track;
+
+	for(h = 0; h < HINT_COUNT; h++)
+	{
+		TI = Want[h];
+		if(!TI || TI == Playing)	continue;
+
+		// Already there?
+		for(s = 0; s < HINT_COUNT; s++)
+		{
+			if(Slot[s]->Track == TI && Slot[s]->Sil == SilResolve())	break;
+		}
+		if(s != HINT_COUNT)	continue;
+
+		// Recycle a slot nobody wants anymore
+		for(s = 0; s < HINT_COUNT; s++)
+		{
+			if(!Slot[s]->Track || !Wanted(Slot[s]->Track))	return Slot[s];
+		}
+	}
+	TI = NULL;
+	return NULL;
+}
+
+bool TrackPrefetch::Prepare(PlayFile* P, TrackInfo* TI, GameInfo* GI, volatile bool& Cancel)
+{
+	FXuint ID;
+	volatile FXulong Prog = 0;	// Background work, the progress bar belongs to the GUI thread
+
+	P->Close();
+	P->Sil = SilResolve();
+	P->FNHash = GI->DiskFN(TI).hash();
+
+	if(GI->Vorbis)
+	{
+		if(GI->CryptKind)
+		{
+			{
+				FXMutexLock L(Lock);
+				ID = ++TempID;
+			}
+			P->TempFN.format("%s.%u", OggPlayFile.text(), ID);
+			{
+				FXMutexLock L(Crypt);
+				// Maybe we've been superseded while waiting
+				if(Cancel || StopReq)	return false;
+				if(!DumpDecrypt(GI, TI, P->TempFN, &Prog))	return false;
+			}
+			if(Cancel)	return false;
+			if(!P->File.open(P->TempFN, FXIO::Reading))	return false;
+			if(ov_open_callbacks(&P->File, &P->SF, NULL, 0, OV_CALLBACKS_FXFILE))
+			{
+				P->File.close();
+				return false;
+			}
+		}
+		else if(!OpenVorbisBGM(P->File, P->SF, GI, TI))	return false;
+	}
+	else
+	{
+		if(!GI->OpenBGMFile(P->File, TI))	return false;
+		P->File.position(TI->GetStart(FMT_BYTE, P->Sil));
+	}
+
+	if(Cancel)	return false;
+
+	P->Buf = BufPool::Inst().Get(Streamer::PrefetchSize);
+	if(!P->Buf)	return false;
+
+	while((P->Len + Streamer::DecodeSize) <= Streamer::PrefetchSize && P->Chunks < PlayFile::MaxChunks)
+	{
+		if(StopReq || Cancel)	return false;
+
+		char* Dst = P->Buf + P->Len;
+		if(GI->Vorbis)	P->ChunkPos[P->Chunks] = (ulong)ov_read_bgm(&P->SF, Dst, Streamer::DecodeSize, TI, &P->Splice);
+		else			P->ChunkPos[P->Chunks] = pcm_read_bgm(P->File, Dst, Streamer::DecodeSize, TI, &P->Splice);
+		P->Len += Streamer::DecodeSize;
+		P->Chunks++;
+	}
+	return true;
+}
+
+FXint TrackPrefetch::run()
+{
+	PlayFile* P;
+	TrackInfo* TI;
+	GameInfo* GI;
+	bool Ret;
+
+	priority(PriorityMinimum);
+
+	while(!StopReq)
+	{
+		Work.lock();
+		{
+			FXMutexLock L(Lock);
+			P = NextJob(TI);
+			GI = ActiveGame;
+			if(P)
+			{
+				P->Track = NULL;	// Keep Take() away from it
+				Busy = P;
+				BusyTrack = TI;
+			}
+		}
+
+		if(P && GI)
+		{
+			Ret = Prepare(P, TI, GI, Abort);
+			if(!Ret)	P->Close();
+
+			FXMutexLock L(Lock);
+			if(Ret)	P->Track = TI;
+			Busy = NULL;
+			BusyTrack = NULL;
+		}
+		Work.unlock();
+
+		// Maybe the streamer is waiting for this one
+		if(P)	Streamer::Inst().Wake();
+
+		if(!P)	Event.Wait();
+	}
+	return 1;
+}
+
+void TrackPrefetch::Hint(const HintType& Type, TrackInfo* TI)
+{
+	{
+		FXMutexLock L(Lock);
+		if(Want[Type] == TI)	return;
+		Want[Type] = TI;
+	}
+	Event.Signal();
+}
+
+void TrackPrefetch::Neighbors(TrackInfo* TI)
+{
+	ListEntry<TrackInfo>* Cur;
+
+	if(!ActiveGame || !TI)	return;
+
+	Cur = ActiveGame->Track.First();
+	while(Cur && &Cur->Data != TI)	Cur = Cur->Next();
+	if(!Cur)	return;
+
+	{
+		FXMutexLock L(Lock);
+		Want[HINT_PREV] = Cur->Prev() ? &Cur->Prev()->Data : NULL;
+		Want[HINT_NEXT] = Cur->Next() ? &Cur->Next()->Data : NULL;
+	}
+	Event.Signal();
+}
+
+// Switch loading
+// --------------
+TrackLoader::TrackLoader(TrackInfo* TI, GameInfo* GI)
+{
+	Track = TI;
+	Game = GI;
+	File = new PlayFile;
+	Cancel = false;
+	Done = 0;
+	Ret = false;
+}
+
+FXint TrackLoader::run()
+{
+	Ret = Streamer::Inst().Pre.Prepare(File, Track, Game, Cancel);
+	atomicSet(&Done, 1);
+	Streamer::Inst().Wake();
+	return 1;
+}
+
+TrackLoader::~TrackLoader()
+{
+	File->Close();
+	SAFE_DELETE(File);
+}
+
+void TrackPrefetch::Retire()
+{
+	if(!Loader)	return;
+
+	Loader->Cancel = true;
+	Stale.Add(&Loader);
+	Loader = NULL;
+}
+
+void TrackPrefetch::Reap(const bool& Wait)
+{
+	ListEntry<TrackLoader*>* Cur = Stale.First();
+	while(Cur)
+	{
+		ListEntry<TrackLoader*>* Next = Cur->Next();
+		TrackLoader* L = Cur->Data;
+		if(Wait || L->Done)
+		{
+			L->join();
+			SAFE_DELETE(L);
+			Stale.Delete(Cur);
+		}
+		Cur = Next;
+	}
+}
+
+void TrackPrefetch::Load(TrackInfo* TI)
+{
+	FXMutexLock L(Lock);
+
+	Reap();
+	if(Loader && Loader->Track == TI && !Loader->Done)	return;
+	Retire();
+
+	Loader = new TrackLoader(TI, ActiveGame);
+	Loader->start();
+}
+
+void TrackPrefetch::Cancel(TrackInfo* Keep)
+{
+	FXMutexLock L(Lock);
+
+	if(Loader && Loader->Track != Keep)	Retire();
+}
+
+TrackPrefetch::LoadState TrackPrefetch::State(TrackInfo* TI)
+{
+	FXMutexLock L(Lock);
+
+	for(ushort s = 0; s < HINT_COUNT; s++)
+	{
+		if(Slot[s] != Busy && Slot[s]->Track == TI && Slot[s]->Sil == SilResolve())	return LOAD_READY;
+	}
+	if(Loader && Loader->Track == TI)
+	{
+		if(!Loader->Done)	return LOAD_BUSY;
+		return Loader->Ret ? LOAD_READY : LOAD_FAILED;
+	}
+	return (BusyTrack == TI) ? LOAD_BUSY : LOAD_NONE;
+}
+// --------------
+
+void TrackPrefetch::WaitFor(TrackInfo* TI)
+{
+	bool Wait;
+	{
+		FXMutexLock L(Lock);
+		Wait = (BusyTrack == TI);
+	}
+	// Still quicker than opening it a second time
+	if(Wait)
+	{
+		Work.lock();
+		Work.unlock();
+	}
+}
+
+bool TrackPrefetch::Take(TrackInfo* TI, PlayFile*& Cur)
+{
+	FXMutexLock L(Lock);
+	PlayFile* P;
+
+	for(ushort s = 0; s < HINT_COUNT; s++)
+	{
+		P = Slot[s];
+		if(P == Busy || P->Track != TI || P->Sil != SilResolve())	continue;
+
+		Slot[s] = Cur;
+		Cur = P;
+		Slot[s]->Close();
+		return true;
+	}
+
+	if(Loader && Loader->Track == TI && Loader->Done && Loader->Ret && Loader->File->Sil == SilResolve())
+	{
+		P = Loader->File;
+		Loader->File = Cur;
+		Cur = P;
+
+		Loader->join();
+		SAFE_DELETE(Loader);	// Closes the old file
+		return true;
+	}
+	return false;
+}
+
+void TrackPrefetch::Drop()
+{
+	List<TrackLoader*> Old;
+
+	Abort = true;
+	FXMutexLock W(Work);
+	{
+		FXMutexLock L(Lock);
+
+		Retire();
+		Old.Copy(&Stale);
+		Stale.Clear();
+		for(ushort s = 0; s < HINT_COUNT; s++)
+		{
+			Want[s] = NULL;
+			Slot[s]->Close();
+		}
+	}
+
+	// No loader may outlive the game it was started for.
+	// They might still need <Lock> for their temporary file names, so join them outside of it.
+	ListEntry<TrackLoader*>* Cur = Old.First();
+	while(Cur)
+	{
+		Cur->Data->join();
+		SAFE_DELETE(Cur->Data);
+		Cur = Cur->Next();
+	}
+	Abort = false;
+}
+
+void TrackPrefetch::Exit()
+{
+	StopReq = true;	// Also makes the loaders give up
+	if(running())
+	{
+		Event.Signal();
+		join();
+	}
+	Drop();
+	Reap(true);	// Nobody else is left to take <Lock>, and the loaders might still need it
+	StopReq = false;
+}
+
+TrackPrefetch::~TrackPrefetch()
+{
+	for(ushort s = 0; s < HINT_COUNT; s++)	SAFE_DELETE(Slot[s]);
+}
@@ -0,0 +1,123 @@
+// Music Room Interface
+// --------------------
+// ring.cpp - Lock-free PCM ring buffer
+// --------------------
+// "" Nmlgc, 2011
+
+#include <bgmlib/platform.h>
+#include <FXAtomic.h>
+#include <bgmlib/list.h>
+#include <bgmlib/bufpool.h>
+#include "ring.h"
+
+// Loads with a full barrier. Each side only ever writes its own cursor.
+#define RING_LOAD(x)	atomicAdd(&(x), 0)
+
+PCMRing::PCMRing()
+{
+	Buf = NULL;
+	Size = 0;
+	Head = Tail = TagHead = TagTail = 0;
+}
+
+bool PCMRing::Create(const ulong& Bytes)
+{
+	FXint NewSize = 1;
+
+	Clear();
+	while((ulong)NewSize < Bytes && NewSize < 0x40000000)	NewSize <<= 1;
+
+	Buf = BufPool::Inst().Get(NewSize);
+	if(!Buf)	return false;
+	Size = NewSize;
+	return true;
+}
+
+void PCMRing::Clear()
+{
+	if(Buf)	POOL_RELEASE(Buf);
+	Size = 0;
+	Reset();
+}
+
+void PCMRing::Reset()
+{
+	atomicSet(&Head, 0);
+	atomicSet(&Tail, 0);
+	atomicSet(&TagHead, 0);
+	atomicSet(&TagTail, 0);
+}
+
+ulong PCMRing::Fill()
+{
+	return (FXuint)(RING_LOAD(Head) - RING_LOAD(Tail));
+}
+
+ulong PCMRing::Space()
+{
+	return Size - Fill();
+}
+
+char* PCMRing::WriteSpan(ulong& Len)
+{
+	FXint h = Head;	// Only we write this one
+	FXint Off = h & (Size - 1);
+
+	if(!Buf)
+	{
+		Len = 0;
+		return NULL;
+	}
+	Len = MIN(Space(), (ulong)(Size - Off));
+	return Buf + Off;
+}
+
+void PCMRing::Commit(const ulong& Len, const ulong& Pos)
+{
+	FXint h = Head + (FXint)Len;
+	FXint th = TagHead;
+
+	if(!Len)	return;
+
+	// If the reader is lagging that far behind, it simply gets a slightly older position
+	if((FXuint)(th - RING_LOAD(TagTail)) < TagCount)
+	{
+		PosTag& T = Tags[th & (TagCount - 1)];
+		T.End = h;
+		T.Pos = Pos;
+		atomicSet(&TagHead, th + 1);
+	}
+	atomicSet(&Head, h);
+}
+
+ulong PCMRing::Read(char* Dst, const ulong& Len, ulong* Pos)
+{
+	FXint t = Tail;	// Only we write this one
+	ulong Avail = (FXuint)(RING_LOAD(Head) - t);
+	ulong Copy = MIN(Len, Avail);
+	ulong Off = t & (Size - 1);
+	ulong First = MIN(Copy, Size - Off);
+
+	if(!Copy)	return 0;
+
+	memcpy(Dst, Buf + Off, First);
+	if(Copy > First)	memcpy(Dst + First, Buf, Copy - First);
+	t += Copy;
+	atomicSet(&Tail, t);
+
+	// Pick up the tags we passed
+	FXint tt = TagTail;
+	FXint th = RING_LOAD(TagHead);
+	while(tt != th && (FXint)(t - Tags[tt & (TagCount - 1)].End) >= 0)
+	{
+		if(Pos)	*Pos = Tags[tt & (TagCount - 1)].Pos;
+		tt++;
+	}
+	atomicSet(&TagTail, tt);
+	return Copy;
+}
+
+PCMRing::~PCMRing()
+{
+	Clear();
+}
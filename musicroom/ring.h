@@ -0,0 +1,54 @@
+// Music Room Interface
+// --------------------
+// ring.h - Lock-free PCM ring buffer
+// --------------------
+// "" Nmlgc, 2011
+
+#ifndef MUSICROOM_RING_H
+#define MUSICROOM_RING_H
+
+// Single-producer/single-consumer byte ring.
+// One thread writes (WriteSpan + Commit), one other thread reads (Read), no locks involved.
+// Every commit can be tagged with a stream position, which Read hands back once the reader passed it.
+class PCMRing
+{
+protected:
+	struct PosTag
+	{
+		FXint	End;	// <Head> after the tagged commit
+		ulong	Pos;
+	};
+	static const int TagCount = 256;	// Power of 2
+
+	char*	Buf;
+	FXint	Size;	// Power of 2
+	volatile FXint	Head;	// Bytes written in total (wrapping)
+	volatile FXint	Tail;	// Bytes read in total (wrapping)
+
+	PosTag	Tags[TagCount];
+	volatile FXint	TagHead;
+	volatile FXint	TagTail;
+
+public:
+	PCMRing();
+	~PCMRing();
+
+	bool	Create(const ulong& Bytes);	// Allocates at least [Bytes] (rounded up to a power of 2)
+	void	Clear();
+	void	Reset();	// Empties the ring. Neither side may be active during the call!
+
+	ulong	Capacity()	{return Size;}
+	ulong	Fill();	// Bytes available for reading
+	ulong	Space();	// Bytes available for writing
+
+	// Producer side
+	// -------------
+	char*	WriteSpan(ulong& Len);	// Returns the contiguous free space at the write cursor, with its size in [Len]
+	void	Commit(const ulong& Len, const ulong& Pos);	// Publishes [Len] bytes written to the last span, tagged with [Pos]
+	// -------------
+
+	// Consumer side. Copies up to [Len] bytes to [Dst]. [Pos] receives the tag of the last fully read commit, if any.
+	ulong	Read(char* Dst, const ulong& Len, ulong* Pos = NULL);
+};
+
+#endif /* MUSICROOM_RING_H */
@@ -0,0 +1,110 @@
+// Music Room Interface
+// --------------------
+// segcache.cpp - Encoded segment cache
+// --------------------
+// "" Nmlgc, 2011
+
+#include <bgmlib/platform.h>
+#include <FXIO.h>
+#include <bgmlib/list.h>
+#include <bgmlib/bufpool.h>
+#include <bgmlib/libvorbis.h>
+#include "segcache.h"
+
+bool SegKey::operator==(const SegKey& o) const
+{
+	// Cheap comparisons first
+	return SourceSize == o.SourceSize && SourceTime == o.SourceTime
+		&& Pos == o.Pos && Bytes == o.Bytes && Quality == o.Quality && Serial == o.Serial
+		&& Source == o.Source && Fade == o.Fade && Tags == o.Tags && Version == o.Version;
+}
+
+SegCache::SegCache()
+{
+	Cached = 0;
+	Clock = 0;
+	MaxCache = 64 * 1024 * 1024;
+
+	BufPool::Inst();	// Make sure the pool outlives us
+}
+
+ListEntry<SegEntry>* SegCache::Find(const SegKey& Key)
+{
+	ListEntry<SegEntry>* Cur = Entries.First();
+	while(Cur)
+	{
+		if(Cur->Data.Key == Key)	return Cur;
+		Cur = Cur->Next();
+	}
+	return NULL;
+}
+
+void SegCache::Evict(const ulong& Need)
+{
+	ListEntry<SegEntry>* Cur;
+	ListEntry<SegEntry>* Oldest;
+
+	while(Entries.Size() && (Cached + Need) > MaxCache)
+	{
+		Oldest = Cur = Entries.First();
+		while(Cur)
+		{
+			if(Cur->Data.Age < Oldest->Data.Age)	Oldest = Cur;
+			Cur = Cur->Next();
+		}
+		Cached -= Oldest->Data.Size;
+		BufPool::Inst().Release(Oldest->Data.Buf);
+		Entries.Delete(Oldest);
+	}
+}
+
+bool SegCache::Get(const SegKey& Key, VFile& Dst)
+{
+	FXMutexLock Lock(this->Lock);
+	ListEntry<SegEntry>* E = Find(Key);
+	VFileIO Out(Dst);
+
+	if(!E)	return false;
+	E->Data.Age = ++Clock;
+	return Out.writeBlock(E->Data.Buf, E->Data.Size) == (FXival)E->Data.Size;
+}
+
+void SegCache::Put(const SegKey& Key, const VFile& Src)
+{
+	FXMutexLock Lock(this->Lock);
+	SegEntry* New;
+	char* Buf;
+
+	if(!Src.Buf || Src.Size > MaxCache || Find(Key))	return;
+	Evict(Src.Size);
+
+	Buf = BufPool::Inst().Get(Src.Size);
+	if(!Buf)	return;
+	memcpy(Buf, Src.Buf, Src.Size);
+
+	// The key holds strings, so we can't just copy a stack entry into the list
+	New = &Entries.Add()->Data;
+	New->Key = Key;
+	New->Buf = Buf;
+	New->Size = Src.Size;
+	New->Age = ++Clock;
+	Cached += New->Size;
+}
+
+void SegCache::Clear()
+{
+	FXMutexLock Lock(this->Lock);
+	ListEntry<SegEntry>* Cur = Entries.First();
+	while(Cur)
+	{
+		BufPool::Inst().Release(Cur->Data.Buf);
+		Cur = Cur->Next();
+	}
+	Entries.Clear();
+	Cached = 0;
+}
+
+SegCache::~SegCache()
+{
+	Clear();
+}
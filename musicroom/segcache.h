@@ -0,0 +1,69 @@
+// Music Room Interface
+// --------------------
+// segcache.h - Encoded segment cache
+// --------------------
+// "" Nmlgc, 2011
+
+#ifndef MUSICROOM_SEGCACHE_H
+#define MUSICROOM_SEGCACHE_H
+
+#include <FXThread.h>
+
+class VFile;
+
+// Identifies one encoded segment. Everything that changes the encoder output goes in here.
+struct SegKey
+{
+	FXString	Source;	// Source file name
+	FXlong	SourceSize;
+	FXTime	SourceTime;	// Modification time
+	ulong	Pos;	// Source position in bytes
+	ulong	Bytes;	// Source length in bytes
+	float	Quality;
+	FXString	Fade;	// Fade algorithm name, empty for unfaded segments
+	long	Serial;	// Stream serial number
+	FXString	Tags;	// Comment header
+	FXString	Version;	// Encoder version
+
+	bool operator==(const SegKey& o) const;
+};
+
+// Cached segment
+struct SegEntry
+{
+	SegKey	Key;
+	char*	Buf;	// Complete logical Ogg stream, headers included
+	ulong	Size;
+	FXuint	Age;	// <SegCache::Clock> at the last use
+};
+
+// Keeps the encoded intro, loop and fade streams of recently extracted tracks.
+// Re-exporting the same tracks with a different loop count only has to copy packets then,
+// and a different fade only needs the fade to be encoded again.
+class SegCache
+{
+protected:
+	FXMutex	Lock;
+	List<SegEntry>	Entries;
+
+	ulong	Cached;	// Bytes in <Entries>
+	FXuint	Clock;
+
+	ListEntry<SegEntry>*	Find(const SegKey& Key);
+	void	Evict(const ulong& Need);	// Drops the least recently used segments until [Need] more bytes fit into <MaxCache>
+
+	SegCache();
+
+public:
+	SINGLETON(SegCache);
+
+	ulong	MaxCache;	// Maximum amount of bytes to keep
+
+	bool	Get(const SegKey& Key, VFile& Dst);	// Appends the segment identified by [Key] to [Dst], if we have it
+	void	Put(const SegKey& Key, const VFile& Src);	// Stores [Src] under [Key]
+	void	Clear();
+
+	~SegCache();
+};
+
+#endif /* MUSICROOM_SEGCACHE_H */
@@ -0,0 +1,484 @@
+// Music Room Interface
+// --------------------
+// selftest.cpp - Checks and benchmarks of the optimized code paths
+// --------------------
+// "" Nmlgc, 2011
+
+#include "musicroom.h"
+#include <math.h>
+#include <FXHash.h>
+#include <FXStream.h>
+#include <FXObject.h>
+#include <FXFile.h>
+#include <FXThread.h>
+#include <FXSystem.h>
+#include <bgmlib/bgmlib.h>
+#include <bgmlib/libvorbis.h>
+#include <bgmlib/bufpool.h>
+#include <bgmlib/ui.h>
+#include "extract.h"
+#include "enc_wav.h"
+#include "httpd.h"
+#include "selftest.h"
+
+#if defined(_DEBUG) || defined(PROFILING_LIBS)
+
+static int Failed;
+
+static void Check(const bool& Cond, const FXString& What)
+{
+	if(Cond)	return;
+	Failed++;
+	BGMLib::UI_Stat("FAILED: " + What + "\n");
+}
+
+// Million samples per second
+static double MSPS(const FXulong& Samples, const FXTime& Time)
+{
+	return Samples * 1000.0 / MAX(Time, (FXTime)1);
+}
+
+// Fades
+// -----
+// Runs every fade algorithm over ten seconds of fixed pseudo-random stereo audio and compares the block faders
+// against a per-frame evaluation of Gain(), which is what they replaced. 1 LSB of difference is allowed.
+static void FadeTest()
+{
+	const long Frames = 441000;
+	const long Len = Frames << 2;
+	short* In = new short[Frames << 1];
+	short* Blk = new short[Frames << 1];
+	short* Ref = new short[Frames << 1];
+	float* F[2] = {new float[Frames], new float[Frames]};
+	unsigned int Seed = 1;
+	FXTime TBlk, TRef;
+	FXString Str;
+	long c, s, Diff;
+
+	for(s = 0; s < (Frames << 1); s++)
+	{
+		Seed = Seed * 1103515245 + 12345;
+		In[s] = (short)(Seed >> 16);
+	}
+
+	ListEntry<FadeAlg*>* CurFA = Extractor::Inst().FAs.First();
+	while(CurFA)
+	{
+		FadeAlg* A = CurFA->Data;
+
+		memcpy(Blk, In, Len);
+		c = 0;
+		TBlk = FXThread::time();
+		A->Fade(Blk, c, Len, Len);
+		TBlk = FXThread::time() - TBlk;
+
+		TRef = FXThread::time();
+		for(s = 0; s < Frames; s++)
+		{
+			double g = A->Gain((double)(s << 2) / (double)Len);
+			Ref[(s << 1)]     = (short)((double)In[(s << 1)] * g);
+			Ref[(s << 1) + 1] = (short)((double)In[(s << 1) + 1] * g);
+		}
+		TRef = FXThread::time() - TRef;
+
+		Diff = 0;
+		for(s = 0; s < (Frames << 1); s++)	if(abs(Blk[s] - Ref[s]) > 1)	Diff++;
+		Check(Diff == 0, "16-bit fade (" + A->Name + ")");
+
+		for(s = 0; s < Frames; s++)
+		{
+			F[0][s] = In[(s << 1)] / 32768.0f;
+			F[1][s] = In[(s << 1) + 1] / 32768.0f;
+		}
+		c = 0;
+		A->EvalFloat(F, Frames, c, Frames);
+		Diff = 0;
+		for(s = 0; s < Frames; s++)
+		{
+			float g = (float)A->Gain((double)s / (double)Frames);
+			if(fabs(F[0][s] - (In[(s << 1)] / 32768.0f) * g) > (1.0f / 32768.0f))	Diff++;
+			if(fabs(F[1][s] - (In[(s << 1) + 1] / 32768.0f) * g) > (1.0f / 32768.0f))	Diff++;
+		}
+		Check(Diff == 0, "float fade (" + A->Name + ")");
+
+		Str.format("Fade (%s): block %.1f, per-frame %.1f million samples/s\n", A->Name.text(),
+			MSPS(Frames << 1, TBlk), MSPS(Frames << 1, TRef));
+		BGMLib::UI_Stat(Str);
+
+		CurFA = CurFA->Next();
+	}
+
+	SAFE_DELETE_ARRAY(In);
+	SAFE_DELETE_ARRAY(Blk);
+	SAFE_DELETE_ARRAY(Ref);
+	SAFE_DELETE_ARRAY(F[0]);
+	SAFE_DELETE_ARRAY(F[1]);
+}
+// -----
+
+// Seeks
+// -----
+// Opens the first track of the active game into [VF], decrypting it into [Dec] if necessary.
+// Returns the track, or NULL if there's nothing to test.
+static TrackInfo* OpenFirstTrack(FXFile& File, VFile& Dec, OggVorbis_File& VF, const FXString& Test)
+{
+	GameInfo* GI = ActiveGame;
+	TrackInfo* TI;
+
+	if(!GI || !GI->Vorbis || !GI->Track.First())
+	{
+		BGMLib::UI_Stat(Test + ": skipped, the game isn't Vorbis-compressed.\n");
+		return NULL;
+	}
+	TI = &GI->Track.First()->Data;
+
+	if(GI->CryptKind)
+	{
+		if(DecryptBGM(GI, TI, Dec) && !ov_open_callbacks(&Dec, &VF, NULL, 0, OV_CALLBACKS_VFILE))	return TI;
+	}
+	else if(OpenVorbisFile(File, VF, GI, TI))	return TI;
+
+	Check(false, Test + ": opening " + TI->GetComment(Lang));
+	return NULL;
+}
+
+// Reads exactly [Len] bytes of 16-bit PCM unless the stream ends first
+static long ReadFull(OggVorbis_File* vf, char* Buf, const long& Len)
+{
+	long Got = 0, Ret;
+	int Bit;
+
+	while(Got < Len && (Ret = ov_read(vf, Buf + Got, Len - Got, 0, 2, 1, &Bit)) > 0)	Got += Ret;
+	return Got;
+}
+
+// Lands 400 random seeks into the first track of the active game both through an OggPageIndex
+// and through ov_pcm_seek()'s bisection, and compares the decoded samples.
+static void SeekTest()
+{
+	const int Seeks = 400;
+	const long CmpLen = 0x1000;
+	char A[CmpLen];
+	char B[CmpLen];
+	unsigned int Seed = 1;
+	TrackInfo* TI;
+	FXFile File;
+	VFile Dec;
+	OggVorbis_File VF;
+	OggPageIndex Index;
+	ogg_int64_t Start, Dst;
+	ulong E;
+	FXTime TIdx = 0, TBis = 0, T;
+	FXString Str;
+	long LA, LB, Diff = 0;
+
+	if(!(TI = OpenFirstTrack(File, Dec, VF, "Seek")))	return;
+
+	Start = TI->GetStart(FMT_SAMPLE, false);
+	TI->GetPos(FMT_SAMPLE, false, NULL, NULL, &E);
+	if((ogg_int64_t)E <= Start)
+	{
+		ov_clear(&VF);
+		return;
+	}
+	Check(Index.Build(&VF, Start, E), "Seek: building the page index");
+
+	for(int s = 0; s < Seeks; s++)
+	{
+		Seed = Seed * 1103515245 + 12345;
+		Dst = Start + (ogg_int64_t)((Seed >> 8) / (double)(1 << 24) * (double)(E - Start));
+
+		T = FXThread::time();
+		ov_pcm_seek_indexed(&VF, &Index, Dst);
+		TIdx += FXThread::time() - T;
+		if(ov_pcm_tell(&VF) != Dst)	Diff++;
+		LA = ReadFull(&VF, A, CmpLen);
+
+		T = FXThread::time();
+		ov_pcm_seek(&VF, Dst);
+		TBis += FXThread::time() - T;
+		LB = ReadFull(&VF, B, CmpLen);
+
+		if(LA != LB || memcmp(A, B, LA))	Diff++;
+	}
+	Check(Diff == 0, "Seek: indexed against bisected");
+	ov_clear(&VF);
+
+	Str.format("Seek: %d random seeks, %.2f ms indexed, %.2f ms bisected on average\n", Seeks,
+		(double)TIdx / 1000000.0 / Seeks, (double)TBis / 1000000.0 / Seeks);
+	BGMLib::UI_Stat(Str);
+}
+// -----
+
+// PCM conversion
+// --------------
+// Reference for the vectorized 16-bit packing in ov_read(): round to nearest-even, then clip
+static short RoundS16(const float& f)
+{
+	double r = floor(f + 0.5);
+
+	if(r - f == 0.5 && fmod(r, 2.0) != 0.0)	r -= 1.0;
+	return (short)MIN(MAX(r, -32768.0), 32767.0);
+}
+
+// Runs every 16-bit value through deinterleave_s16(), with the two channels offset against each other,
+// and compares the result against the scalar division it replaced.
+static void DeinterleaveTest()
+{
+	const long Frames = 0x10000 + 3;	// odd tail for the scalar loop
+	const int Rounds = 100;
+	short* In = new short[Frames * 2];
+	float* L = new float[Frames];
+	float* R = new float[Frames];
+	FXTime TVec, TRef;
+	FXString Str;
+	long i, Diff = 0;
+	int r;
+
+	for(i = 0; i < Frames; i++)
+	{
+		In[i*2] = (short)(i - 0x8000);
+		In[i*2+1] = (short)(0x7fff - i * 3);
+	}
+	deinterleave_s16(L, R, (const char*)In, Frames);
+	for(i = 0; i < Frames; i++)
+	{
+		if(L[i] != In[i*2] / 32768.f)	Diff++;
+		if(R[i] != In[i*2+1] / 32768.f)	Diff++;
+	}
+	Check(Diff == 0, "deinterleave_s16() against the scalar division");
+
+	TVec = FXThread::time();
+	for(r = 0; r < Rounds; r++)	deinterleave_s16(L, R, (const char*)In, Frames);
+	TVec = FXThread::time() - TVec;
+
+	TRef = FXThread::time();
+	for(r = 0; r < Rounds; r++)
+	{
+		for(i = 0; i < Frames; i++)
+		{
+			L[i] = In[i*2] / 32768.f;
+			R[i] = In[i*2+1] / 32768.f;
+		}
+	}
+	TRef = FXThread::time() - TRef;
+
+	Str.format("Deinterleave: %.1f vectorized, %.1f scalar million samples/s\n",
+		MSPS((FXulong)Frames * 2 * Rounds, TVec), MSPS((FXulong)Frames * 2 * Rounds, TRef));
+	BGMLib::UI_Stat(Str);
+
+	SAFE_DELETE_ARRAY(In);
+	SAFE_DELETE_ARRAY(L);
+	SAFE_DELETE_ARRAY(R);
+}
+
+// Decodes the first ten seconds of the first track through ov_read(), whose native 16-bit packing is vectorized,
+// and again through ov_read_float() with the scalar packing, and compares both.
+static void PackTest()
+{
+	const long Frames = 441000;
+	short* Vec = new short[Frames * 2];
+	short* Ref = new short[Frames * 2];
+	float** Src;
+	TrackInfo* TI;
+	FXFile File;
+	VFile Dec;
+	OggVorbis_File VF;
+	ogg_int64_t Start;
+	FXTime TVec, TFlt, TRef = 0, T;
+	FXString Str;
+	long Got, Ret, i, Diff;
+	int Link;
+
+	if((TI = OpenFirstTrack(File, Dec, VF, "Pack")) && ov_info(&VF, -1)->channels != 2)
+	{
+		BGMLib::UI_Stat("Pack: skipped, the track isn't stereo.\n");
+		ov_clear(&VF);
+	}
+	else if(TI)
+	{
+		Start = TI->GetStart(FMT_SAMPLE, false);
+
+		ov_pcm_seek(&VF, Start);
+		TVec = FXThread::time();
+		Got = ReadFull(&VF, (char*)Vec, Frames * 4) / 4;
+		TVec = FXThread::time() - TVec;
+
+		ov_pcm_seek(&VF, Start);
+		TFlt = FXThread::time();
+		for(i = 0; i < Got; i += Ret)
+		{
+			if((Ret = ov_read_float(&VF, &Src, Got - i, &Link)) <= 0)	break;
+
+			T = FXThread::time();
+			for(long s = 0; s < Ret; s++)
+			{
+				Ref[(i + s) * 2]     = RoundS16(Src[0][s] * 32768.f);
+				Ref[(i + s) * 2 + 1] = RoundS16(Src[1][s] * 32768.f);
+			}
+			TRef += FXThread::time() - T;
+		}
+		TFlt = FXThread::time() - TFlt - TRef;
+		ov_clear(&VF);
+
+		Check(i == Got, "Pack: ov_read_float() ended early");
+		Diff = 0;
+		for(i = 0; i < Got * 2; i++)	if(Vec[i] != Ref[i])	Diff++;
+		Check(Diff == 0, "Pack: ov_read() against scalar packing");
+
+		// ov_read() minus the plain decode is what the packing costs
+		Str.format("Pack: ov_read() %.1f, ov_read_float() %.1f million samples/s, scalar packing alone %.1f\n",
+			MSPS((FXulong)Got * 2, TVec), MSPS((FXulong)Got * 2, TFlt), MSPS((FXulong)Got * 2, TRef));
+		BGMLib::UI_Stat(Str);
+	}
+	SAFE_DELETE_ARRAY(Vec);
+	SAFE_DELETE_ARRAY(Ref);
+}
+// --------------
+
+// HTTP server
+// -----------
+// Request/response round trips through the whole server, if it's running
+static void HTTPTest()
+{
+	HTTPServer& Srv = HTTPServer::Inst();
+	FXString Resp;
+
+	if(!Srv.running())
+	{
+		BGMLib::UI_Stat("HTTP: skipped, the server isn't running.\n");
+		return;
+	}
+
+	Resp = Srv.Request("GET / HTTP/1.0\r\n\r\n");
+	Check(Resp.left(17) == "HTTP/1.0 200 OK\r\n", "HTTP: playlist status");
+	Check(Resp.find("\r\n\r\n#EXTM3U\r\n") > 0, "HTTP: playlist body");
+
+	Resp = Srv.Request("GET /nogame/1.ogg HTTP/1.0\r\n\r\n");
+	Check(Resp.left(22) == "HTTP/1.0 404 Not Found", "HTTP: unknown game");
+
+	Resp = Srv.Request("POST / HTTP/1.1\r\nHost: localhost\r\n\r\n");
+	Check(Resp.left(12) == "HTTP/1.1 405", "HTTP: unsupported method");
+}
+// -----------
+
+// WAV range copies
+// ----------------
+// Compares [Len] bytes of [A] at [APos] with [B] at [BPos]
+static bool SameBytes(FXFile& A, const FXlong& APos, FXFile& B, const FXlong& BPos, const ulong& Len)
+{
+	char BufA[0x10000];
+	char BufB[0x10000];
+	ulong Done, Part;
+
+	A.position(APos);
+	B.position(BPos);
+	for(Done = 0; Done < Len; Done += Part)
+	{
+		Part = MIN(Len - Done, (ulong)sizeof(BufA));
+		if(A.readBlock(BufA, Part) != (FXival)Part || B.readBlock(BufB, Part) != (FXival)Part)	return false;
+		if(memcmp(BufA, BufB, Part))	return false;
+	}
+	return true;
+}
+
+// Copies a scratch file in [Dir] once through Encoder_WAV::CopyRange() and once through a plain read/write loop,
+// and reports which of the copy paths the file system took. Both sides start at the same unaligned offset,
+// like the sample data of a raw BGM file and the WAV files written from it.
+static void CopyTest(const FXString& Dir)
+{
+	const ulong Size = 0x4000000;	// 64 MiB
+	const ulong Len = Size - WAV_HEADER_SIZE;
+	FXString SrcFN = Dir + SlashString + "musicroom_selftest.raw";
+	FXString DstFN = Dir + SlashString + "musicroom_selftest_copy.raw";
+	FXString BufFN = Dir + SlashString + "musicroom_selftest_buf.raw";
+	FXFile Src, Dst, Buf;
+	Encoder_WAV Enc;
+	Extract_Vals V;
+	WAVCopyStats St;
+	unsigned int Seed = 1;
+	FXTime TCopy, TBuf;
+	FXString Str;
+	FXival Read;
+	ulong o, s;
+	bool Ret;
+
+	V.Buf = BufPool::Inst().Resize(V.Buf, OV_BLOCK);
+
+	if(!Src.open(SrcFN, FXIO::ReadWrite | FXIO::Create | FXIO::Truncate) ||
+	   !Dst.open(DstFN, FXIO::ReadWrite | FXIO::Create | FXIO::Truncate) ||
+	   !Buf.open(BufFN, FXIO::ReadWrite | FXIO::Create | FXIO::Truncate))
+	{
+		BGMLib::UI_Stat("WAV copy: skipped, can't write to " + Dir + ".\n");
+	}
+	else
+	{
+		for(o = 0, Ret = true; Ret && o < Size; o += OV_BLOCK)
+		{
+			for(s = 0; s < OV_BLOCK; s++)
+			{
+				Seed = Seed * 1103515245 + 12345;
+				V.Buf[s] = (char)(Seed >> 16);
+			}
+			Ret = Src.writeBlock(V.Buf, MIN((ulong)OV_BLOCK, Size - o)) > 0;
+		}
+		Check(Ret, "WAV copy: writing the scratch file in " + Dir);
+
+		// Same misalignment on the destination side
+		Dst.writeBlock(V.Buf, WAV_HEADER_SIZE);
+		Buf.writeBlock(V.Buf, WAV_HEADER_SIZE);
+
+		TCopy = FXThread::time();
+		Check(Enc.CopyRange(Dst, Src, WAV_HEADER_SIZE, Len, V, St), "WAV copy: CopyRange() in " + Dir);
+		TCopy = FXThread::time() - TCopy;
+
+		TBuf = FXThread::time();
+		Src.position(WAV_HEADER_SIZE);
+		for(o = 0; o < Len; o += Read)
+		{
+			Read = Src.readBlock(V.Buf, MIN((ulong)OV_BLOCK, Len - o));
+			if(Read <= 0 || Buf.writeBlock(V.Buf, Read) != Read)	break;
+		}
+		TBuf = FXThread::time() - TBuf;
+
+		Check(SameBytes(Src, WAV_HEADER_SIZE, Dst, WAV_HEADER_SIZE, Len), "WAV copy: CopyRange() result in " + Dir);
+		Check(SameBytes(Src, WAV_HEADER_SIZE, Buf, WAV_HEADER_SIZE, Len), "WAV copy: read/write result in " + Dir);
+
+		Str.format("WAV copy in %s: CopyRange() %.1f ms (%lu bytes cloned, %lu in-kernel, %lu through user space), read/write %.1f ms\n",
+			Dir.text(), (double)TCopy / 1000000.0, (unsigned long)St.Cloned, (unsigned long)St.Kernel, (unsigned long)St.User,
+			(double)TBuf / 1000000.0);
+		BGMLib::UI_Stat(Str);
+	}
+	Src.close();
+	Dst.close();
+	Buf.close();
+	FXFile::remove(SrcFN);
+	FXFile::remove(DstFN);
+	FXFile::remove(BufFN);
+	POOL_RELEASE(V.Buf);
+}
+// ----------------
+
+int SelfTest()
+{
+	FXString Str;
+
+	Failed = 0;
+	BGMLib::UI_Stat("Self-test...\n");
+
+	FadeTest();
+	SeekTest();
+	DeinterleaveTest();
+	PackTest();
+	HTTPTest();
+
+	// Where the scratch files and the extracted tracks go, these can be on different file systems
+	CopyTest(FXSystem::getTempDirectory());
+	if(!OutPath.empty() && OutPath != FXSystem::getTempDirectory())	CopyTest(OutPath);
+
+	Str.format("Self-test done, %d check(s) failed.\n", Failed);
+	BGMLib::UI_Stat(Str);
+	return Failed;
+}
+
+#endif
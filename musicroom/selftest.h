@@ -0,0 +1,17 @@
+// Music Room Interface
+// --------------------
+// selftest.h - Checks and benchmarks of the optimized code paths
+// --------------------
+// "" Nmlgc, 2011
+
+#ifndef MUSICROOM_SELFTEST_H
+#define MUSICROOM_SELFTEST_H
+
+#if defined(_DEBUG) || defined(PROFILING_LIBS)
+// Compares the optimized code paths against their reference versions on the loaded game and times both.
+// Started with "musicroom <game directory> -selftest", never part of normal operation.
+// Returns the number of failed checks.
+int SelfTest();
+#endif
+
+#endif /* MUSICROOM_SELFTEST_H */
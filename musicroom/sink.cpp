@@ -0,0 +1,212 @@
+// Music Room Interface
+// --------------------
+// sink.cpp - Portable audio output sinks
+// --------------------
+// "" Nmlgc, 2011
+
+#include "musicroom.h"
+#include <FXHash.h>
+#include <FXStream.h>
+#include <FXObject.h>
+#include <FXFile.h>
+#include <FXPath.h>
+#include <FXThread.h>
+#include <bgmlib/ui.h>
+#include "extract.h"
+#include "ring.h"
+#include "sink.h"
+
+// Statistics
+// ----------
+void SinkStats::Clear()
+{
+	Blocks = Underruns = Late = 0;
+	MinMargin = forever;
+}
+// ----------
+
+// Base
+// ----
+AudioSink::AudioSink()
+{
+	Freq = 44100;
+	Stats.Clear();
+}
+
+ulong AudioSink::Take(PCMRing& Ring, char* Dst, const ulong& Size, ulong* Pos)
+{
+	ulong Got = Ring.Read(Dst, Size, Pos);
+	FXTime Left = BytesToTime(Ring.Fill());
+
+	// Underrun, rather play silence than stall
+	if(Got < Size)	memset(Dst + Got, 0, Size - Got);
+	if(Left < Stats.MinMargin)	Stats.MinMargin = Left;
+	return Got;
+}
+// ----
+
+// Null
+// ----
+Sink_Null::Sink_Null()
+{
+	Block = NULL;
+	Playing = false;
+	Base = 0;
+	Written = Played = 0;
+}
+
+bool Sink_Null::Init(void* xid)
+{
+	Block = (char*)malloc(BlockSize);
+	return Block != NULL;
+}
+
+void Sink_Null::Exit()
+{
+	Stop();
+	SAFE_FREE(Block);
+}
+
+// Call with <Lock> held
+FXulong Sink_Null::PlayCursor()
+{
+	if(!Playing)	return Played;
+	return (FXulong)((FXThread::time() - Base) * (Freq * BlockAlign / 1000000000.0));
+}
+
+void Sink_Null::Start()
+{
+	FXMutexLock L(Lock);
+
+	if(Playing)	return;
+	Base = FXThread::time() - BytesToTime(Played);
+	Playing = true;
+}
+
+void Sink_Null::Stop()
+{
+	FXMutexLock L(Lock);
+
+	if(!Playing)	return;
+	Played = PlayCursor();
+	Playing = false;
+}
+
+void Sink_Null::Restart()
+{
+	FXMutexLock L(Lock);
+
+	Written = Played = 0;
+	Base = FXThread::time();
+}
+
+FXTime Sink_Null::Stream(PCMRing& Ring, ulong* Pos)
+{
+	FXulong Play;
+	{
+		FXMutexLock L(Lock);
+
+		if(!Playing || !Block)	return forever;	// Start() comes with a wakeup
+
+		Play = PlayCursor();
+		if(Play > Written)
+		{
+			// Nobody refilled the device in time, it played silence
+			Stats.Late++;
+			Written = Play & ~(BlockAlign - 1);
+		}
+		if((Written + BlockSize) > (Play + BufferSize))
+		{
+			// Sleep until there's room for a whole block
+			FXTime Wait = BytesToTime(Written + BlockSize - Play - BufferSize);
+			return MAX(Wait, TIMEOUT / 5);
+		}
+		Written += BlockSize;
+	}
+
+	if(Take(Ring, Block, BlockSize, Pos) < BlockSize)	Stats.Underruns++;
+	Output(Block, BlockSize);
+	Stats.Blocks++;
+	return 0;
+}
+
+Sink_Null::~Sink_Null()
+{
+	SAFE_FREE(Block);
+}
+// ----
+
+// WAV
+// ---
+Sink_WAV::Sink_WAV(const FXString& FN)
+{
+	this->FN = FN;
+	Size = 0;
+	HdrFreq = Freq;
+}
+
+void Sink_WAV::WriteHeader()
+{
+	char Header[WAV_HEADER_SIZE];
+
+	makeheader(Header, Size, HdrFreq);
+	Out.position(0);
+	Out.writeBlock(Header, WAV_HEADER_SIZE);
+	Out.position(0, FXIO::End);
+}
+
+bool Sink_WAV::Init(void* xid)
+{
+	if(!Sink_Null::Init(xid))	return false;
+
+	if(!Out.open(FN, FXIO::Writing))
+	{
+		BGMLib::UI_Stat("ERROR: Couldn't open " + FN + " for writing!\n");
+		return false;
+	}
+	Size = 0;
+	HdrFreq = Freq;
+	WriteHeader();
+	return true;
+}
+
+void Sink_WAV::Output(const char* Buf, const ulong& Len)
+{
+	// RIFF sizes are 32-bit
+	if(!Out.isOpen() || (Size + Len + WAV_HEADER_SIZE) < Size)	return;
+
+	Out.writeBlock(Buf, Len);
+	Size += Len;
+}
+
+// A WAV file only has one sampling rate, so this one is taken from the first track played
+void Sink_WAV::SetFrequency(const ulong& NewFreq)
+{
+	Sink_Null::SetFrequency(NewFreq);
+	if(Size == 0)	HdrFreq = NewFreq;
+}
+
+void Sink_WAV::Exit()
+{
+	Sink_Null::Exit();
+	if(Out.isOpen())
+	{
+		WriteHeader();
+		Out.close();
+	}
+}
+// ---
+
+AudioSink* CreateSink(const FXString& Output)
+{
+	FXString Sel = Output;
+	Sel.lower();
+
+	if(Sel == "null")	return new Sink_Null;
+	if(FXPath::extension(Sel) == "wav")	return new Sink_WAV(Output);
+#ifdef WIN32
+	return new Sink_DSound;
+#else
+	return new Sink_Null;
+#endif
+}
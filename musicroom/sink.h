@@ -0,0 +1,165 @@
+// Music Room Interface
+// --------------------
+// sink.h - Audio output sinks
+// --------------------
+// "" Nmlgc, 2011
+
+#ifndef MUSICROOM_SINK_H
+#define MUSICROOM_SINK_H
+
+#include <FXFile.h>
+#include <FXThread.h>
+
+class PCMRing;
+
+// Playback statistics
+struct SinkStats
+{
+	FXulong	Blocks;	// Blocks played
+	FXulong	Underruns;	// Blocks which had to be padded with silence because the decoder fell behind
+	FXulong	Late;	// Blocks which were written after the device already ran dry
+	FXTime	MinMargin;	// Shortest play time left in the ring after a block was taken, in ns
+
+	void Clear();
+};
+
+// Output device behind the Streamer.
+// Start(), Stop(), Clear() and SetVolume() may be called from any thread, everything else only from the streaming thread.
+class AudioSink
+{
+protected:
+	ulong	Freq;	// Current sampling rate
+	SinkStats	Stats;
+
+	// Reads [Size] bytes out of [Ring] to [Dst], padding underruns with silence. Returns the number of bytes actually read.
+	ulong Take(PCMRing& Ring, char* Dst, const ulong& Size, ulong* Pos);
+
+	// Play time of [Bytes] at the current rate, in ns
+	FXTime BytesToTime(const FXulong& Bytes)	{return (FXTime)(Bytes * 1000000000.0 / (Freq * BlockAlign));}
+
+public:
+	static const int BlockSize = 0x4000;
+	static const int BlockCount = 3;
+	static const int BufferSize = BlockSize * BlockCount;
+	static const int BlockAlign = 4;	// 16-bit stereo
+
+	AudioSink();
+
+	virtual const FXchar* Name() = 0;
+
+	virtual bool Init(void* xid) = 0;	// [xid]: Main window handle
+	virtual void Exit() = 0;
+
+	ulong	Frequency()	{return Freq;}
+	virtual void SetFrequency(const ulong& NewFreq)	{Freq = NewFreq;}
+	virtual void SetVolume(const int& Vol)	{}	// [Vol]: 0-100
+
+	virtual void Start() = 0;	// Starts or resumes playback
+	virtual void Stop() = 0;
+	virtual void Clear() = 0;	// Silences everything still buffered
+	virtual void Restart() = 0;	// Places the write cursor for a new track. Call after filling the ring.
+
+	// Plays the next block from [Ring] if the device has room for it.
+	// Returns 0 if a block was written, otherwise the time in ns until it will have room.
+	virtual FXTime Stream(PCMRing& Ring, ulong* Pos) = 0;
+
+	const SinkStats&	GetStats()	{return Stats;}
+	void	ResetStats()	{Stats.Clear();}	// Call while stopped
+
+	virtual ~AudioSink()	{}
+};
+
+// Discards everything, but consumes it at the nominal rate of a real device
+class Sink_Null : public AudioSink
+{
+protected:
+	FXMutex	Lock;	// Guards the play cursor
+	char*	Block;	// Scratch block
+	bool	Playing;
+	FXTime	Base;	// Point in time where the virtual play cursor was at 0
+	FXulong	Written;	// Bytes written since <Base>
+	FXulong	Played;	// Play cursor while stopped
+
+	FXulong PlayCursor();	// Bytes played since <Base>
+
+	virtual void Output(const char* Buf, const ulong& Size)	{}
+
+public:
+	Sink_Null();
+
+	virtual const FXchar* Name()	{return "null";}
+
+	virtual bool Init(void* xid);
+	virtual void Exit();
+
+	virtual void Start();
+	virtual void Stop();
+	virtual void Clear()	{}
+	virtual void Restart();
+
+	virtual FXTime Stream(PCMRing& Ring, ulong* Pos);
+
+	virtual ~Sink_Null();
+};
+
+// Records everything that would be played into a WAV file, in real time
+class Sink_WAV : public Sink_Null
+{
+protected:
+	FXString	FN;
+	FXFile	Out;
+	ulong	Size;	// Data bytes written
+	ulong	HdrFreq;	// Sampling rate in the header
+
+	void WriteHeader();
+
+	virtual void Output(const char* Buf, const ulong& Len);
+
+public:
+	Sink_WAV(const FXString& FN);
+
+	virtual const FXchar* Name()	{return "wav";}
+
+	virtual bool Init(void* xid);
+	virtual void Exit();
+
+	virtual void SetFrequency(const ulong& NewFreq);
+};
+
+#ifdef WIN32
+#include <dsound.h>
+
+// DirectSound secondary buffer
+class Sink_DSound : public AudioSink
+{
+protected:
+	IDirectSound8* DS;	// Device
+	IDirectSoundBuffer* SB;	// Sound Buffer
+	WAVEFORMATEX Fmt;	// Sample rate
+	ulong	Write;	// Current write cursor
+	int	CurVol;	// Volume currently set on <SB>
+
+public:
+	Sink_DSound();
+
+	virtual const FXchar* Name()	{return "dsound";}
+
+	virtual bool Init(void* xid);
+	virtual void Exit();
+
+	virtual void SetFrequency(const ulong& NewFreq);
+	virtual void SetVolume(const int& Vol);
+
+	virtual void Start();
+	virtual void Stop();
+	virtual void Clear();
+	virtual void Restart();
+
+	virtual FXTime Stream(PCMRing& Ring, ulong* Pos);
+};
+#endif
+
+// Creates the sink selected by the <output> setting
+AudioSink* CreateSink(const FXString& Output);
+
+#endif /* MUSICROOM_SINK_H */
@@ -0,0 +1,184 @@
+// Music Room Interface
+// --------------------
+// sink_ds.cpp - DirectSound output
+// --------------------
+// "" Nmlgc, 2010-2011
+
+#include "musicroom.h"
+#include <bgmlib/ui.h>
+#include "ring.h"
+#include "sink.h"
+
+#ifdef WIN32
+
+Sink_DSound::Sink_DSound()
+{
+	DS = NULL;
+	SB = NULL;
+	Write = 0;
+	CurVol = -1;
+
+	ZeroMemory(&Fmt, sizeof(WAVEFORMATEX));
+}
+
+bool Sink_DSound::Init(void* xid)
+{
+	MMRESULT Ret;
+
+	BGMLib::UI_Stat(L"DirectSound Ʈ ʱȭ ...\n");
+
+	// Fill wave format structure
+	Fmt.wFormatTag = WAVE_FORMAT_PCM;
+	Fmt.nChannels = 2;
+	Fmt.nSamplesPerSec = Freq;
+	Fmt.wBitsPerSample = 16;
+	Fmt.nBlockAlign = (Fmt.wBitsPerSample >> 3) * Fmt.nChannels;
+    Fmt.nAvgBytesPerSec = Fmt.nBlockAlign * Fmt.nSamplesPerSec;
+	Fmt.cbSize = 0;
+
+	Ret = DirectSoundCreate8(NULL, &DS, NULL);
+
+	if(Ret != DS_OK)
+	{
+		BGMLib::UI_Stat(L": DirectSound ġ   ϴ.\nƮ    ϴ.\n");
+		DS = NULL;
+		return false;
+	}
+	
+	Ret = DS->SetCooperativeLevel((HWND)xid, DSSCL_PRIORITY);
+
+	DSBUFFERDESC BD;
+	BD.dwSize = sizeof(DSBUFFERDESC);
+	BD.dwBufferBytes = BufferSize;
+	BD.dwFlags = DSBCAPS_LOCDEFER | DSBCAPS_GETCURRENTPOSITION2 | DSBCAPS_GLOBALFOCUS | DSBCAPS_STICKYFOCUS | DSBCAPS_CTRLVOLUME | DSBCAPS_CTRLFREQUENCY;
+	BD.lpwfxFormat = &Fmt;
+	BD.guid3DAlgorithm = DS3DALG_DEFAULT;
+	BD.dwReserved = 0;
+
+	Ret = DS->CreateSoundBuffer(&BD, &SB, NULL);
+	if(Ret != DS_OK)
+	{
+		SB = NULL;
+		return false;
+	}
+	Clear();
+	return true;
+}
+
+FXTime Sink_DSound::Stream(PCMRing& Ring, ulong* Pos)
+{
+	// Fuck notifications, I'm writing my own, TRANSPARENT system.
+	// We're streaming on each call, unless the new data would extend until after the current play cursor.
+
+	// Since the write cursor is always placed after the play cursor, this will, after starting the process,
+	// result in a "chase" situation, where the (usually faster) write cursor tries to catch up to the play cursor.
+	// Once the buffer end reached it, we wait until it passed again and then slowly fill up the bytes it just passed
+	// without intersecting.
+
+	// So it's basically a reversed version of the internal DirectSound method. And mine is way more sane, if you ask me.
+
+	HRESULT Ret;
+	ulong Play, CurBE;
+	ulong ReadBufferSize[2];
+	char* ReadBuffer[2];
+	bool Short = false;
+
+	if(!SB)	return forever;
+
+	SB->GetCurrentPosition(&Play, NULL);
+	CurBE = Write + BlockSize;
+	
+	if( (CurBE > BufferSize) && Play < (Write - BlockSize))	Play += BufferSize;
+
+	if(BETWEEN_EQUAL(Play, Write, CurBE))
+	{
+		// Sleep until the play cursor left the block
+		FXTime Wait = BytesToTime(CurBE - Play + 4);
+		return MAX(Wait, TIMEOUT / 5);
+	}
+
+	Ret = SB->Lock(Write, BlockSize, (void**)&ReadBuffer[0], &ReadBufferSize[0], (void**)&ReadBuffer[1], &ReadBufferSize[1], 0);
+	if(Ret != DS_OK)	return TIMEOUT / 5;
+
+	for(ushort b = 0; b < 2; b++)
+	{
+		if(!ReadBuffer[b])	continue;
+		if(Take(Ring, ReadBuffer[b], ReadBufferSize[b], Pos) < ReadBufferSize[b])	Short = true;
+	}
+	
+	Ret = SB->Unlock(ReadBuffer[0], ReadBufferSize[0], ReadBuffer[1], ReadBufferSize[1]);
+
+	if(Short)	Stats.Underruns++;
+	Stats.Blocks++;
+
+	Write = CurBE;
+	if(Write > BufferSize)	Write -= BufferSize;
+	return 0;	// Maybe we can write the next one already
+}
+
+void Sink_DSound::SetFrequency(const ulong& NewFreq)
+{
+	AudioSink::SetFrequency(NewFreq);
+	if(SB)	SB->SetFrequency(NewFreq);
+}
+
+void Sink_DSound::SetVolume(const int& Vol)
+{
+	if(!SB || Vol == CurVol)	return;
+	CurVol = Vol;
+
+	long VolLog = log10f(MAX(Vol, 1)) * abs(DSBVOLUME_MIN / 2) + DSBVOLUME_MIN;
+	VolLog = MIN(VolLog, 0);
+	
+	SB->SetVolume(VolLog);
+}
+
+void Sink_DSound::Start()
+{
+	if(SB)	SB->Play(0, 0, DSBPLAY_LOOPING);
+}
+
+void Sink_DSound::Stop()
+{
+	if(SB)	SB->Stop();
+}
+
+void Sink_DSound::Clear()
+{
+	char* b;
+	ulong s;
+
+	if(!SB)	return;
+
+	SB->Lock(0, BufferSize, (void**)&b, &s, NULL, NULL, DSBLOCK_ENTIREBUFFER);
+	ZeroMemory(b, s);
+	SB->Unlock(b, s, NULL, NULL);
+}
+
+void Sink_DSound::Restart()
+{
+	ulong DXWrite = 0, Play = 0, c = 1;
+
+	if(!SB)	return;
+
+	// That was the only case when it was still bugged!
+	while(Play == 0 || DXWrite == 0)
+	{
+		SB->SetCurrentPosition(c += 32);	// Skip a bit ahead to reduce pops and clicks
+		SB->GetCurrentPosition(&Play, &DXWrite);
+		if((Play == 0 || DXWrite == 0) && c > 32 * 4)	FXThread::sleep(TIMEOUT / 5);	// Don't burn the CPU if the device takes its time
+	}
+
+	Write = DXWrite + BlockSize;
+	if(Write > BufferSize)	Write -= BufferSize;
+}
+
+void Sink_DSound::Exit()
+{
+	if(SB)	SB->Release();
+	if(DS)	DS->Release();
+	SB = NULL;
+	DS = NULL;
+}
+
+#endif
@@ -7,152 +7,172 @@
 #include "musicroom.h"
 #include <FXFile.h>
 #include <bgmlib/libvorbis.h>
+#include <bgmlib/bufpool.h>
+#include <FXAtomic.h>
 #include "stream.h"
 #include <bgmlib/packmethod.h>
 #include <bgmlib/ui.h>
 
-#ifdef WIN32
-
 // Initialization
 // --------------
-Streamer::Streamer()
+Streamer::Streamer() : DecLock(true)
 {
 	Active = false;
-	DS = NULL;
-	SB = NULL;
-	Write = 0;
-
-	ZeroMemory(&Fmt, sizeof(WAVEFORMATEX));
+	Cur = new PlayFile;
+	Sink = NULL;
 	Track = NULL;
+	Pos = PosLoop = 0;
+	SwitchReq = SwitchLast = SwitchMax = 0;
+	SwitchBurst = false;
+	SeekReq = false;
+	SeekTime = 0;
+	IndexTrack = NULL;
 }
 
-bool Streamer::Init(void* xid)
+// Events
+// ------
+void StreamEvent::Signal()
 {
-	MMRESULT Ret;
-
-	BGMLib::UI_Stat(L"DirectSound Ʈ ʱȭ ...\n");
-
-	// Fill wave format structure
-	Fmt.wFormatTag = WAVE_FORMAT_PCM;
-	Fmt.nChannels = 2;
-	Fmt.nSamplesPerSec = 44100;
-	Fmt.wBitsPerSample = 16;
-	Fmt.nBlockAlign = (Fmt.wBitsPerSample >> 3) * Fmt.nChannels;
-    Fmt.nAvgBytesPerSec = Fmt.nBlockAlign * Fmt.nSamplesPerSec;
-	Fmt.cbSize = 0;
+	FXMutexLock Lock(M);
+	Set = true;
+	C.signal();
+}
 
-	Ret = DirectSoundCreate8(NULL, &DS, NULL);
+bool StreamEvent::Wait(const FXTime& Timeout)
+{
+	bool Ret;
+	FXMutexLock Lock(M);
 
-	if(Ret != DS_OK)
+	while(!Set)
 	{
-		BGMLib::UI_Stat(L": DirectSound ġ   ϴ.\nƮ    ϴ.\n");
+		if(!C.wait(M, Timeout))	break;
 	}
-	else	Active = true;
-	
-	Ret = DS->SetCooperativeLevel((HWND)xid, DSSCL_PRIORITY);
-
-	DSBUFFERDESC BD;
-	BD.dwSize = sizeof(DSBUFFERDESC);
-	BD.dwBufferBytes = BlockSize * BlockCount;
-	BD.dwFlags = DSBCAPS_LOCDEFER | DSBCAPS_GETCURRENTPOSITION2 | DSBCAPS_GLOBALFOCUS | DSBCAPS_STICKYFOCUS | DSBCAPS_CTRLVOLUME | DSBCAPS_CTRLFREQUENCY;
-	BD.lpwfxFormat = &Fmt;
-	BD.guid3DAlgorithm = DS3DALG_DEFAULT;
-	BD.dwReserved = 0;
+	Ret = Set;
+	Set = false;
+	return Ret;
+}
+// ------
 
-	Ret = DS->CreateSoundBuffer(&BD, &SB, NULL);
-	ClearBuffer();
+bool Streamer::Init(void* xid)
+{
+	Sink = CreateSink(AudioOut);
+	Active = Sink->Init(xid);
+	if(!Active)	return false;
 
+	FitRing(Sink->Frequency());	// Resized on track switches
+	Pre.start();
 	return Active;
 }
 
-FXint Streamer::run()
+FXint StreamDecoder::run()
 {
-	ulong Play, CurBE;
-	StopReq = false;
+	Streamer& Str = Streamer::Inst();
+	bool Idle;
 
 	while(!StopReq)
 	{
-		sleep(TIMEOUT);
-		if(New)
 		{
-			if(!ActiveGame->Scanned)	New = NULL;
-			SwitchTrack();
+			FXMutexLock Lock(Str.DecLock);
+			Idle = !Str.Decode(Streamer::DecodeSize);
 		}
-		else if(Track && CurFile.isOpen())
-		{
-			SetVolume();
-
-			// Fuck notifications, I'm writing my own, TRANSPARENT system.
-			// We're streaming on each call, unless the new data would extend until after the current play cursor.
+		// Ring full or nothing to decode, sleep until the streaming loop made some room or switched tracks
+		if(Idle)	Str.DecEvent.Wait();
+	}
+	return 1;
+}
 
-			// Since the write cursor is always placed after the play cursor, this will, after starting the process,
-			// result in a "chase" situation, where the (usually faster) write cursor tries to catch up to the play cursor.
-			// Once the buffer end reached it, we wait until it passed again and then slowly fill up the bytes it just passed
-			// without intersecting.
+FXint Streamer::run()
+{
+	FXTime Wait;
+	StopReq = false;
 
-			// So it's basically a reversed version of the internal DirectSound method. And mine is way more sane, if you ask me.
+	Dec.StopReq = false;
+	Dec.start();
 
-			SB->GetCurrentPosition(&Play, NULL);
-			CurBE = Write + BlockSize;
-			
-			if( (CurBE > BufferSize) && Play < (Write - BlockSize))	Play += BufferSize;
+	while(!StopReq)
+	{
+		Wait = forever;	// Nothing to do until the next command
 
-			if(!BETWEEN_EQUAL(Play, Write, CurBE))
+		Sink->SetVolume(Volume);
+		if(New)
+		{
+			if(!ActiveGame->Scanned)
 			{
-				if(StreamFrame(Write, BlockSize))	Write = CurBE;
-				if(Write > BufferSize)	Write -= BufferSize;
+				New = NULL;
+				SwitchTrack(NULL);
+				Wait = 0;
 			}
+			else	Wait = PollSwitch();
 		}
+		if(SeekReq)
+		{
+			SeekReq = false;
+			if(!New)	Seek((ulong)SeekTime);	// A pending switch makes it pointless
+		}
+		// Keep playing the old track while the new one is loading
+		if(Wait && ActiveGame && Track && Cur->File.isOpen())
+		{
+			// The sink only copies from <Ring>, the decoding is done by <Dec>
+			ulong Last = Pos;
+			FXTime StreamWait = Sink->Stream(Ring, &Pos);
+			if(Pos < Last)	PosLoop++;	// Wrapped from the loop end back to the loop start
+			if(!StreamWait)	DecEvent.Signal();
+			Wait = MIN(Wait, StreamWait);
+		}
+		if(Wait)	Cmd.Wait(Wait);
 	}
+	Dec.StopReq = true;
+	DecEvent.Signal();
+	Dec.join();
+
 	StopReq = false;
 	detach();
 	return 1;
 }
 
-void Streamer::StreamFrame_WAV(char* Buffer, const ulong& Size)
+ulong Streamer::Decode_WAV(char* Buffer, const ulong& Size)
 {
-	Pos = pcm_read_bgm(CurFile, Buffer, Size, Track);
+	return pcm_read_bgm(Cur->File, Buffer, Size, Track, &Cur->Splice);
 }
 
-void Streamer::StreamFrame_OGG(char* Buffer, const ulong& Size)
+ulong Streamer::Decode_OGG(char* Buffer, const ulong& Size)
 {
-	Pos = ov_read_bgm(&SF, Buffer, Size, Track);
+	return (ulong)ov_read_bgm(&Cur->SF, Buffer, Size, Track, &Cur->Splice);
 }
 
-bool Streamer::StreamFrame(const ulong& Offset, const ulong& Size)
+bool Streamer::Decode(const ulong& Size)
 {
-	if(!ActiveGame)	return false;
+	ulong Len, NewPos;
+	char* Dst;
 
-	HRESULT Ret;
-	ulong ReadBufferSize[2];
-	char* ReadBuffer[2];
+	if(!ActiveGame || !Track || !Cur->File.isOpen())	return false;
 
-	Ret = SB->Lock(Offset, Size, (void**)&ReadBuffer[0], &ReadBufferSize[0], (void**)&ReadBuffer[1], &ReadBufferSize[1], 0);
+	Dst = Ring.WriteSpan(Len);
+	Len = MIN(Len, Size) & ~3;
+	if(!Len)	return false;
 
-	for(ushort b = 0; b < 2; b++)
-	{
-		if(ActiveGame->Vorbis)	StreamFrame_OGG(ReadBuffer[b], ReadBufferSize[b]);
-		else					StreamFrame_WAV(ReadBuffer[b], ReadBufferSize[b]);
-	}
-	
-	Ret = SB->Unlock(ReadBuffer[0], ReadBufferSize[0], ReadBuffer[1], ReadBufferSize[1]);
+	if(ActiveGame->Vorbis)	NewPos = Decode_OGG(Dst, Len);
+	else					NewPos = Decode_WAV(Dst, Len);
+
+	Ring.Commit(Len, NewPos);
 	return true;
 }
 
 bool Streamer::SwitchTrack_WAV(TrackInfo* NewTrack, FXString& NewFN)
 {
 	FXuint NewFNHash = NewFN.hash();
-	if(!Track || !CurFile.isOpen() || (CurFNHash != NewFNHash) )
+	if(!Track || !Cur->File.isOpen() || (Cur->FNHash != NewFNHash) )
 	{
 		CloseFile();
 
-		if(!ActiveGame->OpenBGMFile(CurFile, NewTrack))	return false;
+		if(!ActiveGame->OpenBGMFile(Cur->File, NewTrack))	return false;
 	}
 	Pos = NewTrack->GetStart(FMT_BYTE, SilResolve());
-	CurFile.position(Pos);
+	Cur->File.position(Pos);
+	Cur->Splice.Reset(NewTrack);
 
-	SB->SetFrequency(NewTrack->Freq);
-	CurFNHash = NewFNHash;
+	Sink->SetFrequency(NewTrack->Freq);
+	Cur->FNHash = NewFNHash;
 
 	return true;
 }
@@ -166,160 +186,413 @@ bool Streamer::SwitchTrack_OGG(TrackInfo* NewTrack, FXString& NewFN)
 		CloseFile();
 
 		if(!DumpDecrypt(ActiveGame, NewTrack, OggPlayFile))	return false;
-		CurFile.open(OggPlayFile, FXIO::Reading);
-		ov_open_callbacks(&CurFile, &SF, NULL, 0, OV_CALLBACKS_FXFILE);
+		Cur->TempFN = OggPlayFile;
+		Cur->File.open(OggPlayFile, FXIO::Reading);
+		ov_open_callbacks(&Cur->File, &Cur->SF, NULL, 0, OV_CALLBACKS_FXFILE);
 	}
-	else if(Track && CurFNHash == NewFNHash)
+	else if(Track && Cur->FNHash == NewFNHash)
 	{
-		ov_pcm_seek(&SF, NewTrack->GetStart(FMT_SAMPLE, SilResolve()));
+		ov_pcm_seek(&Cur->SF, NewTrack->GetStart(FMT_SAMPLE, SilResolve()));
 	}
 	else
 	{
 		CloseFile();
 
-		if(!OpenVorbisBGM(CurFile, SF, ActiveGame, NewTrack))	return false;
+		if(!OpenVorbisBGM(Cur->File, Cur->SF, ActiveGame, NewTrack))	return false;
 	}
-	SB->SetFrequency(NewTrack->Freq);
-	CurFNHash = NewFNHash;
+	Cur->Splice.Reset(NewTrack);
+	Sink->SetFrequency(NewTrack->Freq);
+	Cur->FNHash = NewFNHash;
 	
 	return true;
 }
 
+void Streamer::LoadPrefetched()
+{
+	ulong Off = 0, Len, Chunk;
+	char* Dst;
+
+	for(int c = 0; c < Cur->Chunks; c++)
+	{
+		Chunk = MIN((ulong)DecodeSize, Cur->Len - Off);
+		Dst = Ring.WriteSpan(Len);
+		if(Len < Chunk)	break;
+
+		memcpy(Dst, Cur->Buf + Off, Chunk);
+		Ring.Commit(Chunk, Cur->ChunkPos[c]);
+		Off += Chunk;
+	}
+	// Don't need that anymore
+	POOL_RELEASE(Cur->Buf);
+	Cur->Len = 0;
+	Cur->Chunks = 0;
+}
+
 // Always called by thread
-bool Streamer::SwitchTrack()
+bool Streamer::CheapSwitch(TrackInfo* NewTrack)
 {
-	bool Ret;
+	if(!Track || !Cur->File.isOpen() || ActiveGame->CryptKind)	return false;
+	return Cur->FNHash == ActiveGame->DiskFN(NewTrack).hash();
+}
 
+FXTime Streamer::PollSwitch()
+{
 	TrackInfo* Load = New;
-	// SB->Stop();
-	ClearBuffer();
+	FXTime Left;
+
+	// Whatever is still loading for an older selection is useless now
+	Pre.Cancel(Load);
+
+	if(!Load)	return 0;
+	if(CheapSwitch(Load))
+	{
+		SwitchTrack(Load);
+		return 0;
+	}
+
+	switch(Pre.State(Load))
+	{
+	case TrackPrefetch::LOAD_READY:
+		SwitchTrack(Load);
+		return 0;
+
+	case TrackPrefetch::LOAD_FAILED:
+		atomicCas((void* volatile*)&New, Load, NULL);
+		return 0;
+
+	case TrackPrefetch::LOAD_BUSY:
+		return forever;	// We get woken up once it's done
+
+	default:
+		break;
+	}
+
+	// Someone is scrolling through the list, wait until the selection settles
+	{
+		FXMutexLock L(SwitchLock);
+		Left = SwitchReq + SwitchDelay - FXThread::time();
+		if(SwitchBurst && Left > 0)	return Left;
+	}
+
+	Pre.Load(Load);
+	return forever;
+}
+
+bool Streamer::FitRing(const ulong& Freq)
+{
+	// The ring has to take a whole prefetched track start at once
+	ulong Bytes = MAX(MAX(Freq * AudioSink::BlockAlign / 1000 * StreamBuffer, (ulong)AudioSink::BufferSize * 2), (ulong)PrefetchSize);
+
+	// Create() rounds up to a power of 2
+	if(Ring.Capacity() >= Bytes && Ring.Capacity() < Bytes * 2)	return true;
+	return Ring.Create(Bytes);
+}
+
+// Always called by thread
+bool Streamer::SwitchTrack(TrackInfo* Load)
+{
+	bool Ret;
+
+	// The prefetcher might not be able to finish while we hold <DecLock>
+	if(Load)	Pre.WaitFor(Load);
+
+	FXMutexLock Lock(DecLock);
+
+	bool Prefetched;
+	// Sink->Stop();
+	Sink->Clear();
+	Ring.Reset();
 		
-	if(!New)
+	if(!Load)
 	{
 		Track = NULL;
 		return true;
 	}
 
-	do
+	Prefetched = Ret = Pre.Take(Load, Cur);
+	if(Prefetched)
+	{
+		Sink->SetFrequency(Load->Freq);
+		if(!ActiveGame->Vorbis)	Pos = Load->GetStart(FMT_BYTE, SilResolve());
+	}
+	else
 	{
-		if(Load != New)	Load = New;
-
 		FXString NewFN = ActiveGame->DiskFN(Load);
 
 		if(ActiveGame->Vorbis)	Ret = SwitchTrack_OGG(Load, NewFN);
 		else					Ret = SwitchTrack_WAV(Load, NewFN);
 	}
-	while(Load != New);	// ... yeah, maybe someone scrolls through very fast and already changed [New] to a different track than the one we loaded
 
-	if(!Ret)
+	// Unless there's already an even newer one
+	atomicCas((void* volatile*)&New, Load, NULL);
+
+	if(!Ret)	return Ret;
+
+	// <Dec> is locked out and the sink is only fed from this thread
+	if(!FitRing(Load->Freq))
 	{
-		New = NULL;
-		return Ret;
+		Track = NULL;
+		return false;
 	}
 
 	Track = Load;
-	New = Load = NULL;
+	Pos = Load->GetStart(ActiveGame->Vorbis ? FMT_SAMPLE : FMT_BYTE, SilResolve());
+	PosLoop = 0;
 	
 	// Initial load
 	// ------------
-	ulong DXWrite = 0, Play = 0, c = 1;
+	if(Prefetched)	LoadPrefetched();
+	while(Ring.Fill() < AudioSink::BufferSize && Decode(DecodeSize));
+	DecEvent.Signal();
+
+	Sink->Restart();
+	// ------------
+
+	if(!StopReq)	Sink->Start();
 
-	// That was the only case when it was still bugged!
-	while(Play == 0 || DXWrite == 0)
 	{
-		SB->SetCurrentPosition(c += 32);	// Skip a bit ahead to reduce pops and clicks
-		SB->GetCurrentPosition(&Play, &DXWrite);
+		FXMutexLock L(SwitchLock);
+		SwitchLast = FXThread::time() - SwitchReq;
+		SwitchMax = MAX(SwitchMax, SwitchLast);
 	}
 
-	// StreamFrame(DXWrite, BlockSize);
+	Pre.Neighbors(Track);
+	return Ret;
+}
 
-	Write = DXWrite + BlockSize;
-	if(Write > BufferSize)	Write -= BufferSize;
-	// ------------
+void Streamer::RequestTrackSwitch(TrackInfo* NewTrack)
+{
+	FXTime Now;
+
+	if(NewTrack != Track || New)
+	{
+		Now = FXThread::time();
+		{
+			FXMutexLock L(SwitchLock);
+			SwitchBurst = (Now - SwitchReq) < SwitchDelay;
+			SwitchReq = Now;
+		}
+		atomicSet((void* volatile*)&New, (NewTrack != Track) ? NewTrack : NULL);	// Back to the current one cancels the request
+		Wake();
+	}
+}
+
+void Streamer::RequestSeek(const ulong& Time)
+{
+	SeekTime = Time;
+	SeekReq = true;
+	Wake();
+}
+
+ulong Streamer::TimelineToSource(TrackInfo* TI, const ulong& Time, const bool& Fmt, ulong* LoopNum)
+{
+	ulong S, L, E, Ret;
+	FXulong T = Time;
+
+	if(Fmt == FMT_BYTE)	T <<= 2;
 
-	if(!StopReq)	SB->Play(0, 0, DSBPLAY_LOOPING);
+	TI->GetPos(Fmt, false, NULL, &L, &E);
+	S = TI->GetStart(Fmt, SilResolve());
+	if(L == E || L < S)	L = S;	// No loop, the readers wrap around to the start
+
+	if(LoopNum)	*LoopNum = 0;
+	if(E <= S)	return S;
+	if(T < (E - S))	return S + (ulong)T;
+
+	T -= (E - S);
+	Ret = L + (ulong)(T % (E - L));
+	if(LoopNum)	*LoopNum = (ulong)(T / (E - L)) + 1;
 	return Ret;
 }
 
-void Streamer::SetVolume()
+ulong Streamer::SourceToTimeline(TrackInfo* TI, const ulong& Src, const ulong& LoopNum, const bool& Fmt)
 {
-	long VolLog = log10f(MAX(Volume, 1)) * abs(DSBVOLUME_MIN / 2) + DSBVOLUME_MIN;
-	VolLog = MIN(VolLog, 0);
-	
-	SB->SetVolume(VolLog);
+	ulong S, L, E;
+	FXulong T;
+
+	TI->GetPos(Fmt, false, NULL, &L, &E);
+	S = TI->GetStart(Fmt, SilResolve());
+	if(L == E || L < S)	L = S;
+
+	if(Src < S || E <= S)	return 0;
+	if(LoopNum == 0 || E <= L || Src < L)	T = Src - S;
+	else	T = (FXulong)(E - S) + (FXulong)(LoopNum - 1) * (E - L) + (Src - L);
+
+	if(Fmt == FMT_BYTE)	T >>= 2;
+	return (ulong)T;
 }
 
-void Streamer::RequestTrackSwitch(TrackInfo* NewTrack)
+// Always called by thread
+void Streamer::Seek(const ulong& Time)
 {
-	if(NewTrack != Track)	New = NewTrack;
+	FXMutexLock Lock(DecLock);
+	ulong Src;
+
+	if(!ActiveGame || !Track || !Cur->File.isOpen())	return;
+
+	Sink->Clear();
+	Ring.Reset();
+
+	if(ActiveGame->Vorbis)
+	{
+		if(IndexTrack != Track)
+		{
+			// Once per track, that's cheaper than letting every seek bisect the file
+			ulong E;
+			Track->GetPos(FMT_SAMPLE, false, NULL, NULL, &E);
+			Index.Build(&Cur->SF, Track->GetStart(FMT_SAMPLE, false), E);
+			IndexTrack = Track;
+		}
+		Src = TimelineToSource(Track, Time, FMT_SAMPLE, &PosLoop);
+		ov_pcm_seek_indexed(&Cur->SF, &Index, Src);
+	}
+	else
+	{
+		Src = TimelineToSource(Track, Time, FMT_BYTE, &PosLoop);
+		Cur->File.position(Src);
+	}
+	Cur->Splice.Skip();
+	Pos = Src;
+
+	while(Ring.Fill() < AudioSink::BufferSize && Decode(DecodeSize));
+	DecEvent.Signal();
+
+	Sink->Restart();
+	if(!StopReq)	Sink->Start();
 }
 
 void Streamer::Play()
 {
-	if(!New)	SB->Play(0, 0, DSBPLAY_LOOPING);	// Fixes game/track switching artifacts from the last song
+	if(!New)	Sink->Start();	// Fixes game/track switching artifacts from the last song
 	if(!running())	start();			// (SwitchTrack will turn the stream back on in those cases)
 	StopReq = false;
+	Wake();
 }
 
 void Streamer::Stop()
 {
 	if(running())	StopReq = true;
-	if(SB)	SB->Stop();
+	Wake();
+	if(Sink)	Sink->Stop();
 	while(StopReq && !New)
 	{
 		sleep(TIMEOUT);
 	}
 }
 
-void Streamer::ClearBuffer()
-{
-	char* b;
-	ulong s;
-
-	if(!Active)	return;
-
-	SB->Lock(0, BufferSize, (void**)&b, &s, NULL, NULL, DSBLOCK_ENTIREBUFFER);
-	ZeroMemory(b, s);
-	SB->Unlock(b, s, NULL, NULL);
-}
-
 void Streamer::CloseFile()
 {
-	if(CurFile.isOpen())
-	{
-		ov_clear(&SF);
-		CurFile.close();
-		Track = NULL;
-	}
+	FXMutexLock Lock(DecLock);
+
+	if(Cur->File.isOpen())	Track = NULL;
+	Cur->Close();
+	Index.Clear();
+	IndexTrack = NULL;
 	FXFile::remove(OggPlayFile);
-	ClearBuffer();	// Necessary for game switches!
+	if(Active)	Sink->Clear();	// Necessary for game switches!
 }
 
 void Streamer::Exit()
 {
-	if(!Active)	return;
+	FXString Str;
+
+	if(!Active)
+	{
+		SAFE_DELETE(Sink);
+		return;
+	}
 
 	Stop();
+	Pre.Exit();
 	CloseFile();
+	Ring.Clear();
+
+	Sink->Exit();
 
-	SB->Release();
-	DS->Release();
+	const SinkStats& S = Sink->GetStats();
+	if(S.Blocks)
+	{
+		Str.format("Streamer statistics (%s): %u blocks, %u underruns, %u late, minimum decode-ahead %u ms, maximum switch latency %u ms.\n",
+			Sink->Name(), (FXuint)S.Blocks, (FXuint)S.Underruns, (FXuint)S.Late, (FXuint)(S.MinMargin / 1000000), (FXuint)(SwitchLatencyMax() / 1000000));
+		BGMLib::UI_Stat(Str);
+	}
 	BGMLib::UI_Stat("Streamer closed.\n");
+	SAFE_DELETE(Sink);
 	Active = false;
 }
 
-#endif
-
 // Front end
 // ---------
 bool StreamerFront::Init(void* xid)	{return Streamer::Inst().Init(xid);}
 TrackInfo* StreamerFront::CurTrack()	{return Streamer::Inst().Track;}
 void StreamerFront::RequestTrackSwitch(TrackInfo* NewTrack)	{return Streamer::Inst().RequestTrackSwitch(NewTrack);}
+void StreamerFront::SetVolume()	{return Streamer::Inst().Wake();}
 void StreamerFront::Play()	{return Streamer::Inst().Play();}
 void StreamerFront::Stop()	{return Streamer::Inst().Stop();}
-void StreamerFront::CloseFile()	{return Streamer::Inst().CloseFile();}
+void StreamerFront::Seek(const ulong& Time)	{return Streamer::Inst().RequestSeek(Time);}
+void StreamerFront::Prefetch(TrackInfo* TI)	{return Streamer::Inst().Pre.Hint(TrackPrefetch::HINT_HOVER, TI);}
 void StreamerFront::Exit()	{return Streamer::Inst().Exit();}
 
+void StreamerFront::CloseFile()
+{
+	Streamer& Str = Streamer::Inst();
+	Str.Pre.Drop();
+	Str.CloseFile();
+}
+
+#ifdef PROFILING_LIBS
+void StreamerFront::Benchmark(const FXTime& Dur)
+{
+	Streamer& Str = Streamer::Inst();
+	ListEntry<TrackInfo>* CurTI;
+	FXTime Lat, LatSum = 0, LatMax = 0;
+	FXuint Tracks = 0, Switched = 0;
+	FXString Msg;
+
+	if(!Str.Active || !ActiveGame || !ActiveGame->Scanned)	return;
+
+	Str.Stop();
+	Str.Sink->ResetStats();
+
+	CurTI = ActiveGame->Track.First();
+	while(CurTI)
+	{
+		FXTime Req = FXThread::time();
+
+		Str.RequestTrackSwitch(&CurTI->Data);
+		Str.Play();
+		FXThread::sleep(Dur);
+		Tracks++;
+
+		// Only counts if this switch is the one that finished
+		Lat = Str.SwitchLatency();
+		if(Str.Track == &CurTI->Data && Lat <= (FXThread::time() - Req))
+		{
+			LatSum += Lat;
+			LatMax = MAX(LatMax, Lat);
+			Switched++;
+		}
+		CurTI = CurTI->Next();
+	}
+	Str.Stop();
+
+	const SinkStats& S = Str.Stats();
+	Msg.format("Playback benchmark (%s, %u of %u tracks switched, %u ms each): %u blocks, %u underruns, %u late, minimum decode-ahead %u ms, switch latency %u ms average, %u ms maximum.\n",
+		Str.Sink->Name(), Switched, Tracks, (FXuint)(Dur / 1000000), (FXuint)S.Blocks, (FXuint)S.Underruns, (FXuint)S.Late,
+		(FXuint)(S.Blocks ? S.MinMargin / 1000000 : 0), (FXuint)(Switched ? LatSum / Switched / 1000000 : 0), (FXuint)(LatMax / 1000000));
+	BGMLib::UI_Stat(Msg);
+}
+#endif
+
+ulong StreamerFront::Time()
+{
+	Streamer& Str = Streamer::Inst();
+	TrackInfo* TI = Str.Track;
+	if(!TI || !ActiveGame)	return 0;
+
+	return Streamer::SourceToTimeline(TI, Str.Pos, Str.PosLoop, ActiveGame->Vorbis ? FMT_SAMPLE : FMT_BYTE);
+}
+
 ulong StreamerFront::Pos()
 {
 	Streamer& Str = Streamer::Inst();
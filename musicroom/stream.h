@@ -7,17 +7,165 @@
 #ifndef MUSICROOM_STREAM_H
 #define MUSICROOM_STREAM_H
 
-#ifdef WIN32
-#include <dsound.h>
-
 #include <FXHash.h>
 #include <FXStream.h>
 #include <FXObject.h>
 #include <FXThread.h>
+#include "ring.h"
+#include "sink.h"
+
+// Auto-resetting event
+class StreamEvent
+{
+protected:
+	FXMutex	M;
+	FXCondition	C;
+	bool	Set;
+
+public:
+	StreamEvent()	{Set = false;}
+
+	void Signal();
+	bool Wait(const FXTime& Timeout = forever);	// Returns true if signaled, false on timeout
+};
+
+// Opened BGM file of a single track, optionally with the first few decoded chunks
+struct PlayFile
+{
+	static const int MaxChunks = 64;
+
+	TrackInfo*	Track;	// Only set on prefetched files
+	FXFile	File;
+	OggVorbis_File	SF;
+	FXString	TempFN;	// Decrypted temporary file, removed on Close()
+	FXuint	FNHash;	// Hash of the BGM file name
+	bool	Sil;	// SilResolve() at the time of opening
+
+	// Pre-decoded PCM, in chunks of <Streamer::DecodeSize> bytes
+	char*	Buf;
+	ulong	Len;
+	ulong	ChunkPos[MaxChunks];	// Stream position after each chunk
+	int	Chunks;
+
+	LoopSplice	Splice;	// Loop transition, follows the file from the prefetcher to the Streamer
+
+	PlayFile();
+	void Close();
+};
+
+// One-off thread opening a track the user switched to.
+// Superseded loaders are only cancelled and left to finish on their own, so that a new request never has to wait for an old one.
+class TrackLoader : public FXThread
+{
+public:
+	TrackInfo*	Track;
+	GameInfo*	Game;
+	PlayFile*	File;
+	volatile bool	Cancel;
+	volatile FXint	Done;
+	bool	Ret;
+
+	TrackLoader(TrackInfo* TI, GameInfo* GI);
+
+	virtual FXint run();
+
+	~TrackLoader();
+};
+
+// Low-priority worker which opens and pre-decodes the tracks the user is likely to select next,
+// so that switching to them only has to copy the decoded start into the ring.
+class TrackPrefetch : public FXThread
+{
+public:
+	enum HintType
+	{
+		HINT_NEXT = 0,	// In order of priority
+		HINT_PREV,
+		HINT_HOVER,
+		HINT_COUNT
+	};
+
+	enum LoadState
+	{
+		LOAD_NONE = 0,	// Neither prepared nor being loaded
+		LOAD_BUSY,
+		LOAD_READY,	// Can be taken
+		LOAD_FAILED
+	};
+
+protected:
+	friend class TrackLoader;
+
+	FXMutex	Lock;	// Guards everything below
+	FXMutex	Work;	// Held while preparing a slot. Always lock before <Lock>!
+	FXMutex	Crypt;	// Held while decrypting. Superseded loaders and the prefetcher would otherwise all decrypt whole tracks at once.
+	StreamEvent	Event;	// Signaled on new hints
+
+	TrackInfo*	Want[HINT_COUNT];
+	PlayFile*	Slot[HINT_COUNT];
+	PlayFile*	Busy;	// Slot currently being prepared
+	TrackInfo*	BusyTrack;
+	FXuint	TempID;	// Counter for temporary file names
+
+	TrackLoader*	Loader;	// Current switch request
+	List<TrackLoader*>	Stale;	// Cancelled loaders which are still running
+
+	volatile bool StopReq;
+	volatile bool Abort;	// Cancels the current preparation
+
+	PlayFile* NextJob(TrackInfo*& TI);	// Call with <Lock> held
+	bool Wanted(TrackInfo* TI);	// Call with <Lock> held
+	void Retire();	// Cancels <Loader>. Call with <Lock> held.
+	void Reap(const bool& Wait = false);	// Deletes finished stale loaders. Call with <Lock> held, unless [Wait]ing for all of them.
+
+	// Opens [TI] into [P] and decodes its start. Gives up as soon as [Cancel] is set.
+	bool Prepare(PlayFile* P, TrackInfo* TI, GameInfo* GI, volatile bool& Cancel);
+
+public:
+	TrackPrefetch();
+
+	virtual FXint run();
+
+	void Hint(const HintType& Type, TrackInfo* TI);
+	void Neighbors(TrackInfo* TI);	// Wants the tracks before and after [TI]
+
+	// Switch loading
+	// --------------
+	void Load(TrackInfo* TI);	// Starts opening [TI] in a new thread, cancelling any other request
+	void Cancel(TrackInfo* Keep);	// Cancels the current request, unless it's loading [Keep]
+	LoadState State(TrackInfo* TI);
+	// --------------
+
+	// Blocks until the prefetcher is done with [TI], if it's working on it right now.
+	// Never call with <Streamer::DecLock> held.
+	void WaitFor(TrackInfo* TI);
+
+	// If [TI] has been prefetched or loaded, swaps the prepared file into [Cur] and closes the old one.
+	// Returns false if [TI] isn't ready. Never blocks on a preparation in progress.
+	bool Take(TrackInfo* TI, PlayFile*& Cur);
+
+	void Drop();	// Forgets all hints, cancels loading and closes every slot. Call before switching games.
+	void Exit();
+
+	~TrackPrefetch();
+};
+
+// Decode-ahead thread, keeps <Streamer::Ring> filled
+class StreamDecoder : public FXThread
+{
+public:
+	volatile bool StopReq;	// Set true to request thread stopping
+
+	StreamDecoder()	{StopReq = false;}
+	virtual FXint run();
+};
 
 class Streamer : public FXThread, FXObject
 {
 	friend class StreamerFront;
+	friend class StreamDecoder;
+	friend class TrackPrefetch;
+	friend class TrackLoader;
 
 private:
 	Streamer();
@@ -28,51 +176,89 @@ protected:
 	// Streaming File Information
 	// --------------------------
 	TrackInfo* Track;
-	TrackInfo* New;	// Track switch queue
-	FXFile	CurFile;
-	FXuint CurFNHash;
+	TrackInfo* volatile New;	// Track switch queue
+	PlayFile*	Cur;
 	ulong	Pos;
+	ulong	PosLoop;	// Pass through the loop that <Pos> is in, 0 being the intro
 	// --------------------------
 
-	// DirectSound API
-	IDirectSound8* DS;	// Device
-	WAVEFORMATEX Fmt;	// Sample rate
+	// Seeking
+	// -------
+	volatile bool	SeekReq;
+	volatile ulong	SeekTime;	// Requested timeline position, in samples
+	OggPageIndex	Index;	// Page index of <IndexTrack>, built on its first seek
+	TrackInfo*	IndexTrack;
+
+	void Seek(const ulong& Time);
+	// -------
 
-	// Vorbis Stuff
-	OggVorbis_File SF;
+	AudioSink*	Sink;	// Output device
+
+	TrackPrefetch	Pre;
 
-	// Streaming Blocks
-	IDirectSoundBuffer* SB;	// Sound Buffer
-	ulong	Write;	// Current write cursor
 	volatile bool StopReq;	// Set true to request thread stopping
 
-	void StreamFrame_WAV(char* Buffer, const ulong& Size);
-	void StreamFrame_OGG(char* Buffer, const ulong& Size);
-	bool StreamFrame(const ulong& Offset, const ulong& Size); // Streaming Loop Function
-	
+	// Decode-ahead
+	// ------------
+	PCMRing	Ring;	// Decoded PCM, written by <Dec>, read by the streaming loop
+	StreamDecoder	Dec;
+	FXMutex	DecLock;	// Held while decoding. Lock it to access the file or <Track> from another thread.
+	StreamEvent	DecEvent;	// Signaled whenever the decoder might be able to continue
+
+	ulong Decode_WAV(char* Buffer, const ulong& Size);
+	ulong Decode_OGG(char* Buffer, const ulong& Size);
+	bool Decode(const ulong& Size);	// Decodes [Size] bytes into <Ring>. Call with <DecLock> held.
+	// ------------
+
+	StreamEvent	Cmd;	// Signaled on commands, wakes up the streaming loop
+
+	// Track switch latency, from the request until the new track starts playing.
+	// Requests come from the GUI thread, so all of this is guarded by <SwitchLock>.
+	FXMutex	SwitchLock;
+	FXTime	SwitchReq;
+	FXTime	SwitchLast;
+	FXTime	SwitchMax;
+	bool	SwitchBurst;	// Last request followed the previous one within <SwitchDelay>
+
 	bool SwitchTrack_WAV(TrackInfo* NewTrack, FXString& NewFN);
 	bool SwitchTrack_OGG(TrackInfo* NewTrack, FXString& NewFN);
-	bool SwitchTrack();
+	void LoadPrefetched();	// Copies the pre-decoded chunks of <Cur> into <Ring>
+	bool CheapSwitch(TrackInfo* NewTrack);	// Can we switch to [NewTrack] by just seeking in <Cur>?
+	bool SwitchTrack(TrackInfo* Load);
+	bool FitRing(const ulong& Freq);	// Sizes <Ring> for <StreamBuffer> ms at [Freq]. Neither side may be active during the call!
+	FXTime PollSwitch();	// Handles <New>. Returns the time until there's something to do again.
 
 public:
-	static const int BlockSize = 0x4000;
-	static const int BlockCount = 3;
-	static const int BufferSize = BlockSize * BlockCount;
+	static const int DecodeSize = 0x1000;	// Decoder chunk size
+	static const int PrefetchSize = (44100 * AudioSink::BlockAlign / DecodeSize) * DecodeSize;	// Pre-decoded on prefetching, about a second at 44.1 kHz
+	static const FXTime SwitchDelay = 50000000;	// Debounce window for rapid track selection changes
 	
 	virtual FXint run();	// Thread loop, runs streaming and track switching
 
-	bool Init(void* xid);
+	bool Init(void* xid);	// Sets up the sink selected by <AudioOut>
 
-	void SetVolume();
+	void Wake()	{Cmd.Signal();}
 
 	void RequestTrackSwitch(TrackInfo* NewTrack);
+	void RequestSeek(const ulong& Time);	// Jumps to [Time] samples into the looped playback of the current track
 	void Play();
 	void Stop();	// Waits with returning until thread is done!
 
-	void ClearBuffer();	// Resets whole buffer to zero. Only necessary on game switches.
 	void CloseFile();
 	void Exit();
 
+	// Playback statistics
+	const SinkStats&	Stats()	{return Sink->GetStats();}
+	FXTime	SwitchLatency()	{FXMutexLock L(SwitchLock);	return SwitchLast;}
+	FXTime	SwitchLatencyMax()	{FXMutexLock L(SwitchLock);	return SwitchMax;}
+
+	// Maps [Time] samples into the looped playback of [TI] (intro, then the loop over and over, which is also where the fade goes)
+	// to the position in the source file, in [Fmt]. [LoopNum] receives the number of the pass, with 0 being the first one.
+	static ulong TimelineToSource(TrackInfo* TI, const ulong& Time, const bool& Fmt, ulong* LoopNum = NULL);
+
+	// The reverse: maps source position [Src] in pass [LoopNum] back to samples on the timeline of [TI]
+	static ulong SourceToTimeline(TrackInfo* TI, const ulong& Src, const ulong& LoopNum, const bool& Fmt);
+
 	static Streamer& Inst()
 	{
 		static Streamer Instance;
@@ -80,5 +266,4 @@ public:
 	}
 };
 
-#endif /* WIN32 */
 #endif /* MUSICROOM_STREAM_H */
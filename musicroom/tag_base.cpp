@@ -23,7 +23,7 @@ FieldName operator + (const FieldName& a, const FieldName& b)	{int _a = a, _b =
 FieldName operator - (const FieldName& a, const FieldName& b)	{int _a = a, _b = b;	return (FieldName)(_a - _b);}
 FieldName operator % (const FieldName& a, const FieldName& b)	{int _a = a, _b = b;	return (FieldName)(_a % _b);}
 
-const FXString FNMap_Custom[MAP_END] = {"UNKNOWN", "CIRCLE", "ARTIST", "COMPOSER", "TITLE", "ALBUM", "COMMENT", "ALBUM ARTIST", "TRACKNUMBER", "TOTALTRACKS", "DISCNUMBER", "GENRE", "DATE"};
+const FXString FNMap_Custom[MAP_END] = {"UNKNOWN", "CIRCLE", "ARTIST", "COMPOSER", "TITLE", "ALBUM", "COMMENT", "ALBUM ARTIST", "TRACKNUMBER", "TOTALTRACKS", "DISCNUMBER", "GENRE", "DATE", "LOOPSTART", "LOOPLENGTH"};
 
 FXshort FindMapMatch(FXString& In, const FXString* Map, const FXshort& Limit)
 {
@@ -151,6 +151,13 @@ Field* MRTag::Add(const FieldName& Name, FXString* Data)
 	return New;
 }
 
+FXString* MRTag::Keep(const FXString& Str)
+{
+	FXString* New = &Strings.Add()->Data;
+	*New = Str;
+	return New;
+}
+
 // Returns the value of the [Name] field
 char* MRTag::Get(const FieldName& Name)
 {
@@ -273,6 +280,7 @@ void MRTag::Clear()
 	FN.clear();
 	FTP = FTS = SSP = 0;
 	TF.Clear();
+	Strings.Clear();
 }
 
 MRTag::~MRTag()
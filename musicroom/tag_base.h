@@ -27,6 +27,8 @@ enum FieldName
 	DISCNUMBER,
 	GENRE,
 	YEAR,
+	LOOPSTART,	// in samples
+	LOOPLENGTH,
 	MAP_END,
 	// i18n
 	I18N_BASE = 0x20,
@@ -77,6 +79,7 @@ protected:
 	FXint	SSP;	// Start of the audio data in the source file
 	
 	List<Field>	TF;	// Fields to write
+	List<FXString>	Strings;	// Field values owned by this tag, see Keep()
 
 	// Search for a field name matching [ID]. Mainly takes care of i18n
 	FieldName ParseCustom(FXString ID);
@@ -114,6 +117,7 @@ public:
 
 	Field* Find(const FieldName& Name);
 	Field* Add(const FieldName& Name, FXString* Data);
+	FXString* Keep(const FXString& Str);	// Stores a copy of [Str] that lives as long as this tag. Pass the result to Add().
 	char* Get(const FieldName& Name);	// Returns the value of the [Name] field
 
 	mrerr Open(const FXString& FN);
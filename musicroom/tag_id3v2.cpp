@@ -82,7 +82,7 @@ ulong& ss32::val(const bool& endian, const bool& synchsafe)
 }
 // ------------------------------
 
-const FXString FNMap_ID3v2[MAP_END] = {"TXXX", "", "TPE1", "TCOM", "TIT2", "TALB", "COMM", "", "TRCK", "", "TPOS", "TCON", "TDRC"};
+const FXString FNMap_ID3v2[MAP_END] = {"TXXX", "", "TPE1", "TCOM", "TIT2", "TALB", "COMM", "", "TRCK", "", "TPOS", "TCON", "TDRC", "", ""};
 
 // ID3v2Header
 // -----------
@@ -221,7 +221,9 @@ uint MRTag_ID3v2::FmtRenderField(Field *F, const FXString& CustomID)
 	switch(F->Name)
 	{
 	case CIRCLE:
-	case ALBUM_ARTIST:	return WriteCustom(F, FNMap_Custom[F->Name]);
+	case ALBUM_ARTIST:
+	case LOOPSTART:
+	case LOOPLENGTH:	return WriteCustom(F, FNMap_Custom[F->Name]);
 
 	case TRACK:
 		ID = FNMap_ID3v2[F->Name].text();
@@ -49,28 +49,26 @@ bool Tagger::TagBasic(MRTag* TF, GameInfo* GI, TrackInfo* TI)
 
 	// Prepare strings
 	// ---------------
-	TN[0] = TI->GetNumber();
-	TN[1].fromUInt(ActiveGame->Track.Size());
-	if(GI->Track.Size() < 10)	TN[1].prepend('0');
-
-	Game[Lang] = GI->FullName(Lang);
-	Genre = "Game";
-	Year = FXString::value((FXuint)GI->Year, 10);
+	// Several extraction jobs may be tagging at the same time, so all generated strings are owned by [TF]
+	FXString* TN[2];
+	TN[0] = TF->Keep(TI->GetNumber());
+	TN[1] = TF->Keep(FXString::value((FXuint)ActiveGame->Track.Size(), 10));
+	if(GI->Track.Size() < 10)	TN[1]->prepend('0');
 	// ---------------
 
 	TF->Add(ARTIST, &Cmp->Data[Lang]);
 	TF->Add(COMPOSER, &Cmp->Data[Lang]);
-	TF->Add(GENRE, &Genre);
+	TF->Add(GENRE, TF->Keep("Game"));
 	TF->Add(ALBUM_ARTIST, &GI->Artist[Lang]);
 	TF->Add(CIRCLE, &GI->Circle[Lang]);
 	
 	TF->Add(DISCNUMBER, &ActiveGame->GameNum);
-	TF->Add(TRACK, &TN[0]);
-	TF->Add(TOTALTRACKS, &TN[1]);
-	TF->Add(YEAR, &Year);
+	TF->Add(TRACK, TN[0]);
+	TF->Add(TOTALTRACKS, TN[1]);
+	TF->Add(YEAR, TF->Keep(FXString::value((FXuint)GI->Year, 10)));
 
 	TF->Add(TITLE, &TI->Name[Lang]);
-	TF->Add(ALBUM, &Game[Lang]);
+	TF->Add(ALBUM, TF->Keep(GI->FullName(Lang)));
 
 	return true;
 }
@@ -79,15 +77,16 @@ bool Tagger::TagExt(MRTag* TF, GameInfo* GI, TrackInfo* TI)
 {
 	ListEntry<IntString>* Cmp;
 	FieldName LB;
+	FXString* Comment;	// Owned by [TF], see TagBasic()
 
 	if(!TF || !GI || !TI)	return false;
 
 	Cmp = GI->Composer.Get(TI->CmpID);
 
-	Comment[Lang] = TI->GetComment(Lang);
-	Comment[Lang].substitute("\n", "\r\n");
+	Comment = TF->Keep(TI->GetComment(Lang));
+	Comment->substitute("\n", "\r\n");
 
-	TF->Add(COMMENT, &Comment[Lang]);
+	TF->Add(COMMENT, Comment);
 
 	// i18n
 	for(ushort c = 0; c < LANG_COUNT; c++)
@@ -97,19 +96,30 @@ bool Tagger::TagExt(MRTag* TF, GameInfo* GI, TrackInfo* TI)
 		LB = (FieldName)(I18N_BASE + (c * I18N_MAX));
 
 		// Strings
-		Game[c] = GI->FullName(c);
-		Comment[c] = TI->GetComment(c);
-		Comment[c].substitute("\n", "\r\n");
+		Comment = TF->Keep(TI->GetComment(c));
+		Comment->substitute("\n", "\r\n");
 
 		TF->Add(LB + CIRCLE, &GI->Circle[c]);
 		TF->Add(LB + ARTIST, &Cmp->Data[c]);
 		TF->Add(LB + TITLE, &TI->Name[c]);
-		TF->Add(LB + ALBUM, &Game[c]);
-		TF->Add(LB + COMMENT, &Comment[c]);
+		TF->Add(LB + ALBUM, TF->Keep(GI->FullName(c)));
+		TF->Add(LB + COMMENT, Comment);
 	}
 	return true;
 }
 
+bool Tagger::TagLoop(MRTag* TF, TrackInfo* TI)
+{
+	ulong Start, Len;
+
+	if(!TF || !TI || !LoopMeta)	return false;
+	if(!LoopPoints(TI, &Start, &Len))	return false;
+
+	TF->Add(LOOPSTART, TF->Keep(FXString::value((FXuint)Start, 10)));
+	TF->Add(LOOPLENGTH, TF->Keep(FXString::value((FXuint)Len, 10)));
+	return true;
+}
+
 mrerr Tagger::Tag(TrackInfo* TI, FXString& TagFN, FXString& Ext)
 {
 	FXString Str;
@@ -135,6 +145,7 @@ mrerr Tagger::Tag(TrackInfo* TI, FXString& TagFN, FXString& Ext)
 
 	TagBasic(TF, ActiveGame, TI);
 	TagExt(TF, ActiveGame, TI);
+	TagLoop(TF, TI);
 
 	Ret = TF->Save();
 	if(Ret != SUCCESS)
@@ -266,7 +277,8 @@ FXint Tagger::run()
 	StopReq = false;
 	Active = true;
 
-	Ext = Encoders.Get(EncFmt - 1)->Data->Ext.lower();
+	Ext = Encoders.Get(EncFmt - 1)->Data->Ext;
+	Ext.lower();
 	
 	Stat.format("Updating tags...\nDirectory: %s\n----------------", OutPath);
 	BGMLib::UI_Stat_Safe(Stat);
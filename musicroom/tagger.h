@@ -10,13 +10,6 @@ class MRTag;
 class Tagger : public FXThread, FXObject
 {
 protected:
-	// Temporary string storage
-	FXString Comment[LANG_COUNT];
-	FXString Game[LANG_COUNT];
-	FXString TN[3];
-	FXString Genre;
-	FXString Year;
-
 	volatile bool StopReq;
 
 	bool Search(TrackInfo* TI, const FXString& Ext, FXString* FN);	// Searches for a file which might match the given track
@@ -31,6 +24,7 @@ public:
 
 	bool TagBasic(MRTag* TF, GameInfo* GI, TrackInfo* TI);	// Writes only the basic tags 
 	bool TagExt(MRTag* TF, GameInfo* GI, TrackInfo* TI);	// Writes comments and other language tags
+	bool TagLoop(MRTag* TF, TrackInfo* TI);	// Writes the loop points, if <LoopMeta> is set
 
 	// Writes complete tags of [TI] for the [Ext] format to [TagFN]
 	mrerr Tag(TrackInfo* TI, FXString& TagFN, FXString& Ext);
@@ -65,9 +65,32 @@ LCButtonFrame::LCButtonFrame(FXComposite* p, long ApplyID)
 
 // Modified Table
 // --------------
+FXDEFMAP(LCTable) MMTable[] =
+{
+	FXMAPFUNC(SEL_MOTION, 0, LCTable::onMotion),
+};
+
+FXIMPLEMENT(LCTable, FXTable, MMTable, ARRAYNUMBER(MMTable));
+
 LCTable::LCTable(FXComposite *p, FXObject* tgt, FXSelector sel, FXuint opts, FXint x, FXint y, FXint w, FXint h, FXint pl, FXint pr, FXint pt, FXint pb)
 	: FXTable(p, tgt, sel, opts, x, y, w, h, pl, pr, pt, pb)
 {
+	HoverRow = -1;
+}
+
+long LCTable::onMotion(FXObject* Sender, FXSelector Message, void* ptr)
+{
+	FXEvent* Event = (FXEvent*)ptr;
+	long Ret = FXTable::onMotion(Sender, Message, ptr);
+	FXint Row = rowAtY(Event->win_y);
+
+	if(Row >= getNumRows())	Row = -1;
+	if(Row != HoverRow)
+	{
+		HoverRow = Row;
+		if(target)	target->tryHandle(this, FXSEL(SEL_MOTION, message), (void*)(FXival)Row);
+	}
+	return Ret;
 }
 
 void LCTable::fitColumnsToContents(FX::FXint col, FX::FXint nc)
@@ -29,9 +29,19 @@ public:
 // --------------
 class LCTable : public FXTable
 {
+	FXDECLARE(LCTable);
+
+protected:
+	FXint	HoverRow;	// Row under the mouse cursor
+
+	LCTable()	{}
+
 public:
 	LCTable(FXComposite *p,FXObject* tgt=NULL,FXSelector sel=0,FXuint opts=0,FXint x=0,FXint y=0,FXint w=0,FXint h=0,FXint pl=DEFAULT_MARGIN,FXint pr=DEFAULT_MARGIN,FXint pt=DEFAULT_MARGIN,FXint pb=DEFAULT_MARGIN);
 
+	// Sends SEL_MOTION to the target whenever the mouse cursor enters a different row. [ptr] is the row index, or -1.
+	long onMotion(FXObject*,FXSelector,void*);
+
 	// Fit column widths to contents
 	void fitColumnsToContents(FXint col,FXint nc=1);
 };
@@ -143,6 +143,11 @@ typedef struct OggVorbis_File {
 
   ov_callbacks callbacks;
 
+  int             *shared; /* reference count of the link tables and
+                              headers above if they're shared with
+                              other handles through ov_dup(); NULL if
+                              owned exclusively */
+
 } OggVorbis_File;
 
 
@@ -157,6 +162,9 @@ extern int ov_test_callbacks(void *datasource, OggVorbis_File *vf,
                 const char *initial, long ibytes, ov_callbacks callbacks);
 extern int ov_test_open(OggVorbis_File *vf);
 
+extern int ov_dup(OggVorbis_File *src,OggVorbis_File *vf,void *datasource,
+                  ov_callbacks callbacks);
+
 extern long ov_bitrate(OggVorbis_File *vf,int i);
 extern long ov_bitrate_instant(OggVorbis_File *vf);
 extern long ov_streams(OggVorbis_File *vf);
@@ -232,17 +232,9 @@ static int _vds_shared_init(vorbis_dsp_state *v,vorbis_info *vi,int encp){
     v->analysisp=1;
   }else{
     /* finish the codebooks */
-    if(!ci->fullbooks){
-      ci->fullbooks=_ogg_calloc(ci->books,sizeof(*ci->fullbooks));
-      for(i=0;i<ci->books;i++){
-        if(ci->book_param[i]==NULL)
-          goto abort_books;
-        if(vorbis_book_init_decode(ci->fullbooks+i,ci->book_param[i]))
-          goto abort_books;
-        /* decode codebooks are now standalone after init */
-        vorbis_staticbook_destroy(ci->book_param[i]);
-        ci->book_param[i]=NULL;
-      }
+    if(_vorbis_decode_books(vi)){
+      vorbis_dsp_clear(v);
+      return -1;
     }
   }
 
@@ -280,6 +272,29 @@ static int _vds_shared_init(vorbis_dsp_state *v,vorbis_info *vi,int encp){
       look(v,ci->residue_param[i]);
 
   return 0;
+}
+
+/* finish the decode codebooks of a codec setup.  They're kept in the
+   setup, so every decoder initialized from the same vorbis_info (or
+   from a vorbis_info sharing its setup) reuses them */
+int _vorbis_decode_books(vorbis_info *vi){
+  codec_setup_info *ci=vi->codec_setup;
+  int i;
+
+  if(ci==NULL) return 1;
+  if(ci->fullbooks) return 0;
+
+  ci->fullbooks=_ogg_calloc(ci->books,sizeof(*ci->fullbooks));
+  for(i=0;i<ci->books;i++){
+    if(ci->book_param[i]==NULL)
+      goto abort_books;
+    if(vorbis_book_init_decode(ci->fullbooks+i,ci->book_param[i]))
+      goto abort_books;
+    /* decode codebooks are now standalone after init */
+    vorbis_staticbook_destroy(ci->book_param[i]);
+    ci->book_param[i]=NULL;
+  }
+  return 0;
  abort_books:
   for(i=0;i<ci->books;i++){
     if(ci->book_param[i]!=NULL){
@@ -287,7 +302,6 @@ static int _vds_shared_init(vorbis_dsp_state *v,vorbis_info *vi,int encp){
       ci->book_param[i]=NULL;
     }
   }
-  vorbis_dsp_clear(v);
   return -1;
 }
 
@@ -128,6 +128,14 @@ typedef struct codec_setup_info {
                                 highly redundant structure, but
                                 improves clarity of program flow. */
   int         halfrate_flag; /* painless downsample for decode */
+
+  /* decode only; identifies the setup header this was unpacked from,
+     so that links of a chained stream can share one setup */
+  ogg_uint32_t  setup_hash;   /* quick reject only */
+  unsigned char *setup_packet;
+  long          setup_bytes;
+  volatile long refs;        /* additional vorbis_infos sharing this;
+                                only touched through _vorbis_refs_*() */
 } codec_setup_info;
 
 extern vorbis_look_psy_global *_vp_global_look(vorbis_info *vi);
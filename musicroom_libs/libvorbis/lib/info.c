@@ -31,10 +31,33 @@
 #include "misc.h"
 #include "os.h"
 
+#ifdef _WIN32
+#include <intrin.h>
+#pragma intrinsic(_InterlockedIncrement,_InterlockedDecrement)
+#endif
+
 #define GENERAL_VENDOR_STRING "Xiph.Org libVorbis 1.3.2"
 #define ENCODE_VENDOR_STRING "Xiph.Org libVorbis I 20101101 (Schaufenugget)"
 
 /* helpers */
+
+/* links sharing a setup may be cleared from different threads */
+static long _vorbis_refs_inc(volatile long *refs){
+#ifdef _WIN32
+  return _InterlockedIncrement(refs);
+#else
+  return __sync_add_and_fetch(refs,1);
+#endif
+}
+
+static long _vorbis_refs_dec(volatile long *refs){
+#ifdef _WIN32
+  return _InterlockedDecrement(refs);
+#else
+  return __sync_sub_and_fetch(refs,1);
+#endif
+}
+
 static int ilog2(unsigned int v){
   int ret=0;
   if(v)--v;
@@ -163,6 +186,14 @@ void vorbis_info_clear(vorbis_info *vi){
 
   if(ci){
 
+    if(_vorbis_refs_dec(&ci->refs)>=0){
+      /* still used by another vorbis_info; just detach */
+      memset(vi,0,sizeof(*vi));
+      return;
+    }
+
+    if(ci->setup_packet)_ogg_free(ci->setup_packet);
+
     for(i=0;i<ci->modes;i++)
       if(ci->mode_param[i])_ogg_free(ci->mode_param[i]);
 
@@ -371,6 +402,28 @@ int vorbis_synthesis_idheader(ogg_packet *op){
   return 0;
 }
 
+/* remember the setup header, along with a 32 bit FNV-1a hash of it
+   to quickly tell different ones apart */
+static void _vorbis_setup_hash(vorbis_info *vi,ogg_packet *op){
+  codec_setup_info *ci=vi->codec_setup;
+  ogg_uint32_t hash=2166136261U;
+  long i;
+
+  for(i=0;i<op->bytes;i++){
+    hash^=op->packet[i];
+    hash*=16777619U;
+  }
+  if(ci->setup_packet)_ogg_free(ci->setup_packet);
+  ci->setup_packet=_ogg_malloc(op->bytes);
+  if(!ci->setup_packet){
+    ci->setup_bytes=0;
+    return;
+  }
+  memcpy(ci->setup_packet,op->packet,op->bytes);
+  ci->setup_hash=hash;
+  ci->setup_bytes=op->bytes;
+}
+
 /* The Vorbis header is in three packets; the initial small packet in
    the first page that identifies basic parameters, a second packet
    with bitstream comments and a third packet that holds the
@@ -420,7 +473,11 @@ int vorbis_synthesis_headerin(vorbis_info *vi,vorbis_comment *vc,ogg_packet *op)
           return(OV_EBADHEADER);
         }
 
-        return(_vorbis_unpack_books(vi,&opb));
+        {
+          int ret=_vorbis_unpack_books(vi,&opb);
+          if(!ret)_vorbis_setup_hash(vi,op);
+          return(ret);
+        }
 
       default:
         /* Not a valid vorbis header type */
@@ -432,6 +489,45 @@ int vorbis_synthesis_headerin(vorbis_info *vi,vorbis_comment *vc,ogg_packet *op)
   return(OV_EBADHEADER);
 }
 
+/* Lets [dst] use the codec setup of [src] instead of its own, if both
+   were unpacked from identical setup headers.  The decoded codebooks
+   and all floor/residue/mapping setup are then kept only once, and
+   decoders of both share them.  The setup is freed by the last
+   vorbis_info_clear() of either.
+
+   return: 0) now shared (or already was)
+           1) setups differ, nothing done */
+
+int _vorbis_info_share(vorbis_info *dst,vorbis_info *src){
+  codec_setup_info *ci=src->codec_setup;
+  codec_setup_info *di=dst->codec_setup;
+  vorbis_info old;
+
+  if(!ci || !di)return 1;
+  if(ci==di)return 0;
+
+  /* only a setup nobody else refers to can be dropped */
+  if(di->refs)return 1;
+  if(!ci->setup_bytes || ci->setup_bytes!=di->setup_bytes ||
+     ci->setup_hash!=di->setup_hash)return 1;
+  if(memcmp(ci->setup_packet,di->setup_packet,ci->setup_bytes))return 1;
+
+  /* the setup header is decoded in the context of the id header */
+  if(src->channels!=dst->channels ||
+     ci->blocksizes[0]!=di->blocksizes[0] ||
+     ci->blocksizes[1]!=di->blocksizes[1] ||
+     ci->halfrate_flag!=di->halfrate_flag)return 1;
+  if(ci->books!=di->books || ci->modes!=di->modes ||
+     ci->maps!=di->maps || ci->floors!=di->floors ||
+     ci->residues!=di->residues)return 1;
+
+  old=*dst;
+  vorbis_info_clear(&old);
+  dst->codec_setup=ci;
+  _vorbis_refs_inc(&ci->refs);
+  return 0;
+}
+
 /* pack side **********************************************************/
 
 static int _vorbis_pack_info(oggpack_buffer *opb,vorbis_info *vi){
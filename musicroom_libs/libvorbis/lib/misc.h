@@ -21,6 +21,8 @@
 
 extern void *_vorbis_block_alloc(vorbis_block *vb,long bytes);
 extern void _vorbis_block_ripcord(vorbis_block *vb);
+extern int _vorbis_decode_books(vorbis_info *vi);
+extern int _vorbis_info_share(vorbis_info *dst,vorbis_info *src);
 
 #ifdef ANALYSIS
 extern int analysis_noisy;
@@ -64,6 +64,26 @@
 #define CHUNKSIZE 65536 /* greater-than-page-size granularity seeking */
 #define READSIZE 2048 /* a smaller read size is needed for low-rate streaming. */
 
+/* handles created through ov_dup() may be cleared from different
+   threads, so the reference count of their shared tables has to be
+   maintained atomically */
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define _ov_ref_inc(x) _InterlockedIncrement((long volatile *)(x))
+#define _ov_ref_dec(x) _InterlockedDecrement((long volatile *)(x))
+#else
+#define _ov_ref_inc(x) __sync_add_and_fetch((x),1)
+#define _ov_ref_dec(x) __sync_sub_and_fetch((x),1)
+#endif
+
+/* ov_read's native signed 16 bit packing is vectorized where
+   vorbis_ftoi() already rounds to nearest-even, so both agree bit for
+   bit */
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define OV_PACK_SSE2
+#include <emmintrin.h>
+#endif
+
 static long _get_data(OggVorbis_File *vf){
   errno=0;
   if(!(vf->callbacks.read_func))return(-1);
@@ -600,7 +620,24 @@ static int _make_decode_ready(OggVorbis_File *vf){
   if(vf->ready_state>STREAMSET)return 0;
   if(vf->ready_state<STREAMSET)return OV_EFAULT;
   if(vf->seekable){
-    if(vorbis_synthesis_init(&vf->vd,vf->vi+vf->current_link))
+    vorbis_info *vi=vf->vi+vf->current_link;
+
+    /* a decoder kept across a link boundary can be restarted as long
+       as the new link shares its codec setup */
+    if(vf->vd.vi){
+      if(vf->vd.vi->codec_setup==vi->codec_setup &&
+         vf->vd.vi->channels==vi->channels){
+        vf->vd.vi=vi;
+        vorbis_synthesis_restart(&vf->vd);
+        vf->ready_state=INITSET;
+        vf->bittrack=0.f;
+        vf->samptrack=0.f;
+        return 0;
+      }
+      vorbis_dsp_clear(&vf->vd);
+      vorbis_block_clear(&vf->vb);
+    }
+    if(vorbis_synthesis_init(&vf->vd,vi))
       return OV_EBADLINK;
   }else{
     if(vorbis_synthesis_init(&vf->vd,vf->vi))
@@ -652,6 +689,15 @@ static int _open_seekable2(OggVorbis_File *vf){
   vf->pcmlengths[1]-=pcmoffset;
   if(vf->pcmlengths[1]<0)vf->pcmlengths[1]=0;
 
+  /* links of a chained stream usually carry identical setup headers;
+     keep only one decoded copy of each distinct setup */
+  {
+    int i,j;
+    for(i=1;i<vf->links;i++)
+      for(j=0;j<i;j++)
+        if(!_vorbis_info_share(vf->vi+i,vf->vi+j))break;
+  }
+
   return(ov_raw_seek(vf,dataoffset));
 }
 
@@ -662,6 +708,16 @@ static void _decode_clear(OggVorbis_File *vf){
   vf->ready_state=OPENED;
 }
 
+/* leave the current logical bitstream.  When seekable, the decoder
+   itself is kept, so that _make_decode_ready() can reuse it if the
+   next link shares its codec setup */
+static void _decode_leave(OggVorbis_File *vf){
+  if(vf->seekable)
+    vf->ready_state=OPENED;
+  else
+    _decode_clear(vf);
+}
+
 /* fetch and process a packet.  Handles the case where we're at a
    bitstream boundary and dumps the decoding machine.  If the decoding
    machine is unloaded, it loads it.  It also keeps pcm_offset up to
@@ -795,7 +851,7 @@ static int _fetch_and_process_packet(OggVorbis_File *vf,
               if(!spanp)
                 return(OV_EOF);
 
-              _decode_clear(vf);
+              _decode_leave(vf);
 
               if(!vf->seekable){
                 vorbis_info_clear(vf->vi);
@@ -958,19 +1014,23 @@ int ov_clear(OggVorbis_File *vf){
     vorbis_dsp_clear(&vf->vd);
     ogg_stream_clear(&vf->os);
 
-    if(vf->vi && vf->links){
-      int i;
-      for(i=0;i<vf->links;i++){
-        vorbis_info_clear(vf->vi+i);
-        vorbis_comment_clear(vf->vc+i);
+    /* the last handle sharing the tables frees them */
+    if(!vf->shared || _ov_ref_dec(vf->shared)==0){
+      if(vf->vi && vf->links){
+        int i;
+        for(i=0;i<vf->links;i++){
+          vorbis_info_clear(vf->vi+i);
+          vorbis_comment_clear(vf->vc+i);
+        }
+        _ogg_free(vf->vi);
+        _ogg_free(vf->vc);
       }
-      _ogg_free(vf->vi);
-      _ogg_free(vf->vc);
+      if(vf->dataoffsets)_ogg_free(vf->dataoffsets);
+      if(vf->pcmlengths)_ogg_free(vf->pcmlengths);
+      if(vf->serialnos)_ogg_free(vf->serialnos);
+      if(vf->offsets)_ogg_free(vf->offsets);
+      if(vf->shared)_ogg_free(vf->shared);
     }
-    if(vf->dataoffsets)_ogg_free(vf->dataoffsets);
-    if(vf->pcmlengths)_ogg_free(vf->pcmlengths);
-    if(vf->serialnos)_ogg_free(vf->serialnos);
-    if(vf->offsets)_ogg_free(vf->offsets);
     ogg_sync_clear(&vf->oy);
     if(vf->datasource && vf->callbacks.close_func)
       (vf->callbacks.close_func)(vf->datasource);
@@ -1025,6 +1085,8 @@ int ov_fopen(const char *path,OggVorbis_File *vf){
 int ov_halfrate(OggVorbis_File *vf,int flag){
   int i;
   if(vf->vi==NULL)return OV_EINVAL;
+  /* the flag lives in the codec setup, which other handles may share */
+  if(vf->shared)return OV_EINVAL;
   if(vf->ready_state>STREAMSET){
     /* clear out stream state; dumping the decode machine is needed to
        reinit the MDCT lookups. */
@@ -1036,6 +1098,10 @@ int ov_halfrate(OggVorbis_File *vf,int flag){
       vf->pcm_offset=-1; /* make sure the pos is dumped if unseekable */
       ov_pcm_seek(vf,pos);
     }
+  }else{
+    /* a decoder kept across a link boundary has the old lookups, too */
+    vorbis_dsp_clear(&vf->vd);
+    vorbis_block_clear(&vf->vb);
   }
 
   for(i=0;i<vf->links;i++){
@@ -1079,6 +1145,69 @@ int ov_test_open(OggVorbis_File *vf){
   return _ov_open2(vf);
 }
 
+/* Opens a second, independent reader on a file that is already fully
+   open in [src].  [datasource] has to refer to the same physical
+   bitstream.  The new handle gets its own framing, stream and decode
+   state and its own file position, but shares the link tables, the
+   vorbis_info/vorbis_comment of every link and with them the decoded
+   codebooks with [src]; nothing is re-read and no links are
+   re-discovered.  Both handles can then be used and ov_clear()ed
+   independently, from different threads.
+
+   Dups of the same [src] must not be created concurrently.
+
+   return: 0) OK, positioned at the start of the first link
+           OV_EINVAL) [src] is not fully open or not seekable
+           OV_EBADLINK) the codebooks of a link couldn't be decoded
+           else the result of the initial seek */
+
+int ov_dup(OggVorbis_File *src,OggVorbis_File *vf,void *datasource,
+           ov_callbacks callbacks){
+  int i,ret;
+
+  if(src==NULL || vf==NULL || src==vf)return(OV_EINVAL);
+  if(src->ready_state<OPENED || !src->seekable)return(OV_EINVAL);
+  if(!callbacks.seek_func || !callbacks.tell_func)return(OV_EINVAL);
+
+  /* vorbis_synthesis_init() finishes the codebooks lazily, which would
+     race between handles; do it for all links now */
+  for(i=0;i<src->links;i++)
+    if(_vorbis_decode_books(src->vi+i))return(OV_EBADLINK);
+
+  if(!src->shared){
+    src->shared=_ogg_malloc(sizeof(*src->shared));
+    *src->shared=1;
+  }
+  _ov_ref_inc(src->shared);
+
+  memset(vf,0,sizeof(*vf));
+  vf->datasource=datasource;
+  vf->callbacks=callbacks;
+  vf->seekable=1;
+  vf->offset=-1; /* force the first seek */
+  vf->end=src->end;
+
+  vf->links=src->links;
+  vf->offsets=src->offsets;
+  vf->dataoffsets=src->dataoffsets;
+  vf->serialnos=src->serialnos;
+  vf->pcmlengths=src->pcmlengths;
+  vf->vi=src->vi;
+  vf->vc=src->vc;
+  vf->shared=src->shared;
+
+  ogg_sync_init(&vf->oy);
+  ogg_stream_init(&vf->os,-1);
+  vf->ready_state=OPENED;
+
+  ret=ov_raw_seek(vf,vf->dataoffsets[0]);
+  if(ret){
+    vf->datasource=NULL;
+    ov_clear(vf);
+  }
+  return(ret);
+}
+
 /* How many logical bitstreams in this physical bitstream? */
 long ov_streams(OggVorbis_File *vf){
   return vf->links;
@@ -1239,7 +1368,7 @@ int ov_raw_seek(OggVorbis_File *vf,ogg_int64_t pos){
   /* is the seek position outside our current link [if any]? */
   if(vf->ready_state>=STREAMSET){
     if(pos<vf->offsets[vf->current_link] || pos>=vf->offsets[vf->current_link+1])
-      _decode_clear(vf); /* clear out stream state */
+      _decode_leave(vf); /* clear out stream state */
   }
 
   /* don't yet clear out decoding machine (if it's initialized), in
@@ -1351,7 +1480,7 @@ int ov_raw_seek(OggVorbis_File *vf,ogg_int64_t pos){
 
           if(ogg_page_bos(&og)){
             /* we traversed */
-            _decode_clear(vf); /* clear out stream state */
+            _decode_leave(vf); /* clear out stream state */
             ogg_stream_clear(&work_os);
           } /* else, do nothing; next loop will scoop another page */
         }
@@ -1516,8 +1645,8 @@ int ov_pcm_seek_page(OggVorbis_File *vf,ogg_int64_t pos){
       if(result<0) goto seek_error;
 
       if(link!=vf->current_link){
-        /* Different link; dump entire decode machine */
-        _decode_clear(vf);
+        /* Different link; dump the stream state */
+        _decode_leave(vf);
 
         vf->current_link=link;
         vf->current_serialno=vf->serialnos[link];
@@ -1638,7 +1767,7 @@ int ov_pcm_seek(OggVorbis_File *vf,ogg_int64_t pos){
 
       /* suck in a new page */
       if(_get_next_page(vf,&og,-1)<0)break;
-      if(ogg_page_bos(&og))_decode_clear(vf);
+      if(ogg_page_bos(&og))_decode_leave(vf);
 
       if(vf->ready_state<STREAMSET){
         long serialno=ogg_page_serialno(&og);
@@ -1830,6 +1959,42 @@ static int host_is_big_endian() {
   return 0;
 }
 
+/* packs the first frames of mono or stereo float PCM into interleaved
+   native signed 16 bit samples, 8 frames at a time.  Returns the number
+   of frames done; the caller's scalar loop handles the rest.
+   _mm_cvtps_epi32 rounds to nearest-even like vorbis_ftoi(), and
+   _mm_packs_epi32 saturates like the clamp.  Out-of-range and NaN
+   input converts to 0x80000000 in both. */
+static long _pack_s16_native(float **pcm,long channels,long samples,
+                             short *dest){
+  long j=0;
+#ifdef OV_PACK_SSE2
+  const __m128 scale=_mm_set1_ps(32768.f);
+  if(channels==1){
+    float *src=pcm[0];
+    for(;j+8<=samples;j+=8){
+      __m128i a=_mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(src+j),scale));
+      __m128i b=_mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(src+j+4),scale));
+      _mm_storeu_si128((__m128i *)(dest+j),_mm_packs_epi32(a,b));
+    }
+  }else if(channels==2){
+    float *l=pcm[0];
+    float *r=pcm[1];
+    for(;j+8<=samples;j+=8){
+      __m128i lv=_mm_packs_epi32(
+        _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(l+j),scale)),
+        _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(l+j+4),scale)));
+      __m128i rv=_mm_packs_epi32(
+        _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(r+j),scale)),
+        _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(r+j+4),scale)));
+      _mm_storeu_si128((__m128i *)(dest+j*2),_mm_unpacklo_epi16(lv,rv));
+      _mm_storeu_si128((__m128i *)(dest+j*2+8),_mm_unpackhi_epi16(lv,rv));
+    }
+  }
+#endif
+  return j;
+}
+
 /* up to this point, everything could more or less hide the multiple
    logical bitstream nature of chaining from the toplevel application
    if the toplevel application didn't particularly care.  However, at
@@ -1930,12 +2095,14 @@ long ov_read_filter(OggVorbis_File *vf,char *buffer,int length,
 
         if(host_endian==bigendianp){
           if(sgned){
+            long done;
 
             vorbis_fpu_setround(&fpu);
+            done=_pack_s16_native(pcm,channels,samples,(short *)buffer);
             for(i=0;i<channels;i++) { /* It's faster in this order */
               float *src=pcm[i];
-              short *dest=((short *)buffer)+i;
-              for(j=0;j<samples;j++) {
+              short *dest=((short *)buffer)+done*channels+i;
+              for(j=done;j<samples;j++) {
                 val=vorbis_ftoi(src[j]*32768.f);
                 if(val>32767)val=32767;
                 else if(val<-32768)val=-32768;